@@ -0,0 +1,639 @@
+// Micro-benchmarks for Flare's core data structures, editing and file handling. This only
+// uses the headless core, so it runs without a display.
+//
+// Results are written as JSON, to stdout or to the file given with --output, so that runs
+// from different releases can be compared by a script.
+//
+//  flare_bench [--output results.json] [--filter name] [--max-size bytes] [--min-time seconds]
+
+#include "history_tracker.hpp"
+#include "document.hpp"
+#include "piece_table.hpp"
+#include "size_utilities.hpp"
+#include "extension_map.hpp"
+#include "file_utilities.hpp"
+#include "search.hpp"
+#include "regex.hpp"
+#include "highlighter.hpp"
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <deque>
+#include <list>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+
+namespace {
+
+struct Result {
+    std::string name;
+    unsigned long long size, iterations, bytes;
+    double seconds;
+};
+
+std::vector<Result> results;
+std::string filter;
+double min_time = 0.25;
+unsigned long long max_size = 1ull<<30;
+
+// Written to so that the work being timed can't be optimized away.
+volatile unsigned long long sink;
+
+// Runs `body' with more and more iterations until it takes at least min_time, and records
+// the time per iteration. `bytes' is how much data one iteration goes through, if that
+// means anything for the benchmark.
+template<class F>
+void Measure(const std::string &name, unsigned long long size, unsigned long long bytes, F body){
+    if(!filter.empty() && name.find(filter)==std::string::npos)
+        return;
+
+    unsigned long long iterations = 1;
+    while(true){
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        body(iterations);
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+
+        if(seconds>=min_time || iterations>=(1ull<<40)){
+            const Result result = {name, size, iterations, bytes, seconds};
+            results.push_back(result);
+            fprintf(stderr, "%-40s %12llu %14.1f ns\n", name.c_str(), size, seconds*1e9/iterations);
+            return;
+        }
+
+        // Aim a little past min_time, so the next run is normally the last.
+        const double scale = (seconds>0) ? (min_time*1.5/seconds) : 100.0;
+        iterations = (unsigned long long)(iterations*((scale>100.0) ? 100.0 : ((scale<2.0) ? 2.0 : scale)));
+    }
+}
+
+void WriteResults(FILE *to){
+    fputs("{\n  \"benchmark\": \"flare\",\n  \"results\": [\n", to);
+    for(std::vector<Result>::const_iterator i = results.begin(); i!=results.end(); i++){
+        const double ns = i->seconds*1e9/i->iterations;
+        fprintf(to, "    {\"name\": \"%s\", \"size\": %llu, \"iterations\": %llu, \"seconds\": %.6f, \"ns_per_iteration\": %.3f",
+            i->name.c_str(), i->size, i->iterations, i->seconds, ns);
+        if(i->bytes)
+            fprintf(to, ", \"mb_per_second\": %.3f", (i->bytes*(double)i->iterations)/(i->seconds*1e6));
+        fputs((i+1==results.end()) ? "}\n" : "},\n", to);
+    }
+    fputs("  ]\n}\n", to);
+}
+
+// Pseudo-random, but the same on every run.
+struct Random {
+    unsigned long long state;
+    explicit Random(unsigned long long seed) : state(seed){}
+    unsigned next(){
+        state = state*6364136223846793005ull+1442695040888963407ull;
+        return state>>33;
+    }
+};
+
+// Lines of lowercase words and numbers, like source or prose would have.
+char *GenerateText(unsigned long long length){
+    char * const text = (char *)malloc(length);
+    Random random(length);
+    unsigned long long at = 0;
+    unsigned column = 0;
+    while(at<length){
+        const unsigned r = random.next();
+        if(column>60 || at+1==length){
+            text[at++] = '\n';
+            column = 0;
+        }
+        else if(r%8==0){
+            text[at++] = '0'+(r>>3)%10;
+            column++;
+        }
+        else if(r%6==0){
+            text[at++] = ' ';
+            column++;
+        }
+        else{
+            text[at++] = 'a'+(r>>3)%26;
+            column++;
+        }
+    }
+    return text;
+}
+
+//
+// History containers. Every entry counts as 64 bytes against the size limit.
+//
+
+void NoDelete(unsigned long){}
+size_t EntrySize(size_t a, unsigned long){ return a+64; }
+
+const size_t history_limit = 0x3FFFF, history_unlimited = ~(size_t)0;
+
+template<class Tracker>
+void BenchTracker(const char *name, unsigned long count){
+    Measure(name, count, 0, [count](unsigned long long n){
+        for(unsigned long long r = 0; r<n; r++){
+            Tracker tracker;
+            for(unsigned long i = 0; i<count; i++)
+                tracker.push_back(i);
+            sink = tracker.size();
+        }
+    });
+}
+
+// The standard containers, keeping to the same limit as the trackers by dropping from the
+// front, which is the expensive part for a vector.
+template<class Container>
+void BenchContainer(const char *name, unsigned long count, size_t limit){
+    Measure(name, count, 0, [count, limit](unsigned long long n){
+        for(unsigned long long r = 0; r<n; r++){
+            Container container;
+            size_t size = 0;
+            for(unsigned long i = 0; i<count; i++){
+                size = EntrySize(size, i);
+                while(!container.empty() && size>limit){
+                    size-=64;
+                    container.erase(container.begin());
+                }
+                container.push_back(i);
+            }
+            sink = container.size();
+        }
+    });
+}
+
+void BenchHistory(){
+    const unsigned long count = 100000;
+
+    BenchTracker<Pluto::HistoryTracker<unsigned long, NoDelete, EntrySize, history_unlimited> >("history/push/HistoryTracker", count);
+    BenchTracker<Pluto::RingHistoryTracker<unsigned long, NoDelete, EntrySize, history_unlimited> >("history/push/RingHistoryTracker", count);
+    BenchContainer<std::vector<unsigned long> >("history/push/vector", count, history_unlimited);
+    BenchContainer<std::deque<unsigned long> >("history/push/deque", count, history_unlimited);
+    BenchContainer<std::list<unsigned long> >("history/push/list", count, history_unlimited);
+
+    BenchTracker<Pluto::HistoryTracker<unsigned long, NoDelete, EntrySize, history_limit> >("history/limited/HistoryTracker", count);
+    BenchTracker<Pluto::RingHistoryTracker<unsigned long, NoDelete, EntrySize, history_limit> >("history/limited/RingHistoryTracker", count);
+    BenchContainer<std::vector<unsigned long> >("history/limited/vector", count, history_limit);
+    BenchContainer<std::deque<unsigned long> >("history/limited/deque", count, history_limit);
+    BenchContainer<std::list<unsigned long> >("history/limited/list", count, history_limit);
+}
+
+//
+// Editing a Document, which is what the editor widget does underneath.
+//
+
+// Types `keys' characters in bursts of 64, each burst somewhere else in the text so that
+// it is its own step to undo.
+void TypeBursts(Flare::Document &document, unsigned long keys){
+    Flare::Text_Buffer &buffer = document.buffer();
+    Random random(keys);
+    char key[2] = {0, 0};
+    unsigned long at = 0;
+    for(unsigned long i = 0; i<keys; i++){
+        if(i%64==0)
+            at = random.next()%(buffer.length()+1);
+        key[0] = (i%8==7) ? ' ' : 'a'+(i%26);
+        buffer.insert(at++, key);
+    }
+}
+
+void BenchEditing(){
+    const unsigned long keys = 100000;
+
+    Measure("edit/type", keys, 0, [keys](unsigned long long n){
+        for(unsigned long long r = 0; r<n; r++){
+            Flare::Document document;
+            TypeBursts(document, keys);
+            sink = document.historySteps();
+        }
+    });
+
+    // Typing straight after a big paste, which grows the same step as the paste.
+    {
+        char * const text = GenerateText(0x10000);
+        text[0xFFFF] = 0;
+        Measure("edit/type_after_paste", keys, 0, [keys, text](unsigned long long n){
+            for(unsigned long long r = 0; r<n; r++){
+                Flare::Document document;
+                Flare::Text_Buffer &buffer = document.buffer();
+                buffer.insert(0, text);
+                const char key[2] = {'a', 0};
+                for(unsigned long i = 0; i<keys; i++)
+                    buffer.insert(buffer.length(), key);
+                sink = document.historySteps();
+            }
+        });
+        free(text);
+    }
+
+    // Backspacing over all of it, which is grown into one step.
+    {
+        char * const text = GenerateText(keys);
+        text[keys-1] = 0;
+        Measure("edit/backspace", keys, 0, [keys, text](unsigned long long n){
+            for(unsigned long long r = 0; r<n; r++){
+                Flare::Document document;
+                document.reset(text);
+                Flare::Text_Buffer &buffer = document.buffer();
+                for(int at = buffer.length(); at>0; at--)
+                    buffer.remove(at-1, at);
+                sink = document.historySteps();
+            }
+        });
+        free(text);
+    }
+
+    {
+        Flare::Document document;
+        document.historyBudget(~(size_t)0);
+        TypeBursts(document, keys);
+        Measure("edit/undo_redo_all", document.historySteps(), 0, [&document](unsigned long long n){
+            for(unsigned long long r = 0; r<n; r++){
+                while(document.canUndo())
+                    document.undo();
+                while(document.canRedo())
+                    document.redo();
+            }
+            sink = document.length();
+        });
+    }
+
+    // Walking back and forth through a history with a branch every 16 bursts.
+    {
+        Flare::Document document;
+        document.historyBudget(~(size_t)0);
+        for(unsigned b = 0; b<200; b++){
+            TypeBursts(document, 64*16);
+            for(unsigned u = 0; u<8; u++)
+                document.undo();
+        }
+        Measure("edit/earlier_later", document.historySteps(), 0, [&document](unsigned long long n){
+            for(unsigned long long r = 0; r<n; r++)
+                document.earlier();
+            for(unsigned long long r = 0; r<n; r++)
+                document.later();
+            sink = document.length();
+        });
+    }
+
+    // A character typed at each of many places far apart, in a gap buffer and in a piece
+    // table. The gap has to be moved to each one.
+    {
+        const unsigned long size = (max_size<(1ull<<26)) ? max_size : (1ull<<26);
+        const unsigned long edits = 1000;
+        char * const text = GenerateText(size);
+        text[size-1] = 0;
+
+        Flare::Document document;
+        document.reset(text);
+        Measure("edit/scattered/gap_buffer", edits, 0, [&document, edits](unsigned long long n){
+            Flare::Text_Buffer &buffer = document.buffer();
+            Random random(edits);
+            for(unsigned long long r = 0; r<n; r++){
+                for(unsigned long i = 0; i<edits; i++)
+                    buffer.insert(random.next()%buffer.length(), "x");
+                for(unsigned long i = 0; i<edits; i++)
+                    document.undo();
+            }
+            sink = document.length();
+        });
+
+        Flare::PieceTable table;
+        table.reset(text, size-1);
+        Measure("edit/scattered/piece_table", edits, 0, [&table, edits](unsigned long long n){
+            Random random(edits);
+            unsigned long pos, removed, inserted;
+            for(unsigned long long r = 0; r<n; r++){
+                for(unsigned long i = 0; i<edits; i++)
+                    table.insert(random.next()%table.length(), "x", 1);
+                for(unsigned long i = 0; i<edits; i++)
+                    table.undo(pos, removed, inserted);
+            }
+            sink = table.length();
+        });
+        free(text);
+    }
+
+    // Indenting every line of a file at once, and undoing it.
+    {
+        const unsigned long size = (max_size<(1ull<<24)) ? max_size : (1ull<<24);
+        char * const text = GenerateText(size);
+        text[size-1] = 0;
+        Flare::Document document;
+        document.reset(text);
+        free(text);
+
+        std::vector<unsigned long> lines;
+        const Flare::TextSpans spans = document.spans();
+        lines.push_back(0);
+        for(unsigned long i = 0; i+1<spans.length(); i++)
+            if(spans.at(i)=='\n')
+                lines.push_back(i+1);
+
+        Measure("edit/indent", lines.size(), size, [&document, &lines](unsigned long long n){
+            for(unsigned long long r = 0; r<n; r++){
+                Flare::Document::Transaction edits(document);
+                edits.reserve(lines.size());
+                for(std::vector<unsigned long>::const_iterator i = lines.begin(); i!=lines.end(); i++)
+                    edits.insert(*i, "    ", 4);
+                edits.commit();
+                document.undo();
+            }
+            sink = document.length();
+        });
+
+        // Going to a line, from the index and by counting newlines as FLTK does.
+        const unsigned long line_count = document.lineCount();
+        Measure("lines/goto/index", line_count, 0, [&document, line_count](unsigned long long n){
+            Random random(line_count);
+            for(unsigned long long r = 0; r<n; r++)
+                sink = document.lineStart(random.next()%line_count);
+        });
+        Measure("lines/goto/scan", line_count, 0, [&document, line_count](unsigned long long n){
+            Random random(line_count);
+            for(unsigned long long r = 0; r<n; r++)
+                sink = document.buffer().skip_lines(0, random.next()%line_count);
+        });
+
+        const Flare::Searcher searcher(std::string("e"));
+        Measure("edit/replace_all", size, size, [&document, &searcher](unsigned long long n){
+            for(unsigned long long r = 0; r<n; r++){
+                sink = document.replaceAll(searcher, "E");
+                document.undo();
+            }
+        });
+    }
+}
+
+//
+// Highlighting.
+//
+
+// Keeps the styles of a document highlighted as it is edited, as TextEditor does.
+struct Highlighted {
+    Flare::Document &document;
+    Flare::Text_Buffer style;
+    Flare::Highlighter highlighter;
+
+    explicit Highlighted(Flare::Document &d)
+      : document(d){
+        document.changeCallback(Changed, this);
+    }
+    ~Highlighted(){
+        document.changeCallback(nullptr, nullptr);
+    }
+
+    static void Changed(unsigned long pos, unsigned long inserted, unsigned long deleted, void *a){
+        Highlighted * const that = static_cast<Highlighted *>(a);
+        if(deleted>0)
+            that->style.remove(pos, pos+deleted);
+        if(inserted>0){
+            const std::string filler(inserted, Flare::STYLE_PLAIN);
+            that->style.insert(pos, filler.c_str());
+        }
+        unsigned long from, to;
+        that->highlighter.update(that->document.spans(), that->document.lineIndex(), that->style, pos, inserted, from, to);
+    }
+};
+
+void BenchHighlighting(){
+    static const char *const lines[] = {
+        "#include <cstdio>\n",
+        "/* A block comment\n",
+        "   that carries on. */\n",
+        "static const char *name = \"a string\";\n",
+        "for(unsigned long i = 0; i<0x100; i++) // counting\n",
+        "    if(value>=1.5f && !done) return false;\n",
+        "class Thing : public Base { virtual void run() override; };\n",
+        "\n"
+    };
+    const unsigned line_count = 100000;
+
+    std::string source;
+    Random random(line_count);
+    for(unsigned i = 0; i<line_count; i++)
+        source+=lines[random.next()%(sizeof(lines)/sizeof(lines[0]))];
+
+    Flare::Document document;
+    document.reset(source.c_str());
+    Highlighted highlighted(document);
+    highlighted.highlighter.syntax(&Flare::c_syntax);
+    highlighted.style.fill(Flare::STYLE_PLAIN, document.length());
+
+    Measure("highlight/full", line_count, source.size(), [&highlighted, &document](unsigned long long n){
+        for(unsigned long long r = 0; r<n; r++)
+            highlighted.highlighter.highlight(document.spans(), document.lineIndex(), highlighted.style);
+        sink = highlighted.style.byte_at(0);
+    });
+
+    // What opening the file costs the UI thread when the rest is lexed in the background:
+    // the first lines, and copying the text for the job.
+    highlighted.highlighter.lineBudget(0x1000);
+    Measure("highlight/budget", line_count, 0, [&highlighted, &document](unsigned long long n){
+        for(unsigned long long r = 0; r<n; r++)
+            highlighted.highlighter.highlight(document.spans(), document.lineIndex(), highlighted.style);
+        sink = highlighted.highlighter.linesLexed();
+    });
+    Measure("highlight/snapshot", line_count, source.size(), [&highlighted, &document](unsigned long long n){
+        for(unsigned long long r = 0; r<n; r++)
+            sink = highlighted.highlighter.job(document.spans(), document.lineIndex(), document.version(), 0, 0)!=nullptr;
+    });
+    highlighted.highlighter.lineBudget(0);
+    highlighted.highlighter.highlight(document.spans(), document.lineIndex(), highlighted.style);
+
+    // Typing a letter in the middle of the text, and taking it back.
+    document.pauseHistory();
+    Measure("highlight/type", line_count, 0, [&highlighted, &document](unsigned long long n){
+        const unsigned long at = document.lineStart(document.lineCount()/2);
+        for(unsigned long long r = 0; r<n; r++){
+            document.buffer().insert(at, "x");
+            document.buffer().remove(at, at+1);
+        }
+        sink = highlighted.highlighter.linesLexed();
+    });
+    document.resumeHistory();
+
+    // Hibernating a tab of source, which is compressed on a worker, and waking it again,
+    // which is done on the UI thread as the tab is shown. Highlighting is off meanwhile.
+    document.changeCallback(nullptr, nullptr);
+    std::vector<unsigned char> compressed;
+    Measure("hibernate/compress", line_count, source.size(), [&document, &compressed](unsigned long long n){
+        for(unsigned long long r = 0; r<n; r++)
+            Flare::compressText(document.spans(), compressed);
+        sink = compressed.size();
+    });
+    Measure("hibernate/wake", line_count, source.size(), [&document, &compressed](unsigned long long n){
+        for(unsigned long long r = 0; r<n; r++){
+            std::vector<unsigned char> copy(compressed);
+            document.hibernate(copy, document.version());
+            document.wake();
+        }
+        sink = document.length();
+    });
+}
+
+//
+// Small utilities.
+//
+
+void BenchUtilities(){
+    std::vector<unsigned long long> sizes(0x1000);
+    Random random(1);
+    for(std::vector<unsigned long long>::iterator i = sizes.begin(); i!=sizes.end(); i++)
+        *i = ((unsigned long long)random.next()<<(random.next()%20))%2000000000000ull;
+
+    Measure("sizeNumberString", sizes.size(), 0, [&sizes](unsigned long long n){
+        char buffer[8];
+        unsigned long long total = 0;
+        for(unsigned long long r = 0; r<n; r++)
+            for(std::vector<unsigned long long>::const_iterator i = sizes.begin(); i!=sizes.end(); i++)
+                total+=sizeNumberString(buffer, *i)[0];
+        sink = total;
+    });
+
+    static const char *const names[] = {"txt", "cpp", "hpp", "c", "h", "py", "js", "md"};
+    const unsigned name_count = sizeof(names)/sizeof(names[0]);
+    for(unsigned registered = 8; registered<=64; registered*=8){
+        Flare::ExtensionMap<unsigned> map;
+        std::vector<std::string> lookups;
+        for(unsigned i = 0; i<registered; i++){
+            char extension[16];
+            snprintf(extension, sizeof(extension), "%s%u", names[i%name_count], i/name_count);
+            map.set(extension, i);
+            lookups.push_back(std::string(".")+extension);
+        }
+        lookups.push_back(".unknown");
+
+        char name[64];
+        snprintf(name, sizeof(name), "extension/lookup/%u", registered);
+        Measure(name, registered, 0, [&map, &lookups](unsigned long long n){
+            unsigned total = 0;
+            for(unsigned long long r = 0; r<n; r++)
+                for(std::vector<std::string>::const_iterator i = lookups.begin(); i!=lookups.end(); i++){
+                    unsigned value = 0;
+                    map.get(*i, value);
+                    total+=value;
+                }
+            sink = total;
+        });
+    }
+}
+
+//
+// Loading, saving and searching generated files.
+//
+
+void BenchFiles(const std::string &directory){
+    for(unsigned long long size = 1024; size<=max_size; size*=32){
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), "/%llu", size);
+        const std::string path = directory+"/bench.txt";
+
+        char * const text = GenerateText(size);
+        const Flare::TextSpans spans = {text, (unsigned long)size, text+size, 0};
+
+        uLong adler;
+        if(!Flare::saveFileContents(path.c_str(), spans, adler)){
+            fprintf(stderr, "Could not write %s\n", path.c_str());
+            free(text);
+            return;
+        }
+
+        Flare::Document document;
+        Measure(std::string("file/load")+suffix, size, size, [&path, &document](unsigned long long n){
+            for(unsigned long long r = 0; r<n; r++)
+                document.load(path.c_str());
+            sink = document.checksum();
+        });
+
+        Measure(std::string("file/save")+suffix, size, size, [&path, &document](unsigned long long n){
+            for(unsigned long long r = 0; r<n; r++)
+                document.save(path.c_str());
+            sink = document.checksum();
+        });
+
+        // The piece table only maps the file, and saves it a piece at a time.
+        Flare::PieceTable table;
+        Measure(std::string("file/load/piece_table")+suffix, size, size, [&path, &table](unsigned long long n){
+            for(unsigned long long r = 0; r<n; r++)
+                table.load(path.c_str());
+            sink = table.length();
+        });
+
+        table.insert(size/2, "x", 1);
+        table.remove(size/2, 1);
+        Measure(std::string("file/save/piece_table")+suffix, size, size, [&path, &table](unsigned long long n){
+            for(unsigned long long r = 0; r<n; r++)
+                table.save(path.c_str());
+            sink = table.checksum();
+        });
+
+        // Neither is in the text, so the whole of it is searched.
+        const Flare::Searcher searcher(std::string("flare needle"));
+        Measure(std::string("find/text")+suffix, size, size, [&searcher, &spans](unsigned long long n){
+            for(unsigned long long r = 0; r<n; r++)
+                sink = searcher.find(spans, 0, spans.length());
+        });
+
+        Flare::Regex regex;
+        std::string error;
+        regex.compile("[0-9]{4}[A-Z]", error);
+        Measure(std::string("find/regex")+suffix, size, size, [&regex, &spans](unsigned long long n){
+            for(unsigned long long r = 0; r<n; r++){
+                unsigned long start, end;
+                sink = regex.find(spans, 0, spans.length(), start, end);
+            }
+        });
+
+        free(text);
+        unlink(path.c_str());
+    }
+}
+
+}
+
+int main(int argc, char *argv[]){
+    const char *output = nullptr;
+    for(int i = 1; i<argc; i++){
+        if(i+1<argc && strcmp(argv[i], "--output")==0)
+            output = argv[++i];
+        else if(i+1<argc && strcmp(argv[i], "--filter")==0)
+            filter = argv[++i];
+        else if(i+1<argc && strcmp(argv[i], "--max-size")==0)
+            max_size = strtoull(argv[++i], nullptr, 10);
+        else if(i+1<argc && strcmp(argv[i], "--min-time")==0)
+            min_time = atof(argv[++i]);
+        else{
+            fprintf(stderr, "Usage: %s [--output results.json] [--filter name] [--max-size bytes] [--min-time seconds]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    const char *tmp = getenv("TMPDIR");
+    std::string directory = (tmp && tmp[0]) ? tmp : "/tmp";
+    directory+="/flare-bench-XXXXXX";
+    if(!mkdtemp(&(directory[0]))){
+        fprintf(stderr, "Could not create a directory in %s\n", directory.c_str());
+        return EXIT_FAILURE;
+    }
+
+    BenchHistory();
+    BenchEditing();
+    BenchHighlighting();
+    BenchUtilities();
+    BenchFiles(directory);
+
+    rmdir(directory.c_str());
+
+    FILE * const to = output ? fopen(output, "w") : stdout;
+    if(!to){
+        fprintf(stderr, "Could not open %s\n", output);
+        return EXIT_FAILURE;
+    }
+    WriteResults(to);
+    if(output)
+        fclose(to);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,348 @@
+// Randomized checks of Flare's core data structures against simple models of them. This
+// only uses the core without any widgets, so it runs without a display. It prints what
+// failed and exits with a failure status if any check does.
+//
+//  flare_check [seed]
+
+#include "undo_tree.hpp"
+#include "document.hpp"
+#include "regex.hpp"
+
+#include <sys/resource.h>
+#include <csignal>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+unsigned long failures = 0;
+
+#define CHECK(cond) do{ \
+    if(!(cond)){ \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+        return; \
+    } \
+}while(0)
+
+//
+// UndoTree. Each step takes the model's text from one numbered state to another, so any
+// step that is applied from the wrong state is caught. The steps that are made and freed
+// are counted, to catch one being freed twice or never.
+//
+
+struct Step {
+    int from, to;
+};
+
+long live_steps = 0;
+
+void DeleteStep(Step){
+    live_steps--;
+}
+
+size_t SizeStep(size_t a, Step){
+    return a+100;
+}
+
+Step NewStep(int from, int to){
+    const Step step = {from, to};
+    live_steps++;
+    return step;
+}
+
+typedef Flare::UndoTree<Step, DeleteStep, SizeStep> Tree;
+
+// Stands in for the journal that evicted steps are spilled to.
+void SpillStep(Step s, void *a){
+    static_cast<std::vector<Step> *>(a)->push_back(NewStep(s.from, s.to));
+}
+
+// Follows moves from earlier() or later(), checking each one starts where the last ended.
+bool FollowMoves(const std::vector<Tree::Move> &moves, int &state){
+    for(std::vector<Tree::Move>::const_iterator i = moves.begin(); i!=moves.end(); i++){
+        if(i->undo){
+            if(i->step.to!=state) return false;
+            state = i->step.from;
+        }
+        else{
+            if(i->step.from!=state) return false;
+            state = i->step.to;
+        }
+    }
+    return true;
+}
+
+// Pushes, merged steps, undo, redo, earlier and later, with spills to the journal, under
+// budgets tight enough that eviction happens all the time.
+void CheckUndoTreeRandom(){
+    for(unsigned round = 0; round<50; round++){
+        std::vector<Step> journal;
+        {
+            Tree tree((rand()%3) ? 2000+rand()%6000 : 1000000);
+            tree.evictTo(SpillStep, &journal);
+
+            int next = 1, state = 0;
+            for(unsigned i = 0; i<20000; i++){
+                const int r = rand()%10;
+                if(r<4){
+                    if(tree.atTip() && rand()%3==0){
+                        // Grows the current step, as typing does.
+                        Step &top = tree.step();
+                        CHECK(top.to==state);
+                        top.to = state = next++;
+                        tree.currentChanged();
+                    }
+                    else{
+                        tree.push(NewStep(state, next));
+                        state = next++;
+                    }
+                }
+                else if(r<6){
+                    if(!tree.atRoot()){
+                        const Step s = tree.undo();
+                        CHECK(s.to==state);
+                        state = s.from;
+                    }
+                    else if(!journal.empty()){
+                        const Step s = journal.back();
+                        journal.pop_back();
+                        CHECK(s.to==state);
+                        state = s.from;
+                        tree.pushRoot(s);
+                    }
+                }
+                else if(r<8){
+                    Step s;
+                    if(tree.redo(s)){
+                        CHECK(s.from==state);
+                        state = s.to;
+                    }
+                }
+                else{
+                    std::vector<Tree::Move> moves;
+                    if((r==8) ? tree.earlier(moves) : tree.later(moves))
+                        CHECK(FollowMoves(moves, state));
+                }
+                CHECK(tree.bytes()<=tree.budget() || tree.size()<=1);
+            }
+
+            CHECK(live_steps==(long)(tree.size()+journal.size()));
+        }
+
+        CHECK(live_steps==(long)journal.size());
+        for(std::vector<Step>::const_iterator i = journal.begin(); i!=journal.end(); i++)
+            DeleteStep(*i);
+    }
+}
+
+// earlier() across a long history with a branch every thousand steps.
+void CheckUndoTreeLong(){
+    Tree tree(1ul<<40);
+    int next = 1, state = 0;
+    for(unsigned i = 0; i<300000; i++){
+        tree.push(NewStep(state, next));
+        state = next++;
+        if(i%1000==999){
+            for(unsigned u = 0; u<500; u++)
+                state = tree.undo().from;
+        }
+    }
+
+    std::vector<Tree::Move> moves;
+    unsigned long total = 0;
+    while(tree.earlier(moves)){
+        CHECK(FollowMoves(moves, state));
+        total+=moves.size();
+        moves.clear();
+    }
+    CHECK(state==0);
+    CHECK(total>0);
+}
+
+//
+// Document history, with the journal that it spills to failing part way. Every state that
+// undo reaches has to be one the text was really in, even though some steps are lost.
+//
+
+bool SameText(Flare::Document &document, const std::string &model){
+    char * const text = document.buffer().text();
+    const bool same = model==text;
+    free(text);
+    return same;
+}
+
+// Runs of typing, Backspace and Delete, which grow one step each, then undoing all of them
+// and redoing them again. Each undo has to go back to a state from before the last.
+void CheckDocumentRuns(){
+    for(unsigned round = 0; round<20; round++){
+        const bool spills = round%2;
+        Flare::Document document;
+        document.historyBudget(spills ? 2000 : 1ul<<30);
+
+        std::vector<std::string> states(1);
+        std::string model;
+        unsigned long cursor = 0;
+        for(unsigned run = 0; run<300; run++){
+            const int kind = rand()%4;
+            if(kind==0)
+                cursor = rand()%(model.size()+1);
+            const unsigned keys = 1+rand()%50;
+            for(unsigned k = 0; k<keys; k++){
+                // Two bytes at a time now and then, as for a UTF-8 character.
+                const unsigned long n = (rand()%8==0) ? 2 : 1;
+                if(kind<=1){
+                    const std::string typed(n, 'a'+rand()%26);
+                    document.buffer().insert(cursor, typed.c_str());
+                    model.insert(cursor, typed);
+                    cursor+=n;
+                }
+                else if(kind==2 && cursor>=n){
+                    document.buffer().remove(cursor-n, cursor);
+                    model.erase(cursor-n, n);
+                    cursor-=n;
+                }
+                else if(kind==3 && cursor+n<=model.size()){
+                    document.buffer().remove(cursor, cursor+n);
+                    model.erase(cursor, n);
+                }
+            }
+            states.push_back(model);
+        }
+        CHECK(SameText(document, model));
+
+        unsigned long at = states.size()-1;
+        while(document.canUndo()){
+            document.undo();
+            while(at>0 && !SameText(document, states[at-1]))
+                at--;
+            CHECK(at>0);
+            at--;
+        }
+        CHECK(SameText(document, states[0]));
+
+        while(document.canRedo()){
+            document.redo();
+            while(at+1<states.size() && !SameText(document, states[at+1]))
+                at++;
+            CHECK(at+1<states.size());
+            at++;
+        }
+        // Steps that would be redone can be forgotten to keep in the budget, but otherwise
+        // all of them are.
+        if(!spills)
+            CHECK(SameText(document, model));
+    }
+}
+
+// Runs with writes to the journal failing once it reaches 16KB.
+void CheckJournalFailureLimited(){
+    struct Insert {
+        unsigned long pos;
+        std::string text;
+    };
+    std::vector<Insert> inserts;
+    std::string model;
+
+    Flare::Document document;
+    document.historyBudget(4096);
+
+    unsigned long end = 0;
+    for(unsigned i = 0; i<3000; i++){
+        Insert insert;
+        insert.pos = rand()%(model.size()+1);
+        // Right after the last one would grow its step, instead of making a new one.
+        if(insert.pos==end && end>0)
+            insert.pos = 0;
+        for(unsigned n = 0; n<40; n++)
+            insert.text.push_back('a'+rand()%26);
+
+        document.buffer().insert(insert.pos, insert.text.c_str());
+        model.insert(insert.pos, insert.text);
+        end = insert.pos+insert.text.size();
+        inserts.push_back(insert);
+    }
+    CHECK(SameText(document, model));
+    // The journal was cut off when it filled, and nothing has been spilled since.
+    CHECK(document.journalBytes()==0);
+
+    while(document.canUndo()){
+        CHECK(!inserts.empty());
+        document.undo();
+        model.erase(inserts.back().pos, inserts.back().text.size());
+        inserts.pop_back();
+        CHECK(SameText(document, model));
+    }
+    CHECK(!inserts.empty());
+}
+
+void CheckJournalFailure(){
+    // Writes past the limit fail with EFBIG, rather than raising a signal.
+    struct rlimit old_limit, limit;
+    getrlimit(RLIMIT_FSIZE, &old_limit);
+    limit = old_limit;
+    limit.rlim_cur = 16*1024;
+    signal(SIGXFSZ, SIG_IGN);
+    setrlimit(RLIMIT_FSIZE, &limit);
+
+    CheckJournalFailureLimited();
+
+    setrlimit(RLIMIT_FSIZE, &old_limit);
+    signal(SIGXFSZ, SIG_DFL);
+}
+
+//
+// Regex, on a single long line that no pattern ends up matching, which has to take time
+// linear in its length. Trying each start again in turn would take minutes.
+//
+
+void CheckRegexLongLine(){
+    const std::string line(200000, 'a');
+    const Flare::TextSpans spans = {line.data(), line.size(), nullptr, 0};
+
+    const char * const missing[] = {".*x", "a+x", "\\w+x", "(a|aa)*b", "^a*$x"};
+    for(unsigned i = 0; i<sizeof(missing)/sizeof(*missing); i++){
+        Flare::Regex regex;
+        std::string error;
+        CHECK(regex.compile(missing[i], error));
+
+        unsigned long start, end;
+        CHECK(!regex.find(spans, 0, spans.length(), start, end));
+        CHECK(!regex.findLast(spans, 0, spans.length(), start, end));
+        CHECK(regex.matchAt(spans, 0)<0);
+    }
+
+    Flare::Regex regex;
+    std::string error;
+    CHECK(regex.compile("a+$", error));
+    unsigned long start, end;
+    CHECK(regex.find(spans, 1000, spans.length(), start, end));
+    CHECK(start==1000 && end==line.size());
+    CHECK(regex.findLast(spans, 0, spans.length(), start, end));
+    CHECK(start==line.size()-1 && end==line.size());
+}
+
+}
+
+int main(int argc, char *argv[]){
+    srand((argc>1) ? atoi(argv[1]) : 1);
+
+    CheckUndoTreeRandom();
+    CheckUndoTreeLong();
+    CheckDocumentRuns();
+    CheckJournalFailure();
+    CheckRegexLongLine();
+    if(live_steps!=0){
+        fprintf(stderr, "%ld undo steps were never freed\n", live_steps);
+        failures++;
+    }
+
+    if(failures>0){
+        fprintf(stderr, "%lu checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    puts("All checks passed.");
+    return EXIT_SUCCESS;
+}
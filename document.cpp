@@ -0,0 +1,428 @@
+#include "document.hpp"
+#include "search.hpp"
+#include "regex.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+namespace Flare {
+
+Document::Document()
+  : text(gap, gap)
+  , canary(0u)
+  , separate_step(false)
+  , journal_failed(false)
+  , adler(adler32(0L, nullptr, 0))
+  , changed(nullptr)
+  , changed_arg(nullptr)
+  , version_(0)
+  , hibernated_length(0)
+  , hibernating_(false){
+
+    // The history here replaces FLTK's, which would only be extra copying.
+    text.canUndo(0);
+    text.add_modify_callback(ModifyCallback, this);
+    history.evictTo(spill_diff, this);
+}
+
+Document::~Document(){
+    text.remove_modify_callback(ModifyCallback, this);
+}
+
+void Document::copy_text(char *into, int from, int to) const {
+    if(from>=to)
+        return;
+    // The text just added is normally right before the gap, so in one piece.
+    const char * const first = text.address(from);
+    if(text.address(to-1)==first+(to-1-from))
+        memcpy(into, first, to-from);
+    else for(int i = from; i<to; i++)
+        *into++ = text.byte_at(i);
+}
+
+struct Document::diff Document::create_diff(int pos, int add, int del, const char *deleted_text){
+    struct diff that = {nullptr, nullptr, pos, add, del, false};
+    if(add>0 && del>0){
+        that.text = arena.allocate(del+add+2, that.chunk);
+        memcpy(that.text, deleted_text, del);
+        that.text[del] = 0;
+        copy_text(that.text+del+1, pos, pos+add);
+        that.text[del+add+1] = 0;
+    }
+    else if(add>0){
+        that.text = arena.allocate(add+1, that.chunk);
+        copy_text(that.text, pos, pos+add);
+        that.text[add] = 0;
+    }
+    else{
+        that.text = arena.allocate(del+1, that.chunk);
+        memcpy(that.text, deleted_text, del+1);
+    }
+    return that;
+}
+
+void Document::ModifyCallback(int pos, int inserted, int deleted, int restyled, const char *deleted_text, void *a){
+    Document * const that = static_cast<Document *>(a);
+    if(inserted==0 && deleted==0)
+        return;
+
+    that->lines.update(that->text.spans(), pos, inserted, deleted);
+    that->version_++;
+    if(that->changed)
+        that->changed(pos, inserted, deleted, that->changed_arg);
+    if(that->canary==0u)
+        that->record(pos, inserted, deleted, deleted_text);
+}
+
+void Document::record(int pos, int add, int del, const char *deleted_text){
+    // Anything typed after an undo starts a new branch, rather than replacing what could
+    // have been redone.
+    if(separate_step || !history.atTip()){
+        seal_step();
+        history.push(create_diff(pos, add, del, deleted_text));
+        return;
+    }
+
+    struct diff & top = history.step();
+    // Replacements, from Replace or Replace All, are always their own step.
+    if(add>0 && del==0 && top.add>0 && top.del==0 && top.pos+top.add==pos){
+        // Typing grows the text of the last step in place, without any allocation.
+        top.text = arena.extend(top.text, top.add+1, add, top.chunk);
+        copy_text(top.text+top.add, pos, pos+add);
+        top.add+=add;
+        top.text[top.add] = 0;
+        history.currentChanged();
+    }
+    else if(del>0 && add==0 && top.del>0 && top.add==0 && (top.pos==pos || top.pos==pos+del)){
+        top.text = arena.extend(top.text, top.del+1, del, top.chunk);
+        if(top.pos==pos){
+            // Delete, so the text came after what was already deleted.
+            if(top.reversed)
+                reverse_diff(top);
+            memcpy(top.text+top.del, deleted_text, del+1);
+        }
+        else{
+            // Backspace, so it came before. It goes on the end of the reversed text.
+            if(!top.reversed)
+                reverse_diff(top);
+            for(int i = 0; i<del; i++)
+                top.text[top.del+i] = deleted_text[del-1-i];
+            top.text[top.del+del] = 0;
+            top.pos = pos;
+        }
+        top.del+=del;
+        history.currentChanged();
+    }
+    else{
+        seal_step();
+        history.push(create_diff(pos, add, del, deleted_text));
+    }
+}
+
+void Document::spill_diff(struct diff d, void *a){
+    Document * const that = static_cast<Document *>(a);
+    if(that->journal_failed)
+        return;
+    // The current step can be spilled, if it is the only one left. It's freed after this.
+    if(d.reversed)
+        reverse_diff(d);
+
+    const UndoJournal::Record record = {d.pos, d.add, d.del};
+    if(!that->journal.push(record, d.text, diff_text_length(d))){
+        // The steps already in the journal can't be undone without this one, so they go too.
+        that->journal.clear();
+        that->journal_failed = true;
+    }
+}
+
+void Document::apply_undo(const struct diff &op){
+    if(op.add>0 && op.del>0){
+        text.replace(op.pos, op.pos+op.add, op.text);
+    }
+    else if(op.del>0){
+        text.insert(op.pos, op.text);
+    }
+    else{
+        text.remove(op.pos, op.pos+op.add);
+    }
+}
+
+void Document::apply_redo(const struct diff &op){
+    if(op.add>0 && op.del>0){
+        text.replace(op.pos, op.pos+op.del, op.text+op.del+1);
+    }
+    else if(op.add>0){
+        text.insert(op.pos, op.text);
+    }
+    else{
+        text.remove(op.pos, op.pos+op.del);
+    }
+}
+
+void Document::undo(){
+    if(canary>0u) return;
+    if(history.atRoot() && journal.empty()) return;
+    canary++;
+    seal_step();
+
+    if(!history.atRoot())
+        apply_undo(history.undo());
+    else{
+        // Everything in memory has been undone, so carry on with what was spilled to
+        // disk. The step goes back into the history, so it can be redone.
+        struct diff op;
+        UndoJournal::Record record;
+        if(journal.pop(record, arena, op.text, op.chunk)){
+            op.pos = record.pos;
+            op.add = record.add;
+            op.del = record.del;
+            op.reversed = false;
+            apply_undo(op);
+            history.pushRoot(op);
+        }
+    }
+
+    canary--;
+}
+
+void Document::redo(){
+    if(canary>0u) return;
+    canary++;
+
+    struct diff op;
+    if(history.redo(op))
+        apply_redo(op);
+
+    canary--;
+}
+
+void Document::earlier(){
+    if(canary>0u) return;
+    seal_step();
+
+    std::vector<History::Move> moves;
+    if(!history.earlier(moves)){
+        // The oldest state in memory, so the one before it is on disk.
+        undo();
+        return;
+    }
+
+    canary++;
+    for(std::vector<History::Move>::const_iterator i = moves.begin(); i!=moves.end(); i++){
+        if(i->undo)
+            apply_undo(i->step);
+        else
+            apply_redo(i->step);
+    }
+    canary--;
+}
+
+void Document::later(){
+    if(canary>0u) return;
+    seal_step();
+
+    std::vector<History::Move> moves;
+    if(!history.later(moves))
+        return;
+
+    canary++;
+    for(std::vector<History::Move>::const_iterator i = moves.begin(); i!=moves.end(); i++){
+        if(i->undo)
+            apply_undo(i->step);
+        else
+            apply_redo(i->step);
+    }
+    canary--;
+}
+
+void Document::Transaction::commit(){
+    if(edits.empty())
+        return;
+
+    if(document)
+        document->separate_step = true;
+    buffer.applyEdits(edits);
+    if(document)
+        document->separate_step = false;
+
+    edits.clear();
+    change_ = 0;
+}
+
+bool Document::load(const char *path){
+    unsigned long length;
+    uLong new_adler;
+    FileStamp new_stamp;
+    char * const block = loadFileContents(path, length, new_adler, gap, &new_stamp);
+    if(!block)
+        return false;
+
+    adopt(block, length, new_adler, new_stamp);
+    return true;
+}
+
+void Document::adopt(char *block, unsigned long length, uLong adler_, const FileStamp &stamp_){
+    discardHibernated();
+    adler = adler_;
+    stamp = stamp_;
+
+    // Hand the whole file to the buffer at once. Loading is not an undoable change.
+    canary++;
+    text.adopt(block, length, gap);
+    canary--;
+
+    clearHistory();
+}
+
+void Document::reset(const char *placeholder){
+    discardHibernated();
+    canary++;
+    text.text(placeholder);
+    canary--;
+
+    clearHistory();
+}
+
+bool Document::changedOnDisk(const char *path) const {
+    FileStamp current;
+    if(!stampFile(path, current) || current==stamp)
+        return false;
+
+    uLong adler_file;
+    return !fileAdler32(path, adler_file) || adler_file!=adler;
+}
+
+bool Document::save(const char *path){
+    if(!wake())
+        return false;
+    return saveFileContents(path, text.spans(), adler, &stamp);
+}
+
+void Document::calculateChecksum(){
+    if(!wake())
+        return;
+    adler = spansAdler32(text.spans());
+}
+
+bool Document::hibernate(std::vector<unsigned char> &compressed, unsigned long at_version){
+    if(hibernating_ || at_version!=version_)
+        return false;
+
+    char * const empty = (char *)malloc(gap);
+    if(!empty){
+        errno = ENOMEM;
+        return false;
+    }
+
+    hibernated.swap(compressed);
+    hibernated_length = text.length();
+    hibernating_ = true;
+
+    // Freeing the text isn't a change to it, any more than loading is.
+    canary++;
+    text.adopt(empty, 0, gap);
+    canary--;
+    return true;
+}
+
+bool Document::wake(){
+    if(!hibernating_)
+        return true;
+
+    char * const block = decompressText(hibernated, hibernated_length, gap);
+    if(!block)
+        return false;
+
+    hibernating_ = false;
+    canary++;
+    text.adopt(block, hibernated_length, gap);
+    canary--;
+
+    discardHibernated();
+    return true;
+}
+
+bool Document::copyHibernated(std::string &into) const {
+    char * const block = decompressText(hibernated, hibernated_length);
+    if(!block)
+        return false;
+
+    into.assign(block, hibernated_length);
+    free(block);
+    return true;
+}
+
+void Document::discardHibernated(){
+    hibernating_ = false;
+    std::vector<unsigned char>().swap(hibernated);
+    hibernated_length = 0;
+}
+
+unsigned long Document::replaceAll(const Searcher &searcher, const char *replacement, const std::vector<unsigned long> *positions){
+    const unsigned long n = searcher.length(), replacement_length = strlen(replacement);
+    if(n==0)
+        return 0;
+
+    Transaction edits(*this);
+    if(positions){
+        edits.reserve(positions->size());
+        unsigned long end = 0;
+        for(std::vector<unsigned long>::const_iterator i = positions->begin(); i!=positions->end(); i++){
+            if(*i<end)
+                continue;
+            edits.replace(*i, n, replacement, replacement_length);
+            end = *i+n;
+        }
+    }
+    else{
+        const TextSpans spans = text.spans();
+        long found;
+        unsigned long from = 0;
+        while((found = searcher.find(spans, from, spans.length()))>=0){
+            edits.replace(found, n, replacement, replacement_length);
+            from = found+n;
+        }
+    }
+
+    // All at once, so that it is a single change to the buffer and a single step to undo.
+    const unsigned long count = edits.size();
+    edits.commit();
+    return count;
+}
+
+unsigned long Document::replaceAll(const Regex &regex, const char *replacement){
+    const TextSpans spans = text.spans();
+    const bool use_groups = Regex::usesGroups(replacement);
+
+    // All the replacement text goes into one string. The edits can only point into it once
+    // it has stopped growing.
+    std::vector<unsigned long> bounds, offsets;
+    std::string replacements;
+    std::vector<long> groups;
+
+    unsigned long from = 0, start, end;
+    while(regex.find(spans, from, spans.length(), start, end)){
+        if(use_groups)
+            regex.captures(spans, start, end, groups);
+        offsets.push_back(replacements.size());
+        Regex::expand(replacement, spans, groups, replacements);
+        bounds.push_back(start);
+        bounds.push_back(end);
+        from = end;
+    }
+    offsets.push_back(replacements.size());
+
+    const unsigned long count = bounds.size()/2;
+    Transaction edits(*this);
+    edits.reserve(count);
+    for(unsigned long i = 0; i<count; i++){
+        edits.replace(bounds[i*2], bounds[i*2+1]-bounds[i*2],
+            replacements.data()+offsets[i], offsets[i+1]-offsets[i]);
+    }
+
+    edits.commit();
+    return count;
+}
+
+}
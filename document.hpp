@@ -0,0 +1,274 @@
+#pragma once
+
+#include "flare_text_buffer.hpp"
+#include "file_utilities.hpp"
+#include "line_index.hpp"
+#include "undo_tree.hpp"
+#include "undo_arena.hpp"
+#include "undo_journal.hpp"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <vector>
+#include <string>
+
+namespace Flare {
+
+class Searcher;
+class Regex;
+
+// The text of a file, its undo history, and the state of the file on disk, without any
+// widgets. Text_Editor_Widget is a view of a Document, and anything that has to run
+// without a display, such as the benchmarks, can use one directly.
+//
+// Every change made to the buffer is recorded, by whatever means it is made, unless
+// recording is paused.
+class Document {
+
+    Text_Buffer text;
+    // Kept up to date with every change, whether it is recorded or not.
+    LineIndex lines;
+
+    // When both add and del are set, the diff is a replacement and text holds the deleted
+    // text and then the added text, each followed by a nul. The text lives in `arena'.
+    struct diff {
+        char *text;
+        UndoArena::Chunk *chunk;
+        int pos, add, del;
+        // A run of backspaces keeps its text backwards while it grows, so that each key only
+        // appends to it. Only the current step can be, and it is put right by seal_step.
+        bool reversed;
+    };
+
+    struct diff create_diff(int pos, int add, int del, const char *deleted_text);
+    // Copies text from the buffer without allocating, as text_range would.
+    void copy_text(char *into, int from, int to) const;
+
+    static void delete_diff(struct diff d){
+        UndoArena::Release(d.chunk);
+    }
+
+    static size_t size_diff(size_t a, struct diff d){
+        return a+d.add+d.del+sizeof(struct diff);
+    }
+
+    static unsigned long diff_text_length(const struct diff &d){
+        return (d.add>0 && d.del>0) ? (d.add+d.del+2) : (d.add+d.del+1);
+    }
+
+    // Undo steps too old to keep in memory go here, rather than being forgotten.
+    static void spill_diff(struct diff d, void *a);
+
+    static void reverse_diff(struct diff &d){
+        std::reverse(d.text, d.text+d.del);
+        d.reversed = !d.reversed;
+    }
+    // Puts the text of the current step the right way round, before it is undone or has
+    // another step pushed after it.
+    void seal_step(){
+        if(!history.atRoot() && history.step().reversed)
+            reverse_diff(history.step());
+    }
+
+    // Undoes or redoes a step in the buffer.
+    void apply_undo(const struct diff &op);
+    void apply_redo(const struct diff &op);
+
+    unsigned canary;
+    // Set while a transaction is being applied, so that it never joins the previous step.
+    bool separate_step;
+
+    // Declared before the history, which still refers to it while being destroyed.
+    UndoArena arena;
+    typedef UndoTree<struct diff, delete_diff, size_diff> History;
+    History history;
+    // Everything in the journal is older than the root of `history'.
+    UndoJournal journal;
+    // Set once a step couldn't be written to the journal. Nothing more is spilled after
+    // that, so the history is cut off there instead of having a gap in it.
+    bool journal_failed;
+
+    uLong adler;
+    // What the file looked like when we last loaded or saved it.
+    FileStamp stamp;
+
+    static void ModifyCallback(int pos, int inserted, int deleted, int restyled, const char *deleted_text, void *a);
+    void record(int pos, int add, int del, const char *deleted_text);
+
+public:
+
+    // Called after every change to the text, once the lines are up to date.
+    typedef void (*ChangedCallback)(unsigned long pos, unsigned long inserted, unsigned long deleted, void *arg);
+
+private:
+
+    ChangedCallback changed;
+    void *changed_arg;
+    unsigned long version_;
+
+    // The text while hibernating, from compressText, and how long it was.
+    std::vector<unsigned char> hibernated;
+    unsigned long hibernated_length;
+    bool hibernating_;
+
+    void discardHibernated();
+
+public:
+
+    // Slack left after text read from a file, so that it can be adopted as-is.
+    static const unsigned long gap = 0x100;
+
+    // Collects edits to make all at once. They are applied to the buffer in one pass, with
+    // one modify callback, and become one step to undo.
+    // Positions are in the text as it was before any of the edits, which must be added in
+    // order and must not overlap. Their text isn't copied, so it has to outlive commit().
+    // A transaction can also be made on a buffer that no document records.
+    class Transaction {
+        Document *document;
+        Text_Buffer &buffer;
+        std::vector<Text_Buffer::Edit> edits;
+        long change_;
+    public:
+        explicit Transaction(Document &d)
+          : document(&d)
+          , buffer(d.text)
+          , change_(0){}
+        explicit Transaction(Text_Buffer &b)
+          : document(nullptr)
+          , buffer(b)
+          , change_(0){}
+
+        void reserve(unsigned long n){ edits.reserve(n); }
+        unsigned long size() const { return edits.size(); }
+        // How much longer the text will be once the edits are made.
+        long change() const { return change_; }
+
+        void replace(unsigned long pos, unsigned long length, const char *text, unsigned long text_length){
+            const Text_Buffer::Edit edit = {pos, length, text, text_length};
+            edits.push_back(edit);
+            change_+=(long)text_length-(long)length;
+        }
+        void insert(unsigned long pos, const char *text, unsigned long text_length){ replace(pos, 0, text, text_length); }
+        void remove(unsigned long pos, unsigned long length){ replace(pos, length, "", 0); }
+
+        void commit();
+    };
+
+    Document();
+    ~Document();
+
+    Text_Buffer &buffer(){ return text; }
+    const Text_Buffer &buffer() const { return text; }
+    TextSpans spans() const { return text.spans(); }
+    unsigned long length() const { return text.length(); }
+
+    //
+    // Lines, counted from 0. These are O(log n) in the number of lines. The index is updated
+    // after any modify callbacks that were added to the buffer since the document was made.
+    //
+
+    unsigned long lineCount() const { return lines.count(); }
+    unsigned long lineStart(unsigned long line) const { return lines.start(line); }
+    // Where the line ends, not counting its newline.
+    unsigned long lineEnd(unsigned long line) const { return lines.end(line); }
+    unsigned long lineAt(unsigned long pos) const { return lines.lineAt(pos); }
+    const LineIndex &lineIndex() const { return lines; }
+
+    // Goes up with every change to the text, so that work done on a copy of it can tell
+    // whether it still applies.
+    unsigned long version() const { return version_; }
+
+    // There is one of these, for whatever views the document. It is called for changes made
+    // by undo and redo too, and whether or not they are recorded.
+    void changeCallback(ChangedCallback cb, void *arg){
+        changed = cb;
+        changed_arg = arg;
+    }
+
+    //
+    // Files. These return false and set errno on failure, and leave reporting it to the caller.
+    //
+
+    // Reads the whole file, and replaces the text with it.
+    bool load(const char *path);
+    // Replaces the text with a block from loadFileContents, read with `gap' bytes of slack,
+    // and takes ownership of it. This is for files read some other way, such as on a
+    // worker thread.
+    void adopt(char *block, unsigned long length, uLong adler, const FileStamp &stamp);
+    // Replaces the text without recording it, such as with a placeholder while loading.
+    void reset(const char *placeholder);
+
+    // True if the file is no longer what was last loaded or saved. The file's metadata is
+    // enough to tell in the usual case, so it is only read when that has changed.
+    bool changedOnDisk(const char *path) const;
+    // Writes the text over the file atomically, straight from the gap buffer.
+    bool save(const char *path);
+
+    //
+    // Hibernating. The text of a document that isn't being looked at can be kept compressed
+    // and its buffer freed. The history, checksum and file state stay as they are, since the
+    // text comes back exactly as it was. The buffer is empty until the document is woken,
+    // which has to happen before anything else uses the text.
+    //
+
+    // Takes the text as it was at `at_version', compressed by compressText, and frees the
+    // buffer. Returns false and leaves the text alone if it has changed since.
+    bool hibernate(std::vector<unsigned char> &compressed, unsigned long at_version);
+    // Brings the text back. On failure the document is still hibernating.
+    bool wake();
+    bool hibernating() const { return hibernating_; }
+    // Decompresses the text into `into' without waking, such as to search it.
+    bool copyHibernated(std::string &into) const;
+    // The bytes the text takes while hibernating.
+    size_t hibernatedSize() const { return hibernated.size(); }
+
+    // Adler32 of the file as it was last loaded or saved, or as calculated.
+    uLong checksum() const { return adler; }
+    void calculateChecksum();
+
+    //
+    // Replacing, in a single step to undo. These return how many were replaced.
+    //
+
+    // Replaces every match of the searcher. If `positions' is given, it is every match in
+    // the text, in order, and the text isn't searched again. They can overlap, but only
+    // the first of a run of overlapping matches is replaced.
+    unsigned long replaceAll(const Searcher &searcher, const char *replacement, const std::vector<unsigned long> *positions = nullptr);
+    // The same with a regular expression, where the replacement can refer to groups.
+    unsigned long replaceAll(const Regex &regex, const char *replacement);
+
+    //
+    // History.
+    //
+
+    bool canUndo() const { return !history.atRoot() || !journal.empty(); }
+    bool canRedo() const { return history.canRedo(); }
+
+    void undo();
+    void redo();
+    // Go to the state of the text from just before or just after the current one was made,
+    // even if it is on another branch of the history.
+    void earlier();
+    void later();
+
+    void clearHistory(){
+        history.clear();
+        journal.clear();
+        journal_failed = false;
+    }
+
+    // Stops changes to the buffer from being recorded.
+    void pauseHistory(){ canary++; }
+    void resumeHistory(){ canary--; }
+
+    // How many bytes of undo history to keep in memory, across every branch.
+    void historyBudget(size_t bytes){ history.budget(bytes); }
+    size_t historyBudget() const { return history.budget(); }
+    // Steps held in memory, and bytes spilled to disk.
+    size_t historySteps() const { return history.size(); }
+    unsigned long journalBytes() const { return journal.bytes(); }
+
+};
+
+}
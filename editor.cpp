@@ -19,7 +19,7 @@
 
 // Stuff for editor filetype registration
 #include "text_editor.hpp"
-#include <deque>
+#include "extension_map.hpp"
 
 namespace Flare {
 
@@ -29,79 +29,110 @@ Editor::~Editor(){
 
 Editor::Editor(int x, int y, int w, int h)
   : holder(x, y, w, h)
-  , adler(adler32(0L, nullptr, 0)){
+  , last_find_regex(false)
+  , regex_match_start(0){
 
 }
 
-// Editor filetype registry.
-struct filetype{
-    char extension[0x10];
-    Editor::EditorFactory factory;
-} default_editor;
+bool Editor::compileRegex(const char *pattern){
+    if(regex.valid() && regex_pattern==pattern)
+        return true;
 
-static inline bool ConstructFiletype(const char * const c, const unsigned l, const Editor::EditorFactory f, struct filetype &t){
-    t.factory = f;
-    // Since 0xF is contiguous set bits, a bitwise and will perform a min operation.
-    const unsigned n = l&0xF;
-    memcpy(t.extension, c, n);
-    t.extension[n] = 0;
-    return n==l;
+    std::string error;
+    if(!regex.compile(pattern, error)){
+        fl_alert("Invalid regular expression:\n%s\n%s", pattern, error.c_str());
+        return false;
+    }
+    regex_pattern = pattern;
+    return true;
 }
 
-static inline bool ConstructFiletype(const std::string &extension, const Editor::EditorFactory factory, struct filetype &new_filetype){
-    return ConstructFiletype(extension.c_str(), extension.size(), factory, new_filetype);
+void Editor::notFound(const char *text) const {
+    fl_alert("Could not find text:\n%s", text);
 }
 
-static std::deque<struct filetype> filetypes;
+void Editor::findPreviousRegex(unsigned long at){
+    if(!compileRegex(last_find.c_str()))
+        return;
+
+    // Skip the match the cursor is at the end of.
+    unsigned long before = at, start, end;
+    if(regex_match_start<at && regexMatches(regex_match_start, at))
+        before = regex_match_start;
+    if(!findLastRegex(before, start, end)){
+        notFound(last_find.c_str());
+        return;
+    }
 
-bool Editor::RegisterFiletype(const std::string &extension, Editor::EditorFactory factory){
+    regex_match_start = start;
+    showMatch(start, end-start);
+}
 
-    const char *ext = extension.c_str();
-    unsigned len = extension.size();
+void Editor::select(unsigned long start, unsigned long length){
+    // The text may have changed since the match was found.
+    const unsigned long size = textLength();
+    if(start>size)
+        start = size;
+    if(length>size-start)
+        length = size-start;
+    showMatch(start, length);
+}
 
-    if(ext[0]=='.'){
-        ext++;
-        len--;
-    }
+// Editor filetype registry.
+static Editor::EditorFactory default_editor;
+static ExtensionMap<Editor::EditorFactory> filetypes;
+static Editor::EditorFactory large_file_editor;
+static unsigned long long large_file_size;
+static ExtensionMap<const Syntax *> syntaxes;
 
-    for(std::deque<struct filetype>::iterator i = filetypes.begin(); i!=filetypes.end(); i++)
-        if(i->extension==ext){
-            i->factory = factory;
-            return true;
-        }
-    struct filetype new_filetype;
-    if(ConstructFiletype(ext, factory, new_filetype)){
-        filetypes.push_back(new_filetype);
-        return true;
-    }
-    return false;
+bool Editor::RegisterFiletype(const std::string &extension, Editor::EditorFactory factory){
+    return filetypes.set(extension, factory);
 }
 
 bool Editor::RegisterDefaultEditor(EditorFactory factory){
-    return default_editor.factory = factory;
+    return default_editor = factory;
 }
 
 Editor::EditorFactory Editor::GetDefaultEditor(){
-    return default_editor.factory;
+    return default_editor;
 }
 
 bool Editor::RestoreDefaultEditor(){
-    return default_editor.factory = TextEditor::CreateTextEditor;
+    return default_editor = TextEditor::CreateTextEditor;
 }
 
 Editor::EditorFactory Editor::GetEditorForExtension(const std::string &extension){
-    const char *ext = extension.c_str();
-    unsigned len = extension.size();
+    EditorFactory factory = default_editor;
+    filetypes.get(extension, factory);
+    return factory;
+}
 
-    if(ext[0]=='.'){
-        ext++;
-        len--;
-    }
+bool Editor::RegisterLargeFileEditor(EditorFactory factory, unsigned long long size){
+    large_file_size = size;
+    return large_file_editor = factory;
+}
+
+Editor::EditorFactory Editor::GetEditorForFile(const FileStamp &stamp, const std::string &extension){
+    if(large_file_editor && stamp.exists && stamp.size>=large_file_size)
+        return large_file_editor;
+    return GetEditorForExtension(extension);
+}
+
+bool Editor::RegisterSyntax(const std::string &extension, const Syntax *syntax){
+    return syntaxes.set(extension, syntax);
+}
+
+const Syntax *Editor::GetSyntaxForExtension(const std::string &extension){
+    const Syntax *syntax = nullptr;
+    syntaxes.get(extension, syntax);
+    return syntax;
+}
 
-    for(std::deque<struct filetype>::iterator i = filetypes.begin(); i!=filetypes.end(); i++)
-        if(i->extension==ext)
-            return i->factory;
-    return default_editor.factory;
+std::string Editor::Extension(const std::string &path){
+    const std::string::size_type dot = path.rfind('.'), slash = path.rfind('/');
+    if(dot==std::string::npos || (slash!=std::string::npos && dot<slash))
+        return std::string();
+    return path.substr(dot+1);
 }
 
 } // namespace Flare
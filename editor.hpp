@@ -1,26 +1,57 @@
 #pragma once
 
+#include "file_utilities.hpp"
+#include "regex.hpp"
+
 #include <zlib.h>
 
 #include <FL/Fl_Group.H>
 #include <FL/Fl_Text_Editor.H>
 
 #include <string>
+#include <memory>
 
 namespace Flare {
 
+class WorkerPool;
+struct Syntax;
+
 class Editor {
 protected:
 
     Fl_Group holder;
 
-    uLong adler;
-
     std::string path_;
 
+    // What the last find looked for, so findNext and findPrevious can look again. Whether
+    // it is a regular expression, and where the match it last found starts.
+    std::string last_find;
+    bool last_find_regex;
+    unsigned long regex_match_start;
+
+    // The last pattern compiled, so it isn't compiled again for every find.
+    Regex regex;
+    std::string regex_pattern;
+    // Says what is wrong with the pattern if it can't be compiled.
+    bool compileRegex(const char *pattern);
+    void notFound(const char *text) const;
+
+    // How long the text is, and moving to and highlighting some of it, for select.
+    virtual unsigned long textLength() const = 0;
+    virtual void showMatch(unsigned long at, unsigned long length) = 0;
+
+    // For findPreviousRegex. Looks back from `before' for the last match of the regex,
+    // wrapping around, and checks whether it matches exactly [start, end).
+    virtual bool findLastRegex(unsigned long before, unsigned long &start, unsigned long &end) const = 0;
+    virtual bool regexMatches(unsigned long start, unsigned long end) const = 0;
+    // findPrevious with a regular expression, from the cursor at `at'.
+    void findPreviousRegex(unsigned long at);
+
 public:
 
     typedef Editor *(*EditorFactory)(int, int, int, int);
+    // Called on the UI thread when a background load has finished.
+    typedef void (*LoadedCallback)(Editor *, bool, void *);
 
     virtual const Fl_Menu_Item *prepareMenu(void(*OpenCallback_)(Fl_Widget *, void *a) = nullptr, void(*FindCallback_)(Fl_Widget *, void *a) = nullptr, void *arg_ = nullptr) const = 0;
 
@@ -32,12 +63,47 @@ public:
     virtual void info() const = 0;
     virtual bool save() = 0;
     virtual bool load() = 0;
+    // Loads the file using the pool, and calls `loaded' once the editor is ready.
+    // Editors that can't load in the background just load right away.
+    virtual void loadInBackground(WorkerPool &pool, LoadedCallback loaded, void *arg){ loaded(this, load(), arg); }
+    virtual bool loading() const { return false; }
+    // Compresses the text using the pool and frees it, for a tab that isn't being looked
+    // at. Returns false if the editor can't, or doesn't need to. It comes back with wake(),
+    // which has to be called before the editor is shown.
+    virtual bool hibernate(WorkerPool &pool){ return false; }
+    virtual void wake() {}
+    // True from the call to hibernate, even before the text is freed, until wake.
+    virtual bool hibernating() const { return false; }
     virtual void path(const std::string &s) {path_ = s;}
     virtual const std::string &path() const {return path_;}
 
 
     virtual void find(const char *) = 0;
+    // Marks every match of the text, and lets findNext and findPrevious step through them.
+    virtual void findAll(const char *) = 0;
+    virtual void clearMatches() = 0;
+    virtual void findNext() = 0;
+    virtual void findPrevious() = 0;
+    // Replaces the match the last find stopped at, if it is still there, and finds the next one.
+    virtual void replace(const char *text, const char *replacement) = 0;
+    // Replaces every match as a single change. Returns how many were replaced.
+    virtual unsigned long replaceAll(const char *text, const char *replacement) = 0;
+    // The same as find, replace and replaceAll, but with a regular expression. Groups in the
+    // pattern can be used in the replacement as \1 to \9.
+    virtual void findRegex(const char *) = 0;
+    virtual void replaceRegex(const char *pattern, const char *replacement) = 0;
+    virtual unsigned long replaceAllRegex(const char *pattern, const char *replacement) = 0;
+    // Matches found by findAll so far. `complete' is false while it is still searching.
+    virtual unsigned long matchCount(bool &complete) const = 0;
     
+    // A copy of the text that other threads can read while the editor carries on.
+    // Editors that have no text to search, or are still loading, return null.
+    virtual std::shared_ptr<const std::string> snapshot() const { return nullptr; }
+    // Moves to and highlights some text, such as a match from a search.
+    virtual void select(unsigned long start, unsigned long length);
+    // Moves to the start of a line, counting from 1.
+    virtual void goToLine(unsigned long line) {}
+
     virtual void calculateAdler32() = 0;
 
     static bool RegisterFiletype(const std::string &extension, EditorFactory factory);
@@ -45,6 +111,15 @@ public:
     static EditorFactory GetDefaultEditor();
     static bool RestoreDefaultEditor();
     static EditorFactory GetEditorForExtension(const std::string &extension);
+    // Files of at least `size' bytes are opened with `factory', whatever their extension.
+    static bool RegisterLargeFileEditor(EditorFactory factory, unsigned long long size);
+    // The editor for a file, from its extension and what stampFile said about it.
+    static EditorFactory GetEditorForFile(const FileStamp &stamp, const std::string &extension);
+    // How files with an extension are highlighted, if they are. Null turns it off again.
+    static bool RegisterSyntax(const std::string &extension, const Syntax *syntax);
+    static const Syntax *GetSyntaxForExtension(const std::string &extension);
+    // What follows the last dot of the file name, or nothing if it has none.
+    static std::string Extension(const std::string &path);
 
 };
 
@@ -1,59 +1,59 @@
 #include "editor_window.hpp"
+#include "piece_table_editor.hpp"
+#include "large_file_viewer.hpp"
+#include "syntax.hpp"
+#include "size_utilities.hpp"
 
 #include <FL/Fl.H>
 #include <FL/Fl_File_Chooser.H>
 #include <FL/Fl_Native_File_Chooser.H>
 
+#include <algorithm>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <cassert>
 
 namespace Flare {
 
-int EditorWindow::TabScroll::handle(int e){
-    
-    if(e==FL_MOUSEWHEEL){
-    
-        if(Fl::event_dx()>0)
-            window->scrollFullyRight();
-        else if(Fl::event_dx()<0)
-            window->scrollFullyLeft();
-        else if(Fl::event_dy()>0)
-            window->scrollRight(Fl::event_dy()<<3);
-        else if(Fl::event_dy()<0)
-            window->scrollLeft(-(Fl::event_dy()<<3));
-
-        return 1;
-    }
-    
-    return Fl_Scroll::handle(e);
-}
+// How often to look for tabs to hibernate, in seconds.
+#define HIBERNATE_CHECK 30.0
+// The defaults for hibernation. See EditorWindow::hibernation.
+#define HIBERNATE_AFTER 600.0
+#define AWAKE_BUDGET 0x20000000
 
 class TabButton : public Fl_Button {
     static void ReloadCallback(Fl_Widget *w, void *a){
         Fl_Button *button = static_cast<Fl_Button *>(a);
         EditorWindow *window = static_cast<EditorWindow *>(button->user_data());
-        unsigned i = window->tab_bar.find(button);
+        const long i = window->tab_bar.tabOf(button);
+        if(i<0) return;
         switch(fl_choice("Are you sure you want to reload the document?\nYou will lose any unsave changes.", fl_yes, fl_no, nullptr)){
             case 1: return;
-            case 0: window->getEditor(i)->load();
+            case 0: window->loadTab(i);
         }
     }
     static void InfoCallback(Fl_Widget *w, void *a){
         Fl_Button *button = static_cast<Fl_Button *>(a);
         EditorWindow *window = static_cast<EditorWindow *>(button->user_data());
-        unsigned i = window->tab_bar.find(button);
-        window->getEditor(i)->info();
+        const long i = window->tab_bar.tabOf(button);
+        if(i<0) return;
+        window->info(i);
     }
     static void CloseCallback(Fl_Widget *w, void *a){
         Fl_Button *button = static_cast<Fl_Button *>(a);
         EditorWindow *window = static_cast<EditorWindow *>(button->user_data());
-        unsigned i = window->tab_bar.find(button);
-        switch(fl_choice("Save Changes?", fl_cancel, fl_yes, fl_no)){
-            case 0: return;
-            case 1: window->getEditor(i)->save();
+        const long i = window->tab_bar.tabOf(button);
+        if(i<0) return;
+        // A tab that was never shown has nothing to save.
+        if(window->getEditor(i)){
+            switch(fl_choice("Save Changes?", fl_cancel, fl_yes, fl_no)){
+                case 0: return;
+                case 1: window->getEditor(i)->save();
+            }
         }
+        // The strip keeps the button for another tab.
         window->close(i);
-        Fl::delete_widget(button);
     }
 public:
     int handle(int e) override {
@@ -77,6 +77,13 @@ public:
     TabButton(int X, int Y, int W, int H, const char *L = nullptr) : Fl_Button(X, Y, W, H, L){}
 };
 
+// The strip places and labels the buttons itself.
+static Fl_Button *NewTabButton(void *a){
+    Fl_Button * const button = new TabButton(0, 0, 0, 0);
+    button->callback(EditorWindow::ShowButtonCallback, a);
+    return button;
+}
+
 const double ScrollRate(){
     return 1.0/100.0;
 }
@@ -89,34 +96,11 @@ void EditorWindow::timer_callback(void *a){
         return;
     }
     
-    window->TryEditorWindowScroll(window->movement_direction);
+    window->tab_bar.scrollBy(window->movement_direction);
     
     Fl::add_timeout(ScrollRate(), EditorWindow::timer_callback, a);
 }
 
-void EditorWindow::scrollFullyLeft(){
-    TryEditorWindowScroll(0);
-}
-
-void EditorWindow::scrollFullyRight(){
-    TryEditorWindowScroll(EditorMaxScroll());
-}
-
-void EditorWindow::scrollLeft(int ticks){
-
-    if(ticks>=scroll.xposition())
-        scrollFullyLeft();
-    else for(int i = 0; i<ticks; i++)
-            TryEditorWindowScroll(-1);
-}
-
-void EditorWindow::scrollRight(int ticks){
-    if(ticks + scroll.xposition()>=EditorMaxScroll())
-        scrollFullyRight();
-    else for(int i = 0; i<ticks; i++)
-            TryEditorWindowScroll(1);
-}
-
 template<int D>
 void repeat_button_callback(Fl_Widget *w, void *a){
     EditorWindow *window = static_cast<EditorWindow *>(a);
@@ -130,12 +114,11 @@ void repeat_button_callback(Fl_Widget *w, void *a){
 
 void EditorWindow::ShowButtonCallback(Fl_Widget *w, void *a){
     EditorWindow *window = static_cast<EditorWindow *>(a);
-    unsigned i = window->tab_bar.find(w);
+    const long i = window->tab_bar.tabOf(w);
 
-    assert(window->children()==window->tab_bar.children());
-    assert(window->children()==window->holder.children());
+    assert(window->children()==window->tab_bar.count());
 
-    assert(i<window->tab_bar.children());
+    assert(i>=0 && i<window->tab_bar.count());
 
     window->push(i);
     
@@ -143,47 +126,166 @@ void EditorWindow::ShowButtonCallback(Fl_Widget *w, void *a){
 
 void EditorWindow::openFile(const std::string &path){
 
-    assert(editors.size()==tab_bar.children());
-    assert(editors.size()==holder.children());
-
-    fl_font(window.labelfont(), window.labelsize());
-
+    assert(tabs.size()==tab_bar.count());
 
     std::string::const_iterator from = path.cend()--, to = path.cend();
     while(from!=path.cbegin()) if(*from=='/') {from++; break; } else from--;
 
     const std::string new_path = std::string(from, to);
 
-    from = path.cend()--;
-    while(from!=path.cbegin()) if(*from=='.') {from++; break; } else from--;
+    tabs.push_back(Tab());
+    tabs.back().path = path;
+    stampFile(path.c_str(), tabs.back().stamp);
 
-    const std::string extension = std::string(from, to);
+    tab_bar.append(new_path);
 
-    const Fl_Widget * const end_button = last_button();
-    Fl_Button * const button = new TabButton(0, 0, fl_width(new_path.c_str(), new_path.size())+12, 24);
+    assert(tabs.size()==tab_bar.count());
 
-    button->copy_label(new_path.c_str());
-    
-    {
-        Editor *e = Editor::GetEditorForExtension(extension)(holder.x(), holder.y(), holder.w(), holder.h());
-        editors.emplace_back(e);
+}
+
+Editor *EditorWindow::activate(unsigned i){
+    Tab &tab = tabs[i];
+    if(tab.editor){
+        tab.editor->wake();
+        return tab.editor.get();
     }
 
-    holder.add(editors.back()->getGroup()),
-    tab_bar.add(button);
+    // The file may have changed since it was opened.
+    stampFile(tab.path.c_str(), tab.stamp);
+    tab.editor.reset(Editor::GetEditorForFile(tab.stamp, Editor::Extension(tab.path))(holder.x(), holder.y(), holder.w(), holder.h()));
+    holder.add(tab.editor->getGroup());
+
+    tab.editor->path(tab.path);
+    loadTab(i);
+    return tab.editor.get();
+}
+
+void EditorWindow::loadTab(unsigned i){
+    // It is loaded when it is first shown.
+    if(!tabs[i].editor)
+        return;
+
+    // Mark the tab as loading until the editor tells us otherwise.
+    tab_bar.loading(i, true);
 
-    tab_bar.size(tab_bar.h()+button->w()+Fl::box_dw(button->box()), tab_bar.h());
+    tabs[i].editor->loadInBackground(workers, LoadedCallback, this);
+}
 
-    editors.back()->path(path);
-    editors.back()->load();
+void EditorWindow::info(unsigned i){
+    if(tabs[i].editor){
+        tabs[i].editor->wake();
+        tabs[i].editor->info();
+        return;
+    }
 
-    button->callback(ShowButtonCallback, this);
+    const Tab &tab = tabs[i];
+    char buffer[8];
+    const unsigned long long s = tab.stamp.size;
+    fl_alert("Editor information:\npath: %s\nFilesize: %s %cB\nNot loaded yet.\n",
+        tab.path.c_str(), sizeNumberString(buffer, s), sizePrefixChar(s));
+}
 
-    assert(editors.size()==tab_bar.children());
-    assert(editors.size()==holder.children());
+void EditorWindow::LoadedCallback(Editor *e, bool success, void *a){
+    EditorWindow *window = static_cast<EditorWindow *>(a);
 
-    button->do_callback();
+    for(unsigned i = 0; i<window->children(); i++){
+        if(window->tabs[i].editor.get()==e){
+            window->tab_bar.loading(i, false);
+
+            if(window->pending_reveal.editor==e){
+                window->pending_reveal.editor = nullptr;
+                if(success)
+                    e->select(window->pending_reveal.pos, window->pending_reveal.length);
+            }
+            return;
+        }
+    }
+}
 
+void EditorWindow::HibernateTimeout(void *a){
+    EditorWindow * const window = static_cast<EditorWindow *>(a);
+    window->hibernateTabs();
+    Fl::repeat_timeout(HIBERNATE_CHECK, HibernateTimeout, a);
+}
+
+void EditorWindow::hibernateTabs(){
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    // The size of a tab's file stands in for the memory it takes, which is near enough
+    // without asking every editor.
+    unsigned long long awake = 0;
+    std::vector<unsigned> hidden;
+    for(unsigned i = 0; i<children(); i++){
+        const Editor * const editor = tabs[i].editor.get();
+        if(!editor || editor->hibernating())
+            continue;
+        awake+=tabs[i].stamp.size;
+        if(i!=which_)
+            hidden.push_back(i);
+    }
+
+    // Hidden longest first.
+    std::sort(hidden.begin(), hidden.end(), [this](unsigned a, unsigned b){
+        return tabs[a].hidden<tabs[b].hidden;
+    });
+
+    for(std::vector<unsigned>::const_iterator i = hidden.begin(); i!=hidden.end(); i++){
+        const std::chrono::duration<double> idle = now-tabs[*i].hidden;
+        const bool too_long = hibernate_after>0.0 && idle.count()>=hibernate_after;
+        const bool over_budget = awake_budget>0 && awake>awake_budget;
+        if(!too_long && !over_budget)
+            break;
+
+        if(tabs[*i].editor->hibernate(workers))
+            awake-=tabs[*i].stamp.size;
+    }
+}
+
+void EditorWindow::findInTabs(const char *text, bool regex){
+    std::vector<SearchResults::Tab> searched;
+    searched.reserve(children());
+    for(unsigned i = 0; i<children(); i++){
+        // Tabs that haven't been shown yet are read from the file.
+        Editor * const editor = tabs[i].editor.get();
+        const SearchResults::Tab tab = {editor, tab_bar.tabLabel(i),
+            editor ? editor->snapshot() : nullptr, editor ? std::string() : tabs[i].path};
+        searched.push_back(tab);
+    }
+    results.start(workers, searched, text, regex);
+}
+
+void EditorWindow::reveal(const Editor *e, unsigned long pos, unsigned long length){
+    for(unsigned i = 0; i<children(); i++){
+        if(tabs[i].editor.get()==e){
+            push(i);
+            tabs[i].editor->select(pos, length);
+            return;
+        }
+    }
+}
+
+void EditorWindow::findInFiles(const std::string &directory, const char *text, bool regex){
+    results.startFiles(workers, directory, text, regex);
+}
+
+void EditorWindow::revealFile(const std::string &path, unsigned long pos, unsigned long length){
+    unsigned i = 0;
+    while(i<children() && tabs[i].path!=path)
+        i++;
+
+    if(i==children())
+        openFile(path);
+    push(i);
+
+    // Either way it might not have finished loading yet.
+    Editor * const editor = tabs[i].editor.get();
+    if(editor->loading()){
+        pending_reveal.editor = editor;
+        pending_reveal.pos = pos;
+        pending_reveal.length = length;
+    }
+    else
+        editor->select(pos, length);
 }
 
 /*
@@ -199,11 +301,7 @@ void NonNativeOpenCallback(Fl_Widget *w, void *a){
     for(int i = 0; i<chooser.count(); i++)
         window->openFile(chooser.value(i));
 
-    window->scroll.redraw();
-    window->tab_bar.redraw();
-
-    assert(window->editors.size()==window->tab_bar.children());
-    assert(window->editors.size()==window->holder.children());
+    assert(window->tabs.size()==window->tab_bar.count());
 
     window->push(window->children()-1, true);
 
@@ -230,6 +328,10 @@ void EditorWindow::OpenCallback(Fl_Widget *w, void *a){
     for(int i = 0; i<chooser.count(); i++)
         window->openFile(chooser.filename(i));
 
+    // Only the last one is loaded now, the others when they are first shown.
+    if(chooser.count()>0)
+        window->push(window->children()-1);
+
 }
 
 static const Fl_Menu_Item s_menu[4] = {
@@ -253,18 +355,21 @@ Fl_Menu_Item *EditorWindow::emptyMenu(){
 #define BUTTON_WIDTH 32
 #define MENU_HEIGHT 24
 
+
 EditorWindow::EditorWindow()
   : window(WIDTH, HEIGHT, "Flare Text Editor")
   , finder(*this)
+  , results(*this)
+  , hibernate_after(HIBERNATE_AFTER)
+  , awake_budget(AWAKE_BUDGET)
   , menu_bar(0, 0, WIDTH, MENU_HEIGHT)
   , left_button(0, MENU_HEIGHT, BUTTON_HEIGHT, BUTTON_HEIGHT, "<")
   , right_button(WIDTH-BUTTON_WIDTH, MENU_HEIGHT, BUTTON_WIDTH, BUTTON_HEIGHT, ">")
-  , scroll(BUTTON_HEIGHT, MENU_HEIGHT, WIDTH-(BUTTON_WIDTH<<1), BUTTON_HEIGHT)
-  , tab_bar(BUTTON_HEIGHT, MENU_HEIGHT, 0, BUTTON_HEIGHT)
+  , tab_bar(BUTTON_HEIGHT, MENU_HEIGHT, WIDTH-(BUTTON_WIDTH<<1), BUTTON_HEIGHT, NewTabButton, this)
   , holder(0, BUTTON_HEIGHT+MENU_HEIGHT, WIDTH, HEIGHT-(BUTTON_HEIGHT+MENU_HEIGHT))
   , resizer(BUTTON_WIDTH<<1, (BUTTON_HEIGHT<<1)+MENU_HEIGHT, WIDTH-(BUTTON_WIDTH<<3), HEIGHT-(BUTTON_HEIGHT<<2)){
     
-    scroll.window = this;
+    pending_reveal.editor = nullptr;
     
     window.add(holder);
     window.add(resizer);
@@ -272,12 +377,6 @@ EditorWindow::EditorWindow()
 //    resizer.box(FL_EMBOSSED_BOX);
     holder.end();
 
-    scroll.type(0);
-    scroll.end();
-
-    tab_bar.resizable(nullptr);
-    tab_bar.type(Fl_Pack::HORIZONTAL);
-
     left_button.callback(repeat_button_callback<-3>, this);
     left_button.when(FL_WHEN_CHANGED);
     right_button.callback(repeat_button_callback<3>, this);
@@ -291,15 +390,55 @@ EditorWindow::EditorWindow()
 
     
     Fl::option(Fl::OPTION_VISIBLE_FOCUS, false);
+
+    Fl::add_timeout(HIBERNATE_CHECK, HibernateTimeout, this);
+}
+
+EditorWindow::~EditorWindow(){
+    Fl::remove_timeout(HibernateTimeout, this);
+    tabs.clear();
 }
 
 } // namespace Flare
 
 int main(int argc, char *argv[]){
 
+    // Enables Fl::awake, which the background workers use to hand results to the UI.
+    Fl::lock();
+
     Flare::Editor::RestoreDefaultEditor();
 
+    // Files too big to edit comfortably are only viewed.
+    Flare::Editor::RegisterLargeFileEditor(Flare::LargeFileViewer::CreateLargeFileViewer, 0x10000000);
+
+    {
+        static const char *const c_extensions[] = {"c", "h", "cpp", "hpp", "cc", "cxx", "hh", "inl"};
+        for(unsigned i = 0; i<sizeof(c_extensions)/sizeof(c_extensions[0]); i++)
+            Flare::Editor::RegisterSyntax(c_extensions[i], &Flare::c_syntax);
+        Flare::Editor::RegisterSyntax("py", &Flare::python_syntax);
+        Flare::Editor::RegisterSyntax("sh", &Flare::shell_syntax);
+        Flare::Editor::RegisterSyntax("bash", &Flare::shell_syntax);
+    }
+
+    // Keep text in piece tables rather than gap buffers, which suits very large files, and
+    // edit those too.
+    // Tabs left alone for --hibernate-after seconds, or hidden longest once the open files
+    // add up to more than --awake-budget bytes, are compressed until shown again.
+    double hibernate_after = HIBERNATE_AFTER;
+    unsigned long long awake_budget = AWAKE_BUDGET;
+    for(int i = 1; i<argc; i++){
+        if(strcmp(argv[i], "--piece-table")==0){
+            Flare::Editor::RegisterDefaultEditor(Flare::PieceTableEditor::CreatePieceTableEditor);
+            Flare::Editor::RegisterLargeFileEditor(nullptr, 0);
+        }
+        else if(strcmp(argv[i], "--hibernate-after")==0 && i+1<argc)
+            hibernate_after = strtod(argv[++i], nullptr);
+        else if(strcmp(argv[i], "--awake-budget")==0 && i+1<argc)
+            awake_budget = strtoull(argv[++i], nullptr, 0);
+    }
+
     Flare::EditorWindow window;
+    window.hibernation(hibernate_after, awake_budget);
 // editor(0, 0, 600, 400);
     
     window.show();
@@ -2,10 +2,12 @@
 
 #include "editor.hpp"
 #include "find.hpp"
+#include "search_results.hpp"
+#include "worker_pool.hpp"
+#include "file_utilities.hpp"
+#include "tab_strip.hpp"
 
 #include <FL/Fl_Window.H>
-#include <FL/Fl_Scroll.H>
-#include <FL/Fl_Pack.H>
 #include <FL/Fl_Group.H>
 #include <FL/Fl_Box.H>
 #include <FL/Fl_Button.H>
@@ -13,6 +15,7 @@
 
 #include <vector>
 #include <memory>
+#include <chrono>
 
 namespace Flare {
 
@@ -25,38 +28,51 @@ public:
         window->finder.show();
     }
 private:
-    
-    class TabScroll : public Fl_Scroll {
-    public:
-        TabScroll(int ax, int ay, int aw, int ah, const char *acaption = nullptr)
-          : Fl_Scroll(ax, ay, aw, ah, acaption){}
-        int handle(int e) override;
-        
-        EditorWindow *window;
-        
-    };
-    
+
     Find finder;
+    SearchResults results;
+
+    // Where to go once a tab opened by revealFile has loaded.
+    struct {
+        const Editor *editor;
+        unsigned long pos, length;
+    } pending_reveal;
     
-    std::vector<std::unique_ptr<Editor> > editors;
+    // Declared before the editors so that it outlives them.
+    WorkerPool workers;
+
+    // An open file. Its editor is only made, and the file only loaded, once the tab is
+    // first shown, so opening a lot of files at once costs little more than a stat each.
+    struct Tab {
+        std::string path;
+        FileStamp stamp;
+        std::unique_ptr<Editor> editor;
+        // When it was last hidden, to find the tabs that have gone unused longest.
+        std::chrono::steady_clock::time_point hidden;
+    };
+    std::vector<Tab> tabs;
+
+    // Tabs that haven't been shown for this long, in seconds, are hibernated. 0 is never.
+    double hibernate_after;
+    // While the files of the tabs that are awake add up to more than this many bytes, the
+    // tabs hidden longest are hibernated. 0 is no limit.
+    unsigned long long awake_budget;
+
+    static void HibernateTimeout(void *a);
+    // Hibernates the tabs that have been idle too long, or are over the budget.
+    void hibernateTabs();
     
     Fl_Window window;
     Fl_Menu_Bar menu_bar;
     Fl_Button left_button, right_button;
-    TabScroll scroll;
-    Fl_Pack tab_bar;
+    TabStrip tab_bar;
     Fl_Group holder;
     Fl_Box resizer;
     
     bool scroll_again;
-    unsigned movement_direction; // -1 is left, 1 is right
+    int movement_direction; // -1 is left, 1 is right
     static void timer_callback(void *a);
     
-    void scrollFullyLeft();
-    void scrollFullyRight();
-    void scrollLeft(int ticks = 1);
-    void scrollRight(int ticks = 1);
-    
     unsigned which_;
     
     template<int D> friend
@@ -64,84 +80,53 @@ private:
 
     Fl_Menu_Item *emptyMenu();
     
+    // Makes the tab's editor and starts loading the file, if that hasn't been done yet, or
+    // wakes it if it is hibernating.
+    Editor *activate(unsigned i);
+    // The editor of the tab being shown.
+    Editor *current(){ return activate(which()); }
+
     void show(unsigned i){
         if(i>=children()) return;
+        Editor * const editor = activate(i);
         void *o = (void *)menu_bar.menu();
         menu_bar.menu(
-            editors[i]->prepareMenu(OpenCallback, FindCallback, this)
+            editor->prepareMenu(OpenCallback, FindCallback, this)
         );
         free(o);
-        tab_bar.child(i)->box(FL_GLEAM_DOWN_BOX);
-        tab_bar.child(i)->labelcolor(1);
-        tab_bar.child(i)->color(FL_BLUE);
-        holder.child(i)->show(); 
+        tab_bar.select(i);
+        tab_bar.reveal(i);
+        editor->getGroup().show();
         menu_bar.redraw();
     }
 
     void hide(unsigned i){
         if(i>=children()) return;
-        tab_bar.child(i)->box(FL_UP_BOX);
-        tab_bar.child(i)->labelcolor(FL_FOREGROUND_COLOR);
-        tab_bar.child(i)->color(FL_BACKGROUND_COLOR);
-        holder.child(i)->hide();
+        tab_bar.select(-1);
+        tabs[i].hidden = std::chrono::steady_clock::now();
+        if(tabs[i].editor)
+            tabs[i].editor->getGroup().hide();
     }
 
-    inline const Fl_Widget *first_button() const {
-        if(tab_bar.children()==0) return nullptr;
-        return tab_bar.child(0);
-    }
-
-    inline const Fl_Widget *last_button() const {
-        if(tab_bar.children()==0) return nullptr;
-        return tab_bar.child(tab_bar.children()-1);
-    }
-
-    inline Editor *getEditor(unsigned i) { return editors[i].get(); };
+    // Null if the tab hasn't been shown yet.
+    inline Editor *getEditor(unsigned i) { return tabs[i].editor.get(); };
+    void loadTab(unsigned i);
+    void info(unsigned i);
     bool close(unsigned i){
-        editors.erase(editors.begin()+i);
+        tabs.erase(tabs.begin()+i);
+        tab_bar.erase(i);
+        // Stay on the same tab when one before it closes.
+        if(which_>i)
+            which_--;
         return true;
     }
-    
-    inline long EditorMaxScroll(){
-    
-        long last_x_plus_w = 0;
-        
-        for(int i = 0; i<scroll.children(); i++){
-            const Fl_Widget * const c = scroll.child(i);
-            const long l = c->w() + c->x();
-            
-            if(l > last_x_plus_w)
-                last_x_plus_w = l;
-        }
-        return last_x_plus_w;
-    }
 
-    inline void TryEditorWindowScroll(int DX){
-        
-        if(scroll.children()==0) 
-            return;
-        const long to = scroll.xposition()+DX,
-            n_w = window.w() - 32;
-            
-        if(
-                ((to >= 0) && DX<0)
-                ||
-                ((n_w < EditorMaxScroll()) && DX>0)
-        ){
-            scroll.scroll_to(
-                to, 
-                scroll.yposition());
-        }
-    }
 public:
     
     friend class TabButton;
-    friend class TabScroll;
     
     EditorWindow();
-    ~EditorWindow(){
-        editors.clear();
-    }
+    ~EditorWindow();
 
     Fl_Box *getResizer() { return &resizer; }
 
@@ -151,8 +136,8 @@ public:
     void add(T &that){ holder.add(that); }
 
     unsigned which(){
-        if(which_>=holder.children())
-            which_ = holder.children()-1;
+        if(which_>=children())
+            which_ = children()-1;
         return which_;
     }
 
@@ -162,13 +147,45 @@ public:
         hide(which_);
         show(i);
         which_ = i;
+
+        // The tab just shown may have put the others over the budget.
+        hibernateTabs();
+    }
+
+    // See hibernate_after and awake_budget.
+    void hibernation(double idle_seconds, unsigned long long budget){
+        hibernate_after = idle_seconds;
+        awake_budget = budget;
     }
     
-    inline void find(const char * text){ editors[which()]->find(text); }
+    inline void find(const char * text){ current()->find(text); }
+    inline void findAll(const char * text){ if(!empty()) current()->findAll(text); }
+    inline void replace(const char *text, const char *replacement){ if(!empty()) current()->replace(text, replacement); }
+    inline unsigned long replaceAll(const char *text, const char *replacement){
+        return empty() ? 0 : current()->replaceAll(text, replacement);
+    }
+    inline void findRegex(const char *pattern){ if(!empty()) current()->findRegex(pattern); }
+    inline void replaceRegex(const char *pattern, const char *replacement){ if(!empty()) current()->replaceRegex(pattern, replacement); }
+    inline unsigned long replaceAllRegex(const char *pattern, const char *replacement){
+        return empty() ? 0 : current()->replaceAllRegex(pattern, replacement);
+    }
+    // Searches every open tab in the background, and lists the matches.
+    void findInTabs(const char *text, bool regex);
+    // Switches to the tab of `e', if it is still open, and shows the text there.
+    void reveal(const Editor *e, unsigned long pos, unsigned long length);
+    // Searches every file under `directory' in the background, and lists the matches.
+    void findInFiles(const std::string &directory, const char *text, bool regex);
+    // Like reveal, but for a file, which is opened first if it isn't already.
+    void revealFile(const std::string &path, unsigned long pos, unsigned long length);
+    inline unsigned long matchCount(bool &complete){
+        complete = true;
+        return empty() ? 0 : current()->matchCount(complete);
+    }
     
-    inline bool empty() const { return editors.empty(); }
-    inline unsigned children() const { return editors.size(); }
-    inline Fl_Widget *child(unsigned i) { return holder.child(i); }
+    inline bool empty() const { return tabs.empty(); }
+    inline unsigned children() const { return tabs.size(); }
+    // Null if the tab hasn't been shown yet.
+    inline Fl_Widget *child(unsigned i) { return tabs[i].editor ? &tabs[i].editor->getGroup() : nullptr; }
 
     inline Fl_Widget *first(){
         if(empty()) return nullptr;
@@ -180,8 +197,10 @@ public:
         return child(children()-1);
     }
 
+    // Adds a tab for the file, without showing it or loading the file yet.
     void openFile(const std::string &path);
     static void ShowButtonCallback(Fl_Widget *w, void *a);
+    static void LoadedCallback(Editor *e, bool success, void *a);
 
 };
 
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <deque>
+#include <string>
+#include <cstring>
+
+namespace Flare {
+
+// A small table from file extensions to something, such as the editor to open a file with.
+// Extensions are stored inline, so each can be at most 15 characters. A leading dot is
+// ignored, so ".txt" and "txt" are the same extension.
+template<class T>
+class ExtensionMap {
+
+    struct Entry {
+        char extension[0x10];
+        unsigned length;
+        T value;
+    };
+
+    std::deque<Entry> entries;
+
+    static const char *Strip(const std::string &extension, unsigned &length){
+        const char *ext = extension.c_str();
+        length = extension.size();
+        if(length>0 && ext[0]=='.'){
+            ext++;
+            length--;
+        }
+        return ext;
+    }
+
+    // Returns the index of the entry, or -1.
+    long find(const char *ext, unsigned length) const {
+        for(typename std::deque<Entry>::const_iterator i = entries.begin(); i!=entries.end(); i++)
+            if(i->length==length && memcmp(i->extension, ext, length)==0)
+                return i-entries.begin();
+        return -1;
+    }
+
+public:
+
+    // Returns false if the extension is too long.
+    bool set(const std::string &extension, T value){
+        unsigned length;
+        const char * const ext = Strip(extension, length);
+        if(length>=sizeof(Entry().extension))
+            return false;
+
+        const long existing = find(ext, length);
+        if(existing>=0){
+            entries[existing].value = value;
+            return true;
+        }
+
+        Entry entry;
+        memcpy(entry.extension, ext, length);
+        entry.extension[length] = 0;
+        entry.length = length;
+        entry.value = value;
+        entries.push_back(entry);
+        return true;
+    }
+
+    // Returns false, leaving `value' alone, if the extension isn't in the table.
+    bool get(const std::string &extension, T &value) const {
+        unsigned length;
+        const char * const ext = Strip(extension, length);
+        const long i = find(ext, length);
+        if(i<0)
+            return false;
+        value = entries[i].value;
+        return true;
+    }
+
+    unsigned long size() const { return entries.size(); }
+
+};
+
+}
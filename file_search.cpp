@@ -0,0 +1,218 @@
+#include "file_search.hpp"
+#include "worker_pool.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace Flare {
+
+// How much of the line to show on either side of a match.
+#define EXCERPT_CONTEXT 60
+
+// Files are searched this many to a job, so that tiny files don't each cost a job.
+#define FILE_BATCH 32
+
+// A file with a nul byte this close to the start is taken to be binary.
+#define BINARY_PROBE 0x2000
+
+// How much text is searched between checks for the search being cancelled.
+#define CANCEL_SLICE 0x100000
+
+bool SearchPattern::compile(const char *text, bool regex_, std::string &error){
+    use_regex = regex_;
+    if(use_regex)
+        return regex.compile(text, error);
+    searcher = std::make_shared<Searcher>(text, strlen(text));
+    return true;
+}
+
+static std::string Excerpt(const char *text, unsigned long length, unsigned long start, unsigned long end){
+    if(end-start>EXCERPT_CONTEXT*2)
+        end = start+EXCERPT_CONTEXT*2;
+
+    unsigned long from = start, to = end;
+    while(from>0 && start-from<EXCERPT_CONTEXT && text[from-1]!='\n')
+        from--;
+    while(to<length && to-end<EXCERPT_CONTEXT && text[to]!='\n')
+        to++;
+
+    std::string line(text+from, to-from);
+    for(std::string::iterator i = line.begin(); i!=line.end(); i++)
+        if((unsigned char)*i<' ')
+            *i = ' ';
+    return line;
+}
+
+unsigned long CollectMatches(const SearchPattern &pattern, Regex &regex, const char *text, unsigned long length,
+    unsigned long from, unsigned long to, size_t limit, std::vector<SearchMatch> &into, unsigned long &lines,
+    const std::atomic<bool> &cancelled){
+
+    const TextSpans spans = {text, length, nullptr, 0};
+
+    unsigned long found = 0, line = 0, counted = from, at = from;
+    while(at<to && !cancelled){
+        // A slice at a time, so that a long stretch without any matches can be cancelled.
+        const unsigned long slice = (to-at>CANCEL_SLICE) ? (at+CANCEL_SLICE) : to;
+        unsigned long start, end;
+        if(pattern.use_regex){
+            if(!regex.find(spans, at, slice, start, end)){
+                at = slice;
+                continue;
+            }
+        }
+        else{
+            const long match = pattern.searcher->find(spans, at, slice);
+            if(match<0){
+                at = slice;
+                continue;
+            }
+            start = match;
+            end = match+pattern.searcher->length();
+        }
+
+        line += std::count(text+counted, text+start, '\n');
+        counted = start;
+
+        found++;
+        if(into.size()<limit){
+            const SearchMatch match = {start, end-start, line, Excerpt(text, length, start, end)};
+            into.push_back(match);
+        }
+
+        // Overlapping plain matches are the same however the text is split up.
+        at = pattern.use_regex ? end : (start+1);
+    }
+
+    lines = line+std::count(text+counted, text+to, '\n');
+    return found;
+}
+
+FileSearch::FileSearch(WorkerPool &p, const SearchPattern &pat, size_t l, const FoundCallback &f, const DoneCallback &d)
+  : pool(p)
+  , pattern(pat)
+  , limit(l)
+  , found(f)
+  , done(d)
+  , cancelled(false)
+  , outstanding(0)
+  , searched(0){}
+
+std::shared_ptr<FileSearch> FileSearch::Start(WorkerPool &pool, const std::string &directory, const SearchPattern &pattern,
+    size_t limit, const FoundCallback &found, const DoneCallback &done){
+
+    const std::shared_ptr<FileSearch> search(new FileSearch(pool, pattern, limit, found, done));
+    search->schedule(std::bind(&FileSearch::walk, search.get(), directory));
+    return search;
+}
+
+void FileSearch::schedule(const std::function<void()> &job){
+    // Count the job before it can run, so that the count can't reach zero early.
+    outstanding++;
+
+    const std::shared_ptr<FileSearch> self = shared_from_this();
+    pool.post([self, job](){
+        if(!self->cancelled)
+            job();
+        if(--self->outstanding==0)
+            self->done();
+    });
+}
+
+void FileSearch::walk(const std::string &directory){
+    DIR * const dir = opendir(directory.c_str());
+    if(!dir)
+        return;
+
+    std::vector<std::string> files;
+    while(const struct dirent *entry = readdir(dir)){
+        if(cancelled)
+            break;
+
+        // Skips . and .. as well as hidden files, and with them .git and the like.
+        if(entry->d_name[0]=='.')
+            continue;
+
+        const std::string path = directory+'/'+entry->d_name;
+
+        bool is_dir = entry->d_type==DT_DIR, is_file = entry->d_type==DT_REG;
+        if(entry->d_type==DT_UNKNOWN){
+            struct stat info;
+            if(lstat(path.c_str(), &info)!=0)
+                continue;
+            is_dir = S_ISDIR(info.st_mode);
+            is_file = S_ISREG(info.st_mode);
+        }
+
+        if(is_dir)
+            schedule(std::bind(&FileSearch::walk, this, path));
+        else if(is_file){
+            files.push_back(path);
+            if(files.size()==FILE_BATCH){
+                schedule(std::bind(&FileSearch::searchFiles, this, files));
+                files.clear();
+            }
+        }
+    }
+    closedir(dir);
+
+    if(!files.empty())
+        schedule(std::bind(&FileSearch::searchFiles, this, files));
+}
+
+void FileSearch::searchFiles(const std::vector<std::string> &paths){
+    // One copy for the whole batch, so the DFA it builds is reused from file to file.
+    Regex regex;
+    if(pattern.use_regex)
+        regex = pattern.regex;
+
+    std::vector<File> results;
+    for(std::vector<std::string>::const_iterator i = paths.begin(); i!=paths.end() && !cancelled; i++){
+        File file;
+        if(searchFile(*i, regex, file) && file.found>0)
+            results.push_back(std::move(file));
+        searched++;
+    }
+
+    if(!results.empty() && !cancelled)
+        found(results);
+}
+
+bool FileSearch::searchFile(const std::string &path, Regex &regex, File &into){
+    const int fd = open(path.c_str(), O_RDONLY);
+    if(fd<0)
+        return false;
+
+    struct stat info;
+    if(fstat(fd, &info)!=0 || !S_ISREG(info.st_mode) || info.st_size==0){
+        close(fd);
+        return false;
+    }
+
+    const unsigned long length = info.st_size;
+    void * const mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapped==MAP_FAILED)
+        return false;
+
+    const char * const text = static_cast<const char *>(mapped);
+    bool searched_file = false;
+    if(!memchr(text, 0, std::min<unsigned long>(length, BINARY_PROBE))){
+        madvise(mapped, length, MADV_SEQUENTIAL);
+
+        unsigned long lines;
+        into.path = path;
+        into.found = CollectMatches(pattern, regex, text, length, 0, length, limit, into.matches, lines, cancelled);
+        searched_file = true;
+    }
+
+    munmap(mapped, length);
+    return searched_file;
+}
+
+}
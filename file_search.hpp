@@ -0,0 +1,89 @@
+#pragma once
+
+#include "search.hpp"
+#include "regex.hpp"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
+
+namespace Flare {
+
+class WorkerPool;
+
+// What a background search looks for. A pattern can be shared between threads, since each
+// search makes its own copy of the Regex.
+struct SearchPattern {
+    std::shared_ptr<const Searcher> searcher;
+    Regex regex;
+    bool use_regex;
+
+    // Returns false and describes the problem in `error' if `text' is not a valid regex.
+    bool compile(const char *text, bool regex, std::string &error);
+};
+
+// One match found by a background search, with what a list of results would show for it.
+struct SearchMatch {
+    unsigned long pos, length;
+    // Lines before the match, counted from where the search started.
+    unsigned long line;
+    std::string excerpt;
+};
+
+// Finds the matches that start in [from, to) of some text. Only the first `limit' are
+// kept, but all of them are counted in the return value. `lines' is set to the number of
+// newlines in [from, to). Plain text matches may overlap, regex matches don't.
+unsigned long CollectMatches(const SearchPattern &pattern, Regex &regex, const char *text, unsigned long length,
+    unsigned long from, unsigned long to, size_t limit, std::vector<SearchMatch> &into, unsigned long &lines,
+    const std::atomic<bool> &cancelled);
+
+// Searches every file under a directory on a WorkerPool. Directories are read in parallel,
+// and files are mapped into memory and searched in batches. Files that look binary are
+// skipped, as is anything hidden. Symbolic links are not followed.
+class FileSearch : public std::enable_shared_from_this<FileSearch> {
+public:
+
+    struct File {
+        std::string path;
+        unsigned long found;
+        std::vector<SearchMatch> matches;
+    };
+
+    // Both of these are called on worker threads, `found' possibly on several at once. It is
+    // only called for files with matches. `done' is called once after everything else,
+    // including after a cancel.
+    typedef std::function<void(std::vector<File> &)> FoundCallback;
+    typedef std::function<void()> DoneCallback;
+
+private:
+
+    WorkerPool &pool;
+    SearchPattern pattern;
+    size_t limit;
+    FoundCallback found;
+    DoneCallback done;
+
+    std::atomic<bool> cancelled;
+    std::atomic<unsigned long> outstanding, searched;
+
+    FileSearch(WorkerPool &p, const SearchPattern &pat, size_t l, const FoundCallback &f, const DoneCallback &d);
+
+    void schedule(const std::function<void()> &job);
+    void walk(const std::string &directory);
+    void searchFiles(const std::vector<std::string> &paths);
+    bool searchFile(const std::string &path, Regex &regex, File &into);
+
+public:
+
+    // Keeps at most `limit' matches for each file.
+    static std::shared_ptr<FileSearch> Start(WorkerPool &pool, const std::string &directory, const SearchPattern &pattern,
+        size_t limit, const FoundCallback &found, const DoneCallback &done);
+
+    void cancel(){ cancelled = true; }
+    unsigned long filesSearched() const { return searched; }
+
+};
+
+}
@@ -0,0 +1,479 @@
+#include "file_utilities.hpp"
+
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <string>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+
+namespace Flare {
+
+// Big enough that reading is bound by the disk, small enough that the checksum
+// is run while the chunk is still in cache.
+static const unsigned long read_chunk_size = 0x100000;
+
+// How much is written per writev when saving, see read_chunk_size.
+static const unsigned long write_chunk_size = 0x400000;
+
+// Fl_Text_Buffer uses int offsets, so nothing larger than this can ever be edited.
+static const unsigned long max_file_length = INT_MAX - 0x10000;
+
+static void fillStamp(const struct stat &info, FileStamp &stamp){
+    stamp.exists = true;
+    stamp.size = info.st_size;
+    stamp.inode = info.st_ino;
+    stamp.device = info.st_dev;
+#ifdef __APPLE__
+    stamp.mtime_sec = info.st_mtimespec.tv_sec;
+    stamp.mtime_nsec = info.st_mtimespec.tv_nsec;
+#else
+    stamp.mtime_sec = info.st_mtim.tv_sec;
+    stamp.mtime_nsec = info.st_mtim.tv_nsec;
+#endif
+}
+
+bool stampFile(const char *path, FileStamp &stamp){
+    struct stat info;
+    if(stat(path, &info)!=0){
+        stamp = FileStamp();
+        return false;
+    }
+    fillStamp(info, stamp);
+    return true;
+}
+
+bool fileAdler32(const char *path, uLong &adler){
+    FILE *that = fopen(path, "rb");
+    if(!that)
+        return false;
+
+    char * const block = (char *)malloc(read_chunk_size);
+    if(!block){
+        fclose(that);
+        errno = ENOMEM;
+        return false;
+    }
+
+    adler = adler32(0L, nullptr, 0);
+    unsigned long to;
+    do{
+        to = fread(block, 1, read_chunk_size, that);
+        adler = adler32(adler, (unsigned char *)block, to);
+    }while(to==read_chunk_size);
+
+    const bool failed = ferror(that);
+    free(block);
+    fclose(that);
+
+    if(failed)
+        errno = EIO;
+    return !failed;
+}
+
+char *loadFileContents(const char *path, unsigned long &length, uLong &adler, unsigned long slack, FileStamp *stamp){
+
+    FILE *that = fopen(path, "rb");
+    if(!that)
+        return nullptr;
+
+    // Size the block from the file's metadata so that we normally read straight into
+    // the final storage. The file might still grow under us, which is handled below.
+    struct stat info;
+    unsigned long capacity = read_chunk_size;
+    if(fstat(fileno(that), &info)==0){
+        if(info.st_size>0)
+            capacity = info.st_size;
+        if(stamp)
+            fillStamp(info, *stamp);
+    }
+
+    if(capacity>max_file_length){
+        fclose(that);
+        errno = EFBIG;
+        return nullptr;
+    }
+
+    char *block = (char *)malloc(capacity+slack);
+    if(!block){
+        fclose(that);
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    adler = adler32(0L, nullptr, 0);
+    length = 0;
+
+    while(true){
+        if(length==capacity){
+            // Usually this means we are done, but the file may have grown under us.
+            const int c = fgetc(that);
+            if(c==EOF)
+                break;
+
+            capacity += read_chunk_size;
+            char *const grown = (capacity>max_file_length) ? nullptr : (char *)realloc(block, capacity+slack);
+            if(!grown){
+                free(block);
+                fclose(that);
+                errno = (capacity>max_file_length) ? EFBIG : ENOMEM;
+                return nullptr;
+            }
+            block = grown;
+
+            block[length] = c;
+            adler = adler32(adler, (unsigned char *)block+length, 1);
+            length++;
+        }
+
+        const unsigned long want = (capacity-length<read_chunk_size) ? (capacity-length) : read_chunk_size;
+        const unsigned long to = fread(block+length, 1, want, that);
+
+        adler = adler32(adler, (unsigned char *)block+length, to);
+        length+=to;
+
+        if(to!=want)
+            break;
+    }
+
+    const bool failed = ferror(that);
+    fclose(that);
+
+    if(failed){
+        free(block);
+        errno = EIO;
+        return nullptr;
+    }
+
+    return block;
+}
+
+const char *mapFileContents(const char *path, unsigned long &length, FileStamp *stamp){
+    const int fd = open(path, O_RDONLY);
+    if(fd<0)
+        return nullptr;
+
+    struct stat info;
+    if(fstat(fd, &info)!=0){
+        const int error = errno;
+        close(fd);
+        errno = error;
+        return nullptr;
+    }
+    if(stamp)
+        fillStamp(info, *stamp);
+
+    length = info.st_size;
+    if(length==0){
+        close(fd);
+        return "";
+    }
+
+    void * const that = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    const int error = errno;
+    close(fd);
+    if(that==MAP_FAILED){
+        errno = error;
+        return nullptr;
+    }
+    return static_cast<const char *>(that);
+}
+
+void unmapFileContents(const char *text, unsigned long length){
+    if(length>0)
+        munmap((void *)text, length);
+}
+
+uLong spansAdler32(const TextSpans &text){
+    const uLong adler = addAdler32(adler32(0L, nullptr, 0), text.first, text.first_length);
+    return addAdler32(adler, text.second, text.second_length);
+}
+
+uLong addAdler32(uLong adler, const char *text, unsigned long length){
+    while(length>0){
+        const unsigned long n = (length>0x40000000) ? 0x40000000 : length;
+        adler = adler32(adler, (const unsigned char *)text, n);
+        text+=n;
+        length-=n;
+    }
+    return adler;
+}
+
+// Feeds some text to deflate, in pieces small enough for zlib's lengths.
+static bool deflateSpan(z_stream &stream, std::vector<unsigned char> &into, const char *text, unsigned long length, int flush){
+    do{
+        const unsigned long n = (length>0x40000000) ? 0x40000000 : length;
+        stream.next_in = (Bytef *)text;
+        stream.avail_in = n;
+        text+=n;
+        length-=n;
+        const int mode = (length>0) ? Z_NO_FLUSH : flush;
+        int result;
+        do{
+            if(stream.avail_out==0){
+                const size_t used = into.size();
+                into.resize(used + 0x10000);
+                stream.next_out = into.data() + used;
+                stream.avail_out = 0x10000;
+            }
+            result = deflate(&stream, mode);
+            if(result==Z_STREAM_ERROR)
+                return false;
+        }while(stream.avail_out==0 || (mode==Z_FINISH && result!=Z_STREAM_END));
+    }while(length>0);
+    return true;
+}
+
+bool compressText(const TextSpans &text, std::vector<unsigned char> &into){
+    z_stream stream;
+    stream.zalloc = Z_NULL;
+    stream.zfree = Z_NULL;
+    stream.opaque = Z_NULL;
+    if(deflateInit(&stream, Z_DEFAULT_COMPRESSION)!=Z_OK)
+        return false;
+
+    // Most text compresses to well under a quarter, so start there and grow if it doesn't.
+    into.clear();
+    const unsigned long guess = (text.first_length + text.second_length)/4 + 0x100;
+    into.resize((guess>0x40000000) ? 0x40000000 : guess);
+    stream.next_out = into.data();
+    stream.avail_out = into.size();
+
+    const bool ok = deflateSpan(stream, into, text.first, text.first_length, Z_NO_FLUSH) &&
+        deflateSpan(stream, into, text.second, text.second_length, Z_FINISH);
+    into.resize(ok ? into.size() - stream.avail_out : 0);
+    into.shrink_to_fit();
+    deflateEnd(&stream);
+    return ok;
+}
+
+char *decompressText(const std::vector<unsigned char> &compressed, unsigned long length, unsigned long slack){
+    char * const block = (char *)malloc(length + slack + 1);
+    if(!block){
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    z_stream stream;
+    stream.zalloc = Z_NULL;
+    stream.zfree = Z_NULL;
+    stream.opaque = Z_NULL;
+    stream.next_in = (Bytef *)compressed.data();
+    stream.avail_in = compressed.size();
+    if(inflateInit(&stream)!=Z_OK){
+        free(block);
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    // One byte more than there should be, so that too much text is noticed.
+    unsigned long left = length + 1;
+    char *to = block;
+    int result = Z_OK;
+    while(result==Z_OK){
+        const unsigned long n = (left>0x40000000) ? 0x40000000 : left;
+        stream.next_out = (Bytef *)to;
+        stream.avail_out = n;
+        result = inflate(&stream, Z_NO_FLUSH);
+        to+=n - stream.avail_out;
+        left-=n - stream.avail_out;
+        if(result==Z_OK && stream.avail_out!=0 && stream.avail_in==0)
+            break;
+    }
+    inflateEnd(&stream);
+
+    if(result!=Z_STREAM_END || left!=1){
+        free(block);
+        errno = (result==Z_MEM_ERROR) ? ENOMEM : EINVAL;
+        return nullptr;
+    }
+    return block;
+}
+
+// Writes both iovecs completely, retrying on short writes.
+static bool writeAll(int fd, struct iovec *iov, int count){
+    while(count>0){
+        const ssize_t to = writev(fd, iov, count);
+        if(to<0){
+            if(errno==EINTR) continue;
+            return false;
+        }
+
+        size_t written = to;
+        while(count>0 && written>=iov->iov_len){
+            written-=iov->iov_len;
+            iov++;
+            count--;
+        }
+        if(count>0){
+            iov->iov_base = (char *)iov->iov_base+written;
+            iov->iov_len-=written;
+        }
+    }
+    return true;
+}
+
+// Writes a new file with `write' next to `path', syncs it, and renames it over the original.
+// `write' returns false and sets errno on failure.
+template<class Writer>
+static bool replaceFile(const char *path, Writer write, FileStamp *stamp){
+
+    // Replace the file a symlink points to, not the symlink itself.
+    std::string target = path;
+    if(char * const real = realpath(path, nullptr)){
+        target = real;
+        free(real);
+    }
+
+    // Keep the permissions of the original, or use the usual ones for a new file.
+    struct stat info;
+    mode_t mode;
+    if(stat(target.c_str(), &info)==0)
+        mode = info.st_mode&07777;
+    else{
+        const mode_t mask = umask(0);
+        umask(mask);
+        mode = 0666&~mask;
+    }
+
+    // The temporary file must be in the same directory for the rename to be atomic.
+    std::string temp_path = target+".XXXXXX";
+    const int fd = mkstemp(&(temp_path[0]));
+    if(fd<0)
+        return false;
+
+    bool ok = fchmod(fd, mode)==0;
+
+    if(ok)
+        ok = write(fd);
+
+    if(ok)
+        ok = fsync(fd)==0;
+
+    // The rename keeps the inode and times, so this is what the file will look like.
+    if(ok)
+        ok = fstat(fd, &info)==0;
+
+    // Keep errno from the first failure, not from the cleanup.
+    const int error = errno;
+    if(close(fd)!=0 && ok)
+        ok = false;
+    else if(!ok)
+        errno = error;
+
+    if(ok)
+        ok = rename(temp_path.c_str(), target.c_str())==0;
+
+    if(!ok){
+        const int cleanup_error = errno;
+        unlink(temp_path.c_str());
+        errno = cleanup_error;
+        return false;
+    }
+
+    // Make the rename itself durable. This is best-effort, the data is already safe.
+    const std::string::size_type slash = target.rfind('/');
+    const std::string directory = (slash==std::string::npos) ? std::string(".") : target.substr(0, slash+1);
+    const int dir_fd = open(directory.c_str(), O_RDONLY);
+    if(dir_fd>=0){
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+
+    if(stamp)
+        fillStamp(info, *stamp);
+    return true;
+}
+
+bool saveFileContents(const char *path, const TextSpans &text, uLong &adler, FileStamp *stamp){
+
+    uLong new_adler = adler32(0L, nullptr, 0);
+
+    // Write the text in big chunks, which may straddle the gap, checksumming each one
+    // just before it is written while it is still in cache.
+    const bool ok = replaceFile(path, [&text, &new_adler](int fd){
+        unsigned long at = 0;
+        const unsigned long length = text.length();
+        while(at<length){
+            const unsigned long end = (length-at>write_chunk_size) ? (at+write_chunk_size) : length;
+
+            struct iovec iov[2];
+            int count = 0;
+            if(at<text.first_length){
+                const unsigned long first_end = (end<text.first_length) ? end : text.first_length;
+                iov[count].iov_base = (void *)(text.first+at);
+                iov[count].iov_len = first_end-at;
+                count++;
+            }
+            if(end>text.first_length){
+                const unsigned long second_at = (at>text.first_length) ? (at-text.first_length) : 0;
+                iov[count].iov_base = (void *)(text.second+second_at);
+                iov[count].iov_len = end-text.first_length-second_at;
+                count++;
+            }
+
+            for(int i = 0; i<count; i++)
+                new_adler = adler32(new_adler, (const unsigned char *)iov[i].iov_base, iov[i].iov_len);
+
+            if(!writeAll(fd, iov, count))
+                return false;
+            at = end;
+        }
+        return true;
+    }, stamp);
+
+    if(ok)
+        adler = new_adler;
+    return ok;
+}
+
+bool savePieces(const char *path, NextPiece next, void *arg, uLong &adler, FileStamp *stamp){
+
+    uLong new_adler = adler32(0L, nullptr, 0);
+
+    // Gather pieces into one writev until there are enough of them, or enough text. Long
+    // pieces are cut up, so each part is still in cache when it is checksummed.
+    const bool ok = replaceFile(path, [next, arg, &new_adler](int fd){
+        static const int max_iov = 64;
+        struct iovec iov[max_iov];
+        int count = 0;
+        unsigned long gathered = 0;
+
+        const auto flush = [&](){
+            for(int i = 0; i<count; i++)
+                new_adler = adler32(new_adler, (const unsigned char *)iov[i].iov_base, iov[i].iov_len);
+            const bool written = writeAll(fd, iov, count);
+            count = 0;
+            gathered = 0;
+            return written;
+        };
+
+        const char *text;
+        unsigned long length;
+        while(next(arg, text, length)){
+            while(length>0){
+                const unsigned long part = (length<write_chunk_size-gathered) ? length : (write_chunk_size-gathered);
+                iov[count].iov_base = (void *)text;
+                iov[count].iov_len = part;
+                count++;
+                gathered+=part;
+                text+=part;
+                length-=part;
+                if((gathered==write_chunk_size || count==max_iov) && !flush())
+                    return false;
+            }
+        }
+        return flush();
+    }, stamp);
+
+    if(ok)
+        adler = new_adler;
+    return ok;
+}
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "text_spans.hpp"
+
+#include <zlib.h>
+
+#include <vector>
+
+namespace Flare {
+
+// Just enough of a file's metadata to tell if it has changed since we last looked at it,
+// without reading its contents.
+struct FileStamp {
+    bool exists;
+    unsigned long long size, inode, device;
+    long long mtime_sec;
+    long mtime_nsec;
+
+    FileStamp()
+      : exists(false), size(0), inode(0), device(0), mtime_sec(0), mtime_nsec(0){}
+
+    bool operator==(const FileStamp &other) const {
+        return exists==other.exists && size==other.size && inode==other.inode &&
+            device==other.device && mtime_sec==other.mtime_sec && mtime_nsec==other.mtime_nsec;
+    }
+    bool operator!=(const FileStamp &other) const { return !(*this==other); }
+};
+
+// Returns false if the file does not exist or can't be examined.
+bool stampFile(const char *path, FileStamp &stamp);
+
+// Adler32 of a file's contents, read in large blocks. Returns false and sets errno on failure.
+bool fileAdler32(const char *path, uLong &adler);
+
+// Reads an entire file into a single malloc'ed block, computing the Adler32 of the
+// contents in the same pass. The block has `slack' extra bytes after the text so that
+// a text buffer can adopt it as-is with a gap at the end.
+// If `stamp' is given, it is filled in with the metadata of the file that was read.
+// Returns nullptr and sets errno on failure. The caller must free() the result.
+char *loadFileContents(const char *path, unsigned long &length, uLong &adler, unsigned long slack = 0, FileStamp *stamp = nullptr);
+
+// Writes the text to a temporary file next to `path', syncs it, and renames it over the
+// original, so the file is either entirely old or entirely new. The Adler32 of the text is
+// computed while writing, and `stamp' is filled in with the metadata of the new file if given.
+// Returns false and sets errno on failure, leaving `path' untouched.
+bool saveFileContents(const char *path, const TextSpans &text, uLong &adler, FileStamp *stamp = nullptr);
+
+// Gets the next piece of some text to save, or returns false when there are none left.
+typedef bool (*NextPiece)(void *arg, const char *&text, unsigned long &length);
+
+// The same as saveFileContents, for text that is in any number of pieces.
+bool savePieces(const char *path, NextPiece next, void *arg, uLong &adler, FileStamp *stamp = nullptr);
+
+// Maps a whole file read-only, so its text is only read in as it is looked at. Returns
+// nullptr and sets errno on failure. An empty file is mapped as an empty string, which
+// doesn't need unmapping. Pass the result to unmapFileContents when done with it.
+const char *mapFileContents(const char *path, unsigned long &length, FileStamp *stamp = nullptr);
+void unmapFileContents(const char *text, unsigned long length);
+
+// Adler32 of the text, without copying it anywhere.
+uLong spansAdler32(const TextSpans &text);
+// Continues an Adler32 with more text. Unlike adler32, the length can be more than an int.
+uLong addAdler32(uLong adler, const char *text, unsigned long length);
+
+// Compresses the text with zlib into `into', replacing what was there. Returns false if zlib
+// fails, which it only does for want of memory.
+bool compressText(const TextSpans &text, std::vector<unsigned char> &into);
+// Undoes compressText, into a malloc'ed block of the `length' bytes that were compressed
+// followed by `slack' more, like loadFileContents. Returns nullptr and sets errno on failure.
+char *decompressText(const std::vector<unsigned char> &compressed, unsigned long length, unsigned long slack = 0);
+
+}
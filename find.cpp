@@ -2,6 +2,12 @@
 
 #include "editor_window.hpp"
 
+#include <FL/Fl.H>
+#include <FL/Fl_Native_File_Chooser.H>
+#include <FL/fl_ask.H>
+
+#include <cstdio>
+
 namespace Flare {
 /*
     EditorWindow &window
@@ -12,27 +18,121 @@ namespace Flare {
 void Find::FindText() const{
     const char * const text = find_input.value();
     if(text[0]==0) return;
-    window.find(text);
+    if(regex_button.value())
+        window.findRegex(text);
+    else
+        window.find(text);
+}
+
+void Find::FindAllText(){
+    window.findAll(find_input.value());
+    UpdateCount();
+}
+
+void Find::FindTabsText() const{
+    const char * const text = find_input.value();
+    if(text[0]==0) return;
+    window.findInTabs(text, regex_button.value()!=0);
+}
+
+void Find::FindFilesText(){
+    const char * const text = find_input.value();
+    if(text[0]==0) return;
+
+    Fl_Native_File_Chooser chooser;
+    chooser.title("Find in Files");
+    chooser.type(Fl_Native_File_Chooser::BROWSE_DIRECTORY);
+    if(!directory.empty())
+        chooser.directory(directory.c_str());
+
+    const int err = chooser.show();
+    if(err==1) return;
+    else if(err==-1){
+        fl_alert("Error choosing a directory\n%s", chooser.errmsg());
+        return;
+    }
+
+    directory = chooser.filename();
+    window.findInFiles(directory, text, regex_button.value()!=0);
+}
+
+void Find::UpdateCount(){
+    bool complete;
+    const unsigned long count = window.matchCount(complete);
+    if(count==0 && complete)
+        match_count_label[0] = 0;
+    else
+        snprintf(match_count_label, sizeof(match_count_label), "%lu matches%s", count, complete ? "" : "...");
+    match_count.label(match_count_label);
+    match_count.redraw();
+
+    if(!complete && shown() && !Fl::has_timeout(CountCallback, this))
+        Fl::add_timeout(0.25, CountCallback, this);
+}
+
+void Find::CountCallback(void *a){
+    static_cast<Find *>(a)->UpdateCount();
+}
+
+void Find::RegexCallback(Fl_Widget *w, void *a){
+    Find * const that = static_cast<Find *>(a);
+    if(that->regex_button.value())
+        that->find_all_button.deactivate();
+    else
+        that->find_all_button.activate();
 }
 
 void Find::ReplaceText() const{
     const char * const text = find_input.value(),
         * const replace_text = replace_input.value();
-    if(text[0]==0 || replace_text[0]==0) return;
-    
+    if(text[0]==0) return;
+    if(regex_button.value())
+        window.replaceRegex(text, replace_text);
+    else
+        window.replace(text, replace_text);
+}
+
+void Find::ReplaceAllText(){
+    const char * const text = find_input.value(),
+        * const replace_text = replace_input.value();
+    if(text[0]==0) return;
+
+    const unsigned long count = regex_button.value() ?
+        window.replaceAllRegex(text, replace_text) : window.replaceAll(text, replace_text);
+    snprintf(match_count_label, sizeof(match_count_label), "Replaced %lu matches", count);
+    match_count.label(match_count_label);
+    match_count.redraw();
 }
 
 Find::Find(EditorWindow &w)
-  : Fl_Window(400, 100, "Find")
+  : Fl_Window(400, 132, "Find")
   , window(w)
   , find_input(8, 8, 240, 24)
   , replace_input(8, 40, 240, 24)
-  , find_button(256, 8, 80, 24, "Find")
-  , replace_button(256, 40, 80, 24, "Replace"){
+  , find_button(256, 8, 64, 24, "Find")
+  , find_all_button(328, 8, 64, 24, "Find All")
+  , replace_button(256, 40, 64, 24, "Replace")
+  , replace_all_button(328, 40, 64, 24, "Replace All")
+  , find_tabs_button(256, 72, 136, 24, "Find in All Tabs")
+  , find_files_button(256, 104, 136, 24, "Find in Files...")
+  , regex_button(8, 72, 72, 24, "Regex")
+  , match_count(88, 72, 160, 24){
+  
+  match_count_label[0] = 0;
+  match_count.align(FL_ALIGN_LEFT|FL_ALIGN_INSIDE);
   
   find_button.callback(FindCallback, this);
+  find_all_button.callback(FindAllCallback, this);
+  regex_button.callback(RegexCallback, this);
   replace_button.callback(ReplaceCallback, this);
+  replace_all_button.callback(ReplaceAllCallback, this);
+  find_tabs_button.callback(FindTabsCallback, this);
+  find_files_button.callback(FindFilesCallback, this);
     
 }
 
+Find::~Find(){
+    Fl::remove_timeout(CountCallback, this);
+}
+
 }
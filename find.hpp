@@ -4,6 +4,10 @@
 #include <FL/Fl_Button.H>
 #include <FL/Fl_Return_Button.H>
 #include <FL/Fl_Input.H>
+#include <FL/Fl_Check_Button.H>
+#include <FL/Fl_Box.H>
+
+#include <string>
 
 namespace Flare {
 
@@ -13,22 +17,54 @@ class Find : public Fl_Window {
     EditorWindow &window;
     Fl_Input find_input, replace_input;
     Fl_Return_Button find_button;
-    Fl_Button replace_button;
+    Fl_Button find_all_button, replace_button, replace_all_button, find_tabs_button, find_files_button;
+    Fl_Check_Button regex_button;
+    Fl_Box match_count;
+    char match_count_label[0x40];
+    // Where Find in Files last looked.
+    std::string directory;
     
     static void FindCallback(Fl_Widget *w, void *a){
         static_cast<Find *>(a)->FindText();
     }
     
+    static void FindAllCallback(Fl_Widget *w, void *a){
+        static_cast<Find *>(a)->FindAllText();
+    }
+    
+    static void FindTabsCallback(Fl_Widget *w, void *a){
+        static_cast<Find *>(a)->FindTabsText();
+    }
+    
+    static void FindFilesCallback(Fl_Widget *w, void *a){
+        static_cast<Find *>(a)->FindFilesText();
+    }
+    
+    // Keeps the match count up to date while Find All is still searching.
+    static void CountCallback(void *a);
+    
+    // Find All only works with plain text.
+    static void RegexCallback(Fl_Widget *w, void *a);
+    
     static void ReplaceCallback(Fl_Widget *w, void *a){
         static_cast<Find *>(a)->ReplaceText();
     }
     
+    static void ReplaceAllCallback(Fl_Widget *w, void *a){
+        static_cast<Find *>(a)->ReplaceAllText();
+    }
+    
     void FindText() const;
+    void FindAllText();
+    void FindTabsText() const;
+    void FindFilesText();
+    void UpdateCount();
     void ReplaceText() const;
+    void ReplaceAllText();
     
 public:
     Find(EditorWindow &w);
-    virtual ~Find(){}
+    virtual ~Find();
 };
 
 
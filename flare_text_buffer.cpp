@@ -0,0 +1,114 @@
+#include "flare_text_buffer.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace Flare {
+
+void Text_Buffer::adopt(char *block, int length, int gap){
+
+    call_predelete_callbacks(0, mLength);
+
+    // The modify callbacks expect the deleted text as a nul-terminated string. Closing
+    // the gap at the end of the old block gives us that without copying the text out.
+    if(mGapEnd-mGapStart<1)
+        reallocate_with_gap(mLength, 1);
+    else
+        move_gap(mLength);
+    mBuf[mLength] = 0;
+
+    char * const old_block = mBuf;
+    const int old_length = mLength;
+
+    mBuf = block;
+    mLength = length;
+    mGapStart = length;
+    mGapEnd = length+gap;
+    mCursorPosHint = 0;
+
+    update_selections(0, old_length, length);
+    call_modify_callbacks(0, old_length, length, 0, old_block);
+
+    free(old_block);
+}
+
+void Text_Buffer::applyEdits(const std::vector<Edit> &edits){
+    if(edits.empty())
+        return;
+
+    const int start = edits.front().pos, end = edits.back().pos+edits.back().length;
+
+    long change = 0;
+    for(std::vector<Edit>::const_iterator i = edits.begin(); i!=edits.end(); i++)
+        change += (long)i->text_length-(long)i->length;
+
+    const int new_length = mLength+change, inserted = end-start+change;
+
+    call_predelete_callbacks(start, end-start);
+
+    // Put the gap after the replaced text. Everything before it is then contiguous, and the
+    // replaced text can be given to the modify callbacks as a string without copying it.
+    if(mGapEnd-mGapStart<1)
+        reallocate_with_gap(end, 1);
+    else
+        move_gap(end);
+    mBuf[end] = 0;
+
+    char * const block = (char *)malloc(new_length+mPreferredGapSize);
+    memcpy(block, mBuf, start);
+
+    char *out = block+start;
+    unsigned long at = start;
+    for(std::vector<Edit>::const_iterator i = edits.begin(); i!=edits.end(); i++){
+        memcpy(out, mBuf+at, i->pos-at);
+        out+=i->pos-at;
+        memcpy(out, i->text, i->text_length);
+        out+=i->text_length;
+        at = i->pos+i->length;
+    }
+    memcpy(out, mBuf+mGapEnd, mLength-end);
+
+    char * const old_block = mBuf;
+
+    mBuf = block;
+    mLength = new_length;
+    mGapStart = new_length;
+    mGapEnd = new_length+mPreferredGapSize;
+    mCursorPosHint = start+inserted;
+
+    update_selections(start, end-start, inserted);
+    call_modify_callbacks(start, end-start, inserted, 0, old_block+start);
+
+    free(old_block);
+}
+
+void Text_Buffer::fill(char c, int length){
+    char * const block = (char *)malloc(length+mPreferredGapSize);
+    memset(block, c, length);
+    adopt(block, length, mPreferredGapSize);
+}
+
+void Text_Buffer::overwrite(int start, int end, char c){
+    if(start<mGapStart){
+        const int before_end = (end<mGapStart) ? end : mGapStart;
+        memset(mBuf+start, c, before_end-start);
+    }
+    if(end>mGapStart){
+        const int after_start = (start>mGapStart) ? start : mGapStart;
+        memset(mBuf+mGapEnd+(after_start-mGapStart), c, end-after_start);
+    }
+}
+
+void Text_Buffer::overwrite(int start, const char *text, int length){
+    const int end = start+length;
+    if(start<mGapStart){
+        const int before_end = (end<mGapStart) ? end : mGapStart;
+        memcpy(mBuf+start, text, before_end-start);
+    }
+    if(end>mGapStart){
+        const int after_start = (start>mGapStart) ? start : mGapStart;
+        memcpy(mBuf+mGapEnd+(after_start-mGapStart), text+(after_start-start), end-after_start);
+    }
+}
+
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "text_spans.hpp"
+
+#include <FL/Fl_Text_Buffer.H>
+
+#include <vector>
+
+namespace Flare {
+
+// Fl_Text_Buffer with access to the gap buffer for bulk operations.
+class Text_Buffer : public Fl_Text_Buffer {
+public:
+
+    // Replaces `length' bytes at `pos' with `text_length' bytes of `text'.
+    struct Edit {
+        unsigned long pos, length;
+        const char *text;
+        unsigned long text_length;
+    };
+
+    Text_Buffer(int requestedSize = 0, int preferredGapSize = 1024)
+      : Fl_Text_Buffer(requestedSize, preferredGapSize){}
+
+    // Replaces the whole contents of the buffer with a malloc'ed block holding `length'
+    // bytes of text followed by `gap' bytes of slack. The buffer takes ownership of the
+    // block, so the text is never copied, and the modify callbacks are only called once.
+    void adopt(char *block, int length, int gap);
+
+    // Applies edits that are sorted by position and do not overlap, building the new text
+    // in one pass. The modify callbacks are called once, as if the text from the start of
+    // the first edit to the end of the last one had been replaced.
+    void applyEdits(const std::vector<Edit> &edits);
+
+    // Replaces the contents with `length' copies of `c'.
+    void fill(char c, int length);
+
+    // Sets every byte in [start, end) to `c', without calling any callbacks. This is meant
+    // for style buffers, where the caller redisplays the range itself.
+    void overwrite(int start, int end, char c);
+    // The same, but copying `length' bytes of `text' over the buffer from `start'.
+    void overwrite(int start, const char *text, int length);
+
+    // The text before and after the gap. Only valid until the buffer is next modified.
+    TextSpans spans() const {
+        const TextSpans that = {mBuf, (unsigned long)mGapStart, mBuf+mGapEnd, (unsigned long)(mLength-mGapStart)};
+        return that;
+    }
+
+};
+
+}
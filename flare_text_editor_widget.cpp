@@ -1,110 +1,10 @@
 #include "flare_text_editor_widget.hpp"
 
-#include <FL/fl_ask.H>
 #include <FL/Fl.H>
 
 namespace Flare {
 
-    void Text_Editor_Widget::BufferCallback(int pos, int add, int del, int styled, const char* deleted_text){
-            
-        // I do not know if we can really trust this 
-        // to be true, but we rely on it for now.
-#ifndef NDEBUG
-        if((del>0) && (add>0)) fl_alert("Whoops!\nWe both added and deleted? What?");
-        if((pos<0)) fl_alert("Whoops!\nPosition is negative?");
-        if((add<0)) fl_alert("Whoops!\nNumber of added chars is negative?");
-        if((del<0)) fl_alert("Whoops!\nNumber of deleted chars is negative?");
-#endif
-        if(add==0 && del==0){
-           // style_buffer->unselect();
-            return;
-        }
-        
-        if(canary>0u){ return; }
-        canary++;
-                    
-        if((!future.empty()) || history.empty()){
-            future.clear();
-          
-            struct diff that = {
-                ((add>0)  ?
-                    (buffer()->text_range(pos, pos+add)) :
-                    (strdup(deleted_text))),
-                pos,
-                add,
-                del
-            };
-            
-            history.push_back(that);
-        }
-        else{
-            struct diff & top = history.back();
-            if(add>0 && top.add>0 && top.pos+top.add==pos){
-                
-                char *t = buffer()->text_range(pos, pos+add);
-                top.text = (char *)realloc(top.text,top.add+add+1);
-                memcpy(top.text+top.add, t, add+1);
-                top.add+=add;
-                free(t);
-            }
-            else if(del>0 && top.del>0 && top.pos==pos-del){
-                top.text = (char *)realloc(top.text, top.del+del+1);
-                memcpy(top.text+top.del, deleted_text, del+1);
-                top.del+=del;
-            }
-            else{
-                struct diff that = {
-                    ((add>0)  ?
-                        (buffer()->text_range(pos, pos+add)) :
-                        (strdup(deleted_text))),
-                    pos,
-                    add,
-                    del
-                };       
-                history.push_back(that);
-            }
-        }
-        canary--;
-    }
-
-    void Text_Editor_Widget::undo(){
-        if(canary>0u) return;
-        if(history.empty()) return;
-        canary++;
-        
-        struct diff op = history.pop();
-        if(op.del>0){
-            buffer()->insert(op.pos, op.text);
-        }
-        else{
-            buffer()->remove(op.pos, op.pos+op.add);
-        }
-
-        future.push_back(op);
-        
-        canary--;
-    }
-
-    void Text_Editor_Widget::redo(){
-        if(canary>0u) return;   
-        if(future.empty()) return;     
-        canary++;
-
-        struct diff op = future.pop();
-        if(op.add>0){
-            buffer()->insert(op.pos, op.text);
-        }
-        else{
-            buffer()->remove(op.pos, op.pos+op.del);
-        }
-        
-        history.push_back(op);
-        
-        canary--;
-    }
-
-    void Text_Editor_Widget::removeTabChars(int index){
-        const int start_of_line = line_start(index);
+    int Text_Editor_Widget::tabCharsAt(int start_of_line) const {
         // If the start of the line is the same as the tab character, remove it.
         bool starts_with_tab = true;
         for(size_t i = 0; i < tab.length(); i++){
@@ -114,7 +14,7 @@ namespace Flare {
             }
         }
         if(starts_with_tab){
-            mBuffer->remove(start_of_line, start_of_line + tab.length());
+            return tab.length();
         }
         // Otherwise, if the tab char is an actual tab, as many spaces as possible
         // up to 4 from the start of the line.
@@ -127,18 +27,21 @@ namespace Flare {
                 else
                     break;
             }
-            if(num_spaces)
-                mBuffer->remove(start_of_line, start_of_line + num_spaces);
+            return num_spaces;
         }
         // Finally, if none of that worked, if the line starts with a space or a tab, remove it.
         else{
             const char c = mBuffer->char_at(start_of_line);
-            if(c == ' ' || c == '\t'){
-                mBuffer->remove(start_of_line, 1);
-            }
+            return (c == ' ' || c == '\t') ? 1 : 0;
         }
     }
 
+    void Text_Editor_Widget::removeTabChars(int index){
+        const int start_of_line = line_start(index), n = tabCharsAt(start_of_line);
+        if(n)
+            mBuffer->remove(start_of_line, start_of_line + n);
+    }
+
     int Text_Editor_Widget::handle(int e){
         if(!has_set_font){
             textfont(FL_COURIER);
@@ -168,22 +71,36 @@ namespace Flare {
                     }
                 }
                 else{
-                    int line_start_pos = line_start(selection->start());
-                    
-                    while(line_start_pos<selection->end()){
-
-                        if(shift_is_pressed)
-                            removeTabChars(line_start_pos);
-                        else
-                            mBuffer->insert(line_start_pos, tab.c_str());
+                    // Every line is changed in one transaction, so even a huge selection is
+                    // a single pass over the buffer and a single step to undo.
+                    // The document knows where its lines are without searching for them.
+                    const int start = doc ? doc->lineStart(doc->lineAt(selection->start())) :
+                        mBuffer->line_start(selection->start()), end = selection->end();
+                    Document::Transaction edits = doc ? Document::Transaction(*doc) :
+                        Document::Transaction(*static_cast<Text_Buffer *>(mBuffer));
+                    int line_start_pos = start;
+                    while(line_start_pos<end){
+                        const int line_end_pos = doc ? doc->lineEnd(doc->lineAt(line_start_pos)) :
+                            mBuffer->line_end(line_start_pos);
 
-                        line_start_pos = line_end(line_start_pos, true);
-                        
-                        while((mBuffer->char_at(line_start_pos)=='\n') || (mBuffer->char_at(line_start_pos+1)=='\n')){
-                            line_start_pos++;
+                        // Empty lines are left alone.
+                        if(line_end_pos>line_start_pos){
+                            if(!shift_is_pressed)
+                                edits.insert(line_start_pos, tab.c_str(), tab.length());
+                            else if(const int n = tabCharsAt(line_start_pos))
+                                edits.remove(line_start_pos, n);
                         }
-                        
+
+                        if(line_end_pos>=mBuffer->length())
+                            break;
+                        line_start_pos = line_end_pos+1;
                     }
+
+                    const long change = edits.change();
+                    edits.commit();
+                    // Keep the same lines selected, so they can be indented again.
+                    mBuffer->select(start, end+change);
+                    insert_position(end+change);
                 }
                 return 1;
             }
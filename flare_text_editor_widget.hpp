@@ -2,38 +2,33 @@
 
 #include <FL/Fl_Text_Editor.H>
 #include <cstring>
-#include "history_tracker.hpp"
+#include <string>
+#include "document.hpp"
 
 namespace Flare {
 
+// A view of a Document. Undo, redo and the indenting of whole blocks go through the
+// document, so that they are recorded as single steps.
+//
+// It can also show a bare Text_Buffer, for editors that keep their history some other way.
+// They override undo and redo.
 class Text_Editor_Widget : public Fl_Text_Editor {
 
-    struct diff {
-        char *text;
-        int pos, add, del;
-    };
-
-    static void delete_diff(struct diff d){
-        free((void *)d.text);
-    }
-
-    static size_t size_diff(size_t a, struct diff d){
-        return a+strlen(d.text)+sizeof(struct diff);
-    }
-
-    unsigned canary;
+    Document *doc;
     bool has_set_font;
 
     std::string tab;
-    Pluto::HistoryTracker<struct diff, delete_diff, size_diff, 0x3FFFF> history, future;
-
-    void BufferCallback(int, int, int, int, const char*);
 
     static int undo_key_binding(int k, Fl_Text_Editor *editor){ static_cast<Text_Editor_Widget *>(editor)->undo(); return 1; }
     static int redo_key_binding(int k, Fl_Text_Editor *editor){ static_cast<Text_Editor_Widget *>(editor)->redo(); return 1; }
+    static int earlier_key_binding(int k, Fl_Text_Editor *editor){ static_cast<Text_Editor_Widget *>(editor)->earlier(); return 1; }
+    static int later_key_binding(int k, Fl_Text_Editor *editor){ static_cast<Text_Editor_Widget *>(editor)->later(); return 1; }
 
     void removeText(long at, const char *text, unsigned long len = 0);
 
+    // How many characters of indentation Shift+Tab would remove from the line that starts
+    // at `start_of_line'.
+    int tabCharsAt(int start_of_line) const;
     void removeTabChars(int index);
 
 public:
@@ -45,22 +40,32 @@ public:
         if(W>128)
             Fl_Text_Display::linenumber_width(40);
 #endif
-        canary = 0u;
+        doc = nullptr;
         has_set_font = false;
 
         remove_key_binding('z', FL_COMMAND);
         remove_key_binding('y', FL_COMMAND);
         add_key_binding('z', FL_COMMAND, undo_key_binding);
         add_key_binding('y', FL_COMMAND, redo_key_binding);
+        add_key_binding('z', FL_COMMAND|FL_ALT, earlier_key_binding);
+        add_key_binding('y', FL_COMMAND|FL_ALT, later_key_binding);
     }
  
-    void clearHistory(){
-        history.clear();
+    // Shows the document's text. The document has to outlive the widget.
+    void document(Document &d){
+        doc = &d;
+        buffer(&d.buffer());
     }
- 
-   static void text_buffer_change_cb(int a, int b, int c, int d, const char* e, void*that){
-        static_cast<Text_Editor_Widget *>(that)->BufferCallback(a, b, c, d, e);
+    Document *document() const { return doc; }
+
+    // The text that is on screen.
+    void visibleRange(unsigned long &from, unsigned long &to) const {
+        from = mFirstChar;
+        to = mLastChar;
     }
+    // Where the view is scrolled to, as scroll() takes it.
+    int topLine() const { return mTopLineNum; }
+    int horizontalOffset() const { return mHorizOffset; }
 
     int handle(int e) override;
 
@@ -70,8 +75,10 @@ public:
 
     const std::string &tabString() const { return tab; }
 
-    void undo();
-    void redo();
+    virtual void undo(){ if(doc) doc->undo(); }
+    virtual void redo(){ if(doc) doc->redo(); }
+    virtual void earlier(){ if(doc) doc->earlier(); }
+    virtual void later(){ if(doc) doc->later(); }
     
     void duplicate();
 
@@ -0,0 +1,441 @@
+#include "highlighter.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+namespace Flare {
+
+// What a byte can be, or start.
+#define CLASS_SPACE 0x01
+#define CLASS_WORD 0x02
+#define CLASS_DIGIT 0x04
+#define CLASS_QUOTE 0x08
+#define CLASS_COMMENT 0x10
+
+// What the lexer carries from one line to the next. A string is STATE_STRING plus which
+// of the syntax's quotes it started with.
+#define STATE_NORMAL 0
+#define STATE_COMMENT 1
+#define STATE_PREPROCESSOR 2
+#define STATE_STRING 3
+// Never the state of a line that has been lexed, so lexing carries on past it.
+#define STATE_UNKNOWN 0xFF
+
+// Keywords longer than this aren't looked up.
+#define MAX_KEYWORD 0x20
+
+// How much a job lexes before handing a chunk back.
+#define JOB_CHUNK 0x400000
+
+// The length of `s' if the text at `pos' starts with it before `end', otherwise 0.
+static unsigned long startsWith(const TextSpans &text, unsigned long pos, unsigned long end, const char *s){
+    if(!s)
+        return 0;
+    unsigned long n = 0;
+    while(s[n]){
+        if(pos+n>=end || text.at(pos+n)!=s[n])
+            return 0;
+        n++;
+    }
+    return n;
+}
+
+// Where the line that `pos' is in ends, not counting its newline.
+static unsigned long lineEnd(const TextSpans &text, unsigned long pos){
+    if(pos<text.first_length){
+        const char * const newline = (const char *)memchr(text.first+pos, '\n', text.first_length-pos);
+        if(newline)
+            return newline-text.first;
+        pos = text.first_length;
+    }
+    const unsigned long at = pos-text.first_length;
+    const char * const newline = (const char *)memchr(text.second+at, '\n', text.second_length-at);
+    return newline ? (text.first_length+(newline-text.second)) : text.length();
+}
+
+Lexer::Lexer(const Syntax *s)
+  : language(s)
+  , keyword_count(0){
+    memset(classes, 0, sizeof(classes));
+    if(!s)
+        return;
+
+    while(s->keywords[keyword_count])
+        keyword_count++;
+
+    classes[(unsigned char)' '] = classes[(unsigned char)'\t'] = classes[(unsigned char)'\r'] = CLASS_SPACE;
+    for(unsigned c = 'a'; c<='z'; c++)
+        classes[c] = classes[c-'a'+'A'] = CLASS_WORD;
+    classes[(unsigned char)'_'] = CLASS_WORD;
+    // UTF-8 text in identifiers.
+    for(unsigned c = 0x80; c<0x100; c++)
+        classes[c] = CLASS_WORD;
+    for(unsigned c = '0'; c<='9'; c++)
+        classes[c] = CLASS_WORD|CLASS_DIGIT;
+
+    for(const char *q = s->quotes; q && *q; q++)
+        classes[(unsigned char)*q]|=CLASS_QUOTE;
+    if(s->line_comment)
+        classes[(unsigned char)s->line_comment[0]]|=CLASS_COMMENT;
+    if(s->block_comment_start)
+        classes[(unsigned char)s->block_comment_start[0]]|=CLASS_COMMENT;
+}
+
+bool Lexer::isKeyword(const TextSpans &text, unsigned long pos, unsigned long length) const {
+    if(length>=MAX_KEYWORD)
+        return false;
+    char word[MAX_KEYWORD];
+    for(unsigned long i = 0; i<length; i++)
+        word[i] = text.at(pos+i);
+    word[length] = 0;
+
+    // A binary search of the sorted keywords.
+    const char *const *keywords = language->keywords;
+    unsigned long low = 0, high = keyword_count;
+    while(low<high){
+        const unsigned long middle = (low+high)/2;
+        const int order = strcmp(keywords[middle], word);
+        if(order==0)
+            return true;
+        if(order<0)
+            low = middle+1;
+        else
+            high = middle;
+    }
+    return false;
+}
+
+unsigned char Lexer::lexLine(const TextSpans &text, unsigned long pos, unsigned long end, unsigned char state, std::string &into) const {
+    const Syntax &s = *language;
+    const unsigned long start = pos;
+    // Whether there has only been space on the line so far, for preprocessor lines.
+    bool leading = true;
+    // Set if the line ends with an escape that continues a string onto the next one.
+    bool continued = false;
+
+    while(pos<end){
+        if(state==STATE_COMMENT){
+            const unsigned long n = startsWith(text, pos, end, s.block_comment_end);
+            if(n>0){
+                into.append(n, STYLE_COMMENT);
+                pos+=n;
+                state = STATE_NORMAL;
+            }
+            else{
+                into.push_back(STYLE_COMMENT);
+                pos++;
+            }
+            continue;
+        }
+
+        if(state>=STATE_STRING){
+            const char c = text.at(pos);
+            if(s.escape && c==s.escape){
+                continued = pos+1==end;
+                into.append(continued ? 1 : 2, STYLE_STRING);
+                pos+=continued ? 1 : 2;
+                continue;
+            }
+            into.push_back(STYLE_STRING);
+            pos++;
+            if(c==s.quotes[state-STATE_STRING])
+                state = STATE_NORMAL;
+            continue;
+        }
+
+        const unsigned char c = text.at(pos);
+        const unsigned char kind = classes[c];
+
+        if(kind&CLASS_COMMENT){
+            if(startsWith(text, pos, end, s.line_comment)){
+                into.append(end-pos, STYLE_COMMENT);
+                pos = end;
+                continue;
+            }
+            const unsigned long n = startsWith(text, pos, end, s.block_comment_start);
+            if(n>0){
+                into.append(n, STYLE_COMMENT);
+                pos+=n;
+                state = STATE_COMMENT;
+                continue;
+            }
+        }
+
+        if(state==STATE_PREPROCESSOR){
+            into.push_back(STYLE_PREPROCESSOR);
+            pos++;
+            continue;
+        }
+
+        if(kind&CLASS_SPACE){
+            into.push_back(STYLE_PLAIN);
+            pos++;
+            continue;
+        }
+
+        if(leading && s.preprocessor && c==(unsigned char)s.preprocessor){
+            state = STATE_PREPROCESSOR;
+            continue;
+        }
+        leading = false;
+
+        if(kind&CLASS_QUOTE){
+            state = STATE_STRING+(strchr(s.quotes, c)-s.quotes);
+            into.push_back(STYLE_STRING);
+            pos++;
+        }
+        else if(kind&CLASS_WORD){
+            // Numbers can have letters and points in them too, such as 0x1F and 1.5f.
+            const unsigned long word = pos;
+            while(pos<end && ((classes[(unsigned char)text.at(pos)]&CLASS_WORD) || ((kind&CLASS_DIGIT) && text.at(pos)=='.')))
+                pos++;
+
+            const char style = (kind&CLASS_DIGIT) ? STYLE_NUMBER :
+                (isKeyword(text, word, pos-word) ? STYLE_KEYWORD : STYLE_PLAIN);
+            into.append(pos-word, style);
+        }
+        else{
+            into.push_back(STYLE_PLAIN);
+            pos++;
+        }
+    }
+
+    if(state==STATE_COMMENT)
+        return STATE_COMMENT;
+    if(state>=STATE_STRING)
+        return continued ? state : STATE_NORMAL;
+    if(state==STATE_PREPROCESSOR && s.escape && end>start && text.at(end-1)==s.escape)
+        return STATE_PREPROCESSOR;
+    return STATE_NORMAL;
+}
+
+Highlighter::Highlighter()
+  : pending(0)
+  , budget(0)
+  , lexed(0){}
+
+void Highlighter::syntax(const Syntax *s){
+    lexer = Lexer(s);
+    std::vector<unsigned char>().swap(states);
+    pending = 0;
+}
+
+unsigned long Highlighter::run(const TextSpans &text, Text_Buffer &style, unsigned long line, unsigned long pos, unsigned long until){
+    const unsigned long length = text.length();
+    std::string styles;
+    unsigned char state = states[line];
+
+    lexed = 0;
+    while(true){
+        const unsigned long end = lineEnd(text, pos);
+        styles.clear();
+        state = lexer.lexLine(text, pos, end, state, styles);
+        if(end<length)
+            styles.push_back(STYLE_PLAIN);
+        style.overwrite(pos, styles.data(), styles.size());
+        lexed++;
+
+        if(end>=length){
+            pending = states.size();
+            return length;
+        }
+        pos = end+1;
+        line++;
+
+        const bool same = states[line]==state;
+        states[line] = state;
+        // The lines after this one are left for a job anyway.
+        if(line-1==pending)
+            pending = line;
+        if(line>=pending)
+            return pos;
+        // Everything from here on is styled as it was.
+        if(pos>=until && same)
+            return pos;
+        if(budget>0 && lexed>=budget){
+            pending = line;
+            return pos;
+        }
+    }
+}
+
+void Highlighter::highlight(const TextSpans &text, const LineIndex &lines, Text_Buffer &style){
+    if(!active())
+        return;
+    states.assign(lines.count(), STATE_UNKNOWN);
+    states[0] = STATE_NORMAL;
+    pending = states.size();
+    run(text, style, 0, 0, text.length());
+}
+
+void Highlighter::update(const TextSpans &text, const LineIndex &lines, Text_Buffer &style, unsigned long pos, unsigned long inserted, unsigned long &from, unsigned long &to){
+    if(!active() || states.empty())
+        return;
+
+    // The lines the edit replaced are those it added, less the lines there are now.
+    const unsigned long line = lines.lineAt(pos), added = lines.lineAt(pos+inserted)-line;
+    const unsigned long removed = states.size()+added-lines.count();
+
+    // The lines after the edit start in the same state as before, until lexing shows
+    // otherwise. The lines the edit added aren't known yet.
+    states.erase(states.begin()+line+1, states.begin()+line+1+removed);
+    states.insert(states.begin()+line+1, added, STATE_UNKNOWN);
+
+    if(pending>line+removed)
+        pending = pending+added-removed;
+    else if(pending>line)
+        pending = line+1;
+    // The line's state isn't known yet, so it is left for the job. Its styles are out of
+    // date, so it is marked, so that the job doesn't stop before it.
+    else if(pending<line){
+        states[line] = STATE_UNKNOWN;
+        return;
+    }
+
+    from = lines.start(line);
+    to = run(text, style, line, from, pos+inserted);
+}
+
+void Highlighter::restyle(const TextSpans &text, const LineIndex &lines, Text_Buffer &style, unsigned long &from, unsigned long &to){
+    if(!active() || states.empty())
+        return;
+
+    const unsigned long line = lines.lineAt(from);
+    from = lines.start(line);
+    // These lines are styled again once the job reaches them, and marked the same way as
+    // edits are.
+    if(line>pending){
+        style.overwrite(from, to, STYLE_PLAIN);
+        const unsigned long last = lines.lineAt(to);
+        std::fill(states.begin()+line, states.begin()+last+1, STATE_UNKNOWN);
+        return;
+    }
+    to = run(text, style, line, from, to);
+}
+
+std::shared_ptr<Highlighter::Job> Highlighter::job(const TextSpans &text, const LineIndex &lines, unsigned long version, unsigned long view_from, unsigned long view_to) const {
+    if(!active() || finished())
+        return nullptr;
+
+    const std::shared_ptr<Job> that = std::make_shared<Job>(lexer, version);
+    that->line = pending;
+    that->pos = lines.start(pending);
+    that->known.assign(states.begin()+pending, states.end());
+    that->settled = that->known.size();
+    while(that->settled>0 && that->known[that->settled-1]!=STATE_UNKNOWN)
+        that->settled--;
+
+    const unsigned long length = text.length();
+    that->text.reserve(length-that->pos);
+    if(that->pos<text.first_length)
+        that->text.append(text.first+that->pos, text.first_length-that->pos);
+    const unsigned long second = (that->pos>text.first_length) ? (that->pos-text.first_length) : 0;
+    that->text.append(text.second+second, text.second_length-second);
+
+    that->view_end = (view_to>that->pos) ? (view_to-that->pos) : 0;
+
+    // Lines on screen that haven't been lexed since they were loaded or added are guessed
+    // at, unless the first chunk will reach them anyway.
+    const unsigned long view_line = lines.lineAt(view_from), view_start = lines.start(view_line);
+    if(view_line>pending && states[view_line]==STATE_UNKNOWN && view_start-that->pos>=JOB_CHUNK && view_to>view_start){
+        that->guess_line = view_line;
+        that->guess_pos = view_start-that->pos;
+        that->guess_end = ((view_to<length) ? view_to : length)-that->pos;
+    }
+
+    return that;
+}
+
+void Highlighter::Job::run(const std::function<void(Chunk *)> &deliver){
+    const TextSpans spans = {text.data(), text.size(), text.data()+text.size(), 0};
+    const unsigned long length = spans.length();
+
+    if(guess_end>guess_pos){
+        Chunk * const chunk = new Chunk();
+        chunk->version = version;
+        chunk->line = guess_line;
+        chunk->pos = pos+guess_pos;
+        chunk->guess = true;
+        chunk->last = false;
+
+        // Only lines whose state isn't known are guessed at, so that the styles of the
+        // others stay as their states say.
+        unsigned char state = STATE_NORMAL;
+        unsigned long at = guess_pos, next = guess_line;
+        while(at<guess_end && known[next-line]==STATE_UNKNOWN){
+            const unsigned long end = lineEnd(spans, at);
+            state = lexer.lexLine(spans, at, end, state, chunk->styles);
+            if(end<length)
+                chunk->styles.push_back(STYLE_PLAIN);
+            at = end+1;
+            next++;
+        }
+        deliver(chunk);
+    }
+
+    Chunk *chunk = nullptr;
+    unsigned char state = known[0];
+    unsigned long at = 0, next = line, deliver_at = (view_end>0 && view_end<JOB_CHUNK) ? view_end : JOB_CHUNK;
+    while(!cancelled){
+        if(!chunk){
+            chunk = new Chunk();
+            chunk->version = version;
+            chunk->line = next;
+            chunk->pos = pos+at;
+            chunk->guess = false;
+            chunk->last = false;
+        }
+
+        const unsigned long end = lineEnd(spans, at);
+        state = lexer.lexLine(spans, at, end, state, chunk->styles);
+        if(end>=length){
+            chunk->last = true;
+            deliver(chunk);
+            return;
+        }
+        chunk->styles.push_back(STYLE_PLAIN);
+        chunk->states.push_back(state);
+        at = end+1;
+        next++;
+
+        // The lines from here on were lexed from this state before, so they are styled as
+        // they would be.
+        if(next-line>=settled && next-line<known.size() && known[next-line]==state){
+            chunk->last = true;
+            deliver(chunk);
+            return;
+        }
+
+        if(at>=deliver_at){
+            deliver(chunk);
+            chunk = nullptr;
+            deliver_at = at+JOB_CHUNK;
+        }
+    }
+    delete chunk;
+}
+
+bool Highlighter::merge(const Chunk &chunk, unsigned long version, Text_Buffer &style, unsigned long &from, unsigned long &to){
+    if(!active() || chunk.version!=version)
+        return false;
+
+    from = chunk.pos;
+    to = chunk.pos+chunk.styles.size();
+
+    // Only guess at lines that haven't been lexed since.
+    if(chunk.guess){
+        if(chunk.line<=pending)
+            return false;
+        style.overwrite(from, chunk.styles.data(), chunk.styles.size());
+        return true;
+    }
+
+    if(chunk.line!=pending)
+        return false;
+    style.overwrite(from, chunk.styles.data(), chunk.styles.size());
+    std::copy(chunk.states.begin(), chunk.states.end(), states.begin()+chunk.line+1);
+    pending = chunk.last ? states.size() : (chunk.line+chunk.states.size());
+    return true;
+}
+
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include "syntax.hpp"
+#include "text_spans.hpp"
+#include "line_index.hpp"
+#include "flare_text_buffer.hpp"
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <functional>
+
+namespace Flare {
+
+// Lexes lines of a Syntax. It is driven by tables built from the syntax: a class for each
+// byte, and the sorted keywords. Nothing changes once it is made, so a copy can be used on
+// another thread.
+class Lexer {
+
+    const Syntax *language;
+
+    // What each byte can start, as a set of CLASS_ bits.
+    unsigned char classes[0x100];
+    // How many keywords the syntax has, counted once here rather than for every word.
+    unsigned long keyword_count;
+
+    bool isKeyword(const TextSpans &text, unsigned long pos, unsigned long length) const;
+
+public:
+
+    explicit Lexer(const Syntax *s = nullptr);
+
+    const Syntax *syntax() const { return language; }
+
+    // Lexes from `pos' to the end of its line at `end', appending the styles to `into' and
+    // returning the state the next line starts in.
+    unsigned char lexLine(const TextSpans &text, unsigned long pos, unsigned long end, unsigned char state, std::string &into) const;
+
+};
+
+// Gives each byte of a text a style from a Syntax, a line at a time.
+//
+// What the lexer carries from one line to the next, such as being in a block comment, is
+// kept for the start of every line. After an edit, lines are lexed from the one the edit
+// starts in until one past the edit starts in the same state as it did before, since every
+// line after that is styled as it was. Typing normally lexes just the one line.
+//
+// With a line budget, no call lexes more lines than that. The lines that are left are
+// lexed by a Job on another thread, against a copy of the text, and merged back in chunks.
+class Highlighter {
+public:
+
+    // Styles for some lines, lexed by a job.
+    struct Chunk {
+        // The version of the text the job was made for.
+        unsigned long version;
+        // The first line, and where it starts.
+        unsigned long line, pos;
+        std::string styles;
+        // The state each line after the first starts in.
+        std::vector<unsigned char> states;
+        // A guess is lexed from a state that isn't known yet, so that the lines on screen
+        // are styled sooner. It is replaced once the lines before it are lexed.
+        bool guess;
+        // Set on the last chunk of a job.
+        bool last;
+    };
+
+    // Lexes the lines a highlighter left, on any thread.
+    class Job {
+        friend class Highlighter;
+
+        const Lexer lexer;
+        const unsigned long version;
+        // The text from the start of the first line to the end.
+        std::string text;
+        unsigned long line, pos;
+        // The states the lines had from the first one on, to find where lexing can stop.
+        // Lines before `settled' weren't all lexed since they changed, so it can't stop there.
+        std::vector<unsigned char> known;
+        unsigned long settled;
+        // The first chunk ends here, so that it covers the lines on screen.
+        unsigned long view_end;
+        // Lines on screen that are lexed first, as a guess, if guess_end is more than guess_pos.
+        unsigned long guess_line, guess_pos, guess_end;
+
+        std::atomic<bool> cancelled;
+
+    public:
+
+        Job(const Lexer &l, unsigned long v)
+          : lexer(l)
+          , version(v)
+          , line(0)
+          , pos(0)
+          , settled(0)
+          , view_end(0)
+          , guess_line(0)
+          , guess_pos(0)
+          , guess_end(0)
+          , cancelled(false){}
+
+        // Calls `deliver' with each chunk, which then belongs to it. Stops early once cancelled.
+        void run(const std::function<void(Chunk *)> &deliver);
+        void cancel(){ cancelled = true; }
+
+    };
+
+private:
+
+    Lexer lexer;
+
+    // The state each line starts in.
+    std::vector<unsigned char> states;
+    // The lines from this one on haven't been lexed since the text changed, though this
+    // one's state is right. It is the number of lines once everything is lexed.
+    unsigned long pending;
+    unsigned long budget;
+    unsigned long lexed;
+
+    // Lexes a line at a time from `line', which starts at `pos', until the end of the text or
+    // the first line at or after `until' that starts in the same state as it did. Stops
+    // early at the pending lines, or once the budget is spent. Returns where it stopped.
+    unsigned long run(const TextSpans &text, Text_Buffer &style, unsigned long line, unsigned long pos, unsigned long until);
+
+public:
+
+    Highlighter();
+
+    // Sets the language, or turns highlighting off if it is null. Call highlight() after.
+    void syntax(const Syntax *s);
+    const Syntax *syntax() const { return lexer.syntax(); }
+    bool active() const { return lexer.syntax()!=nullptr; }
+
+    // How many lines a call can lex, leaving the rest for a job. 0 is no limit, which is
+    // the default.
+    void lineBudget(unsigned long lines){ budget = lines; }
+    // True if there are no lines left for a job.
+    bool finished() const { return pending>=states.size(); }
+
+    // Styles the whole text. `style' has to be as long as the text.
+    void highlight(const TextSpans &text, const LineIndex &lines, Text_Buffer &style);
+
+    // Styles the text again after `inserted' bytes replaced some at `pos'. `style' has
+    // already been made as long as the text again, and `lines' is up to date. The range
+    // that was styled is returned in `from' and `to'.
+    void update(const TextSpans &text, const LineIndex &lines, Text_Buffer &style, unsigned long pos, unsigned long inserted, unsigned long &from, unsigned long &to);
+
+    // Styles the lines in [from, to) again, as if nothing had been drawn over them, and
+    // widens the range to the lines that were styled.
+    void restyle(const TextSpans &text, const LineIndex &lines, Text_Buffer &style, unsigned long &from, unsigned long &to);
+
+    // A job for the lines that are left, or null if there are none. The text is copied, so
+    // this is O(n) in the text that is left. [view_from, view_to) is on screen, and is
+    // lexed first.
+    std::shared_ptr<Job> job(const TextSpans &text, const LineIndex &lines, unsigned long version, unsigned long view_from, unsigned long view_to) const;
+    // Takes the styles from a chunk of a job, unless the text has changed since the job was
+    // made or the chunk is out of date. The range that was styled is returned in `from' and
+    // `to'.
+    bool merge(const Chunk &chunk, unsigned long version, Text_Buffer &style, unsigned long &from, unsigned long &to);
+
+    // How many lines the last call lexed.
+    unsigned long linesLexed() const { return lexed; }
+
+};
+
+}
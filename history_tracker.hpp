@@ -6,13 +6,14 @@
 //! @copyright BSD 3-Clause License
 
 #include <deque>
+#include <vector>
 #include <string>
 #include <algorithm>
 #include <numeric>
 
 namespace Pluto {
 
-//! See the src/benchmark/history_tracker directory for some speed and memory demo programs.
+//! See benchmark/bench.cpp (scons bench) for speed comparisons with the standard containers.
 //! In general, for simply adding to the tracker and not erasing, it should be faster than
 //! a list but slower than a vector. So pretty close to a raw std::deque.
 //! The real benefit is in the size checking it does.
@@ -20,10 +21,13 @@ template<class T, void(*Deleter)(T), size_t (*Sizer)(size_t, T), size_t max_size
 class HistoryTracker {
     
     std::deque<T> stack;
-    unsigned stack_size;
+    size_t stack_size;
 
 public:
 
+    HistoryTracker()
+      : stack_size(0){}
+
     ~HistoryTracker(){
         std::for_each(stack.begin(), stack.end(), Deleter);
     }
@@ -73,7 +77,7 @@ public:
 
     void clearFrom(size_type i) {
         typename std::deque<T>::iterator from = (stack.rbegin()+i).base();
-        stack_size -= std::accumulate(from, stack.end(), 0u, Sizer);
+        stack_size -= std::accumulate(from, stack.end(), (size_t)0, Sizer);
         
         std::for_each(from, stack.end(), Deleter);
         stack.erase(from, stack.end());
@@ -87,4 +91,145 @@ public:
 
 };
 
+//! The same as HistoryTracker, but the entries are kept in one contiguous ring buffer, and
+//! the size of each entry is only worked out once, when it is added. That makes pushing,
+//! popping and evicting constant time no matter what Sizer has to do, and clearing k
+//! entries O(k).
+//! Since sizes are cached, call backChanged() after changing the entry back() refers to.
+//! Entries evicted to make room can be handed off somewhere else first, see evictTo().
+template<class T, void(*Deleter)(T), size_t (*Sizer)(size_t, T), size_t max_size = 0xFFFF>
+class RingHistoryTracker {
+public:
+
+    typedef void (*Evictor)(T, void *);
+
+private:
+
+    struct Entry {
+        T item;
+        size_t cost;
+    };
+
+    // The size of the ring is always zero or a power of two.
+    std::vector<Entry> ring;
+    size_t first, count, stack_size;
+
+    Evictor evictor;
+    void *evictor_arg;
+
+    size_t index(size_t i) const {
+        return (first+i)&(ring.size()-1);
+    }
+
+    void grow(){
+        std::vector<Entry> bigger(ring.empty() ? 16 : (ring.size()<<1));
+        for(size_t i = 0; i<count; i++)
+            bigger[i] = ring[index(i)];
+        ring.swap(bigger);
+        first = 0;
+    }
+
+    // Drops the oldest entries while over max_size, but always keeps the newest `keep'.
+    void evict(size_t keep){
+        while(count>keep && stack_size>max_size){
+            Entry &oldest = ring[first];
+            stack_size -= oldest.cost;
+            if(evictor)
+                evictor(oldest.item, evictor_arg);
+            Deleter(oldest.item);
+            first = (first+1)&(ring.size()-1);
+            count--;
+        }
+    }
+
+public:
+
+    RingHistoryTracker()
+      : first(0), count(0), stack_size(0), evictor(nullptr), evictor_arg(nullptr){}
+
+    ~RingHistoryTracker(){
+        clear();
+    }
+
+    typedef T value_type;
+    typedef value_type& reference;
+    typedef value_type const & const_reference;
+    typedef unsigned long size_type;
+
+    bool empty() const {
+        return count==0;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    //! Total size of the entries, as measured by Sizer.
+    size_t bytes() const {
+        return stack_size;
+    }
+
+    T &back() {
+        return ring[index(count-1)].item;
+    }
+
+    //! Sets something to be called with each entry dropped to stay under max_size, before
+    //! it is deleted. Entries removed by pop, clearFrom or clear aren't passed to it.
+    void evictTo(Evictor e, void *arg){
+        evictor = e;
+        evictor_arg = arg;
+    }
+
+    //! Measures the entry back() refers to again, and makes room for it if it has grown.
+    void backChanged(){
+        Entry &last = ring[index(count-1)];
+        stack_size -= last.cost;
+        last.cost = Sizer(0, last.item);
+        stack_size += last.cost;
+        evict(1);
+    }
+
+    void push_back(T item){
+        const size_t cost = Sizer(0, item);
+        stack_size += cost;
+        evict(0);
+
+        if(count==ring.size())
+            grow();
+        Entry &entry = ring[index(count)];
+        entry.item = item;
+        entry.cost = cost;
+        count++;
+    }
+
+    void pop_back(){
+        stack_size -= ring[index(count-1)].cost;
+        count--;
+    }
+
+    T pop() {
+        T const s = back();
+        pop_back();
+        return s;
+    }
+
+    T operator[] (size_type i) const { return ring[index(i)].item; }
+
+    //! Removes the newest i entries.
+    void clearFrom(size_type i) {
+        for(; i>0 && count>0; i--){
+            Entry &last = ring[index(count-1)];
+            stack_size -= last.cost;
+            Deleter(last.item);
+            count--;
+        }
+    }
+
+    void clear() {
+        clearFrom(count);
+        first = 0;
+    }
+
+};
+
 }
@@ -0,0 +1,526 @@
+#include "large_file_viewer.hpp"
+#include "text_editor.hpp"
+#include "worker_pool.hpp"
+#include "size_utilities.hpp"
+#include "search.hpp"
+
+#include <FL/Fl.H>
+#include <FL/fl_ask.H>
+
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+
+namespace Flare {
+
+// How much of the file the display is given at once, and how close the view can get to
+// either end of that before the window is moved. Only this much is ever laid out.
+#define WINDOW_SIZE 0x100000
+#define WINDOW_MARGIN 0x40000
+
+// Every this many lines is indexed, which keeps the index to a few bytes a line.
+#define LINE_STRIDE 0x400
+// How much is indexed between handing the lines found to the viewer.
+#define INDEX_CHUNK 0x4000000
+
+// How often to check whether the index has reached the line that goToLine is waiting for.
+#define INDEX_POLL 0.1
+
+// How much Find All searches each time FLTK is idle.
+#define SEARCH_CHUNK 0x800000
+
+// The largest position the scrollbar is given.
+#define BAR_RANGE 0x40000000ul
+
+LargeFileViewer::LineIndex::LineIndex(const std::shared_ptr<const MappedFile> &f)
+  : file(f)
+  , cancelled(false)
+  , scanned(0)
+  , lines(0){
+    starts.push_back(0);
+}
+
+void LargeFileViewer::LineIndex::build(){
+    const char * const text = file->text;
+    const unsigned long length = file->length;
+
+    std::vector<unsigned long> found;
+    unsigned long at = 0, line = 0;
+    while(at<length && !cancelled){
+        const unsigned long end = (length-at>INDEX_CHUNK) ? (at+INDEX_CHUNK) : length;
+        const char *newline;
+        while((newline = (const char *)memchr(text+at, '\n', end-at))!=nullptr){
+            at = newline-text+1;
+            if(++line%LINE_STRIDE==0)
+                found.push_back(at);
+        }
+        at = end;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        starts.insert(starts.end(), found.begin(), found.end());
+        scanned = end;
+        lines = line;
+        found.clear();
+    }
+}
+
+unsigned long LargeFileViewer::LineIndex::closest(unsigned long line, unsigned long &start) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    const size_t i = std::min<size_t>(line/LINE_STRIDE, starts.size()-1);
+    start = starts[i];
+    return i*LINE_STRIDE;
+}
+
+bool LargeFileViewer::LineIndex::reached(unsigned long line) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return line<=lines || scanned>=file->length;
+}
+
+LargeFileViewer::LargeFileViewer(int x, int y, int w, int h)
+  : Editor(x, y, w, h)
+  , pool(nullptr)
+  , adler(0)
+  , adler_known(false)
+  , window(WINDOW_SIZE, WINDOW_MARGIN, FileLengthCallback, FileCopyCallback, this)
+  , view(*this, x, y, w-Fl::scrollbar_size(), h)
+  , bar(x+w-Fl::scrollbar_size(), y, Fl::scrollbar_size(), h)
+  , indexing(x, y, w-Fl::scrollbar_size(), FL_NORMAL_SIZE+8)
+  , shift(0)
+  , pending_line(0){
+
+    window.attach(view);
+    view.textfont(FL_SCREEN);
+    // Only the horizontal scrollbar, the vertical one is over the whole file.
+    view.scrollbar_align(FL_ALIGN_BOTTOM);
+
+    bar.callback(BarCallback, this);
+    updateBar();
+
+    indexing.box(FL_FLAT_BOX);
+    indexing.align(FL_ALIGN_INSIDE|FL_ALIGN_LEFT);
+    indexing.hide();
+
+    holder.resizable(view);
+    holder.end();
+}
+
+LargeFileViewer::~LargeFileViewer(){
+    Fl::remove_idle(ScanCallback, this);
+    Fl::remove_timeout(PendingLineCallback, this);
+    if(index)
+        index->cancelled = true;
+}
+
+int LargeFileViewer::View::handle(int e){
+    if(e==FL_KEYBOARD && owner.key(Fl::event_key()))
+        return 1;
+    if(e==FL_MOUSEWHEEL && Fl::event_dy()!=0){
+        owner.scroll(Fl::event_dy()*3);
+        return 1;
+    }
+
+    const int that = Fl_Text_Display::handle(e);
+    owner.follow();
+    return that;
+}
+
+TextSpans LargeFileViewer::spans() const {
+    const TextSpans that = {file ? file->text : "", file ? file->length : 0, nullptr, 0};
+    return that;
+}
+
+unsigned long LargeFileViewer::FileLengthCallback(const void *a){
+    return static_cast<const LargeFileViewer *>(a)->textLength();
+}
+
+void LargeFileViewer::FileCopyCallback(unsigned long at, unsigned long length, char *into, const void *a){
+    memcpy(into, static_cast<const LargeFileViewer *>(a)->file->text+at, length);
+}
+
+void LargeFileViewer::follow(){
+    if(!file)
+        return;
+
+    window.follow(view.firstVisible(), view.lastVisible());
+    updateBar();
+}
+
+void LargeFileViewer::showLine(unsigned long at){
+    window.showLine(at);
+    follow();
+}
+
+void LargeFileViewer::updateBar(){
+    if(!file){
+        bar.value(0, 1, 0, 1);
+        return;
+    }
+
+    const unsigned long top = window.start()+view.firstVisible(), shown = view.lastVisible()-view.firstVisible();
+    bar.value(top>>shift, (shown>>shift)+1, 0, (file->length>>shift)+1);
+}
+
+void LargeFileViewer::BarCallback(Fl_Widget *w, void *a){
+    LargeFileViewer * const that = static_cast<LargeFileViewer *>(a);
+    if(!that->file)
+        return;
+
+    unsigned long at = (unsigned long)that->bar.value()<<that->shift;
+    if(at>that->file->length)
+        at = that->file->length;
+    that->showLine(that->window.lineStart(at));
+}
+
+void LargeFileViewer::scroll(int lines){
+    view.scrollBy(lines);
+    follow();
+}
+
+bool LargeFileViewer::key(int k){
+    if(!file)
+        return false;
+
+    const int page = (view.visibleLines()>1) ? (view.visibleLines()-1) : 1;
+    switch(k){
+        case FL_Up:
+        scroll(-1);
+        return true;
+        case FL_Down:
+        scroll(1);
+        return true;
+        case FL_Page_Up:
+        scroll(-page);
+        return true;
+        case FL_Page_Down:
+        scroll(page);
+        return true;
+        case FL_Home:
+        if(!Fl::event_state(FL_CTRL))
+            return false;
+        showLine(0);
+        return true;
+        case FL_End:
+        if(!Fl::event_state(FL_CTRL))
+            return false;
+        showLine(window.lineStart(file->length));
+        return true;
+    }
+    return false;
+}
+
+bool LargeFileViewer::jumpToLine(unsigned long line){
+    // Without a pool nothing is indexing the file, so the lines are counted here after all.
+    if(pool && !index->reached(line))
+        return false;
+
+    const char * const text = file->text;
+    const unsigned long length = file->length;
+
+    // Within the index this is at most LINE_STRIDE lines.
+    unsigned long at;
+    for(unsigned long n = index->closest(line, at); n<line; n++){
+        const char * const newline = (const char *)memchr(text+at, '\n', length-at);
+        if(!newline)
+            break;
+        at = newline-text+1;
+    }
+
+    showLine(at);
+    view.insert_position(at-window.start());
+    return true;
+}
+
+void LargeFileViewer::goToLine(unsigned long line){
+    if(!file)
+        return;
+
+    cancelPendingLine();
+    // Lines are counted from 1 here, and from 0 in the index.
+    const unsigned long target = (line>0) ? (line-1) : 0;
+    if(jumpToLine(target))
+        return;
+
+    pending_line = target;
+    char label[64];
+    snprintf(label, sizeof(label), "Indexing lines, going to line %lu when it is reached...", line);
+    indexing.copy_label(label);
+    indexing.show();
+    Fl::add_timeout(INDEX_POLL, PendingLineCallback, this);
+}
+
+void LargeFileViewer::PendingLineCallback(void *a){
+    LargeFileViewer * const that = static_cast<LargeFileViewer *>(a);
+    if(that->jumpToLine(that->pending_line)){
+        that->indexing.hide();
+        that->holder.redraw();
+    }
+    else
+        Fl::repeat_timeout(INDEX_POLL, PendingLineCallback, a);
+}
+
+void LargeFileViewer::cancelPendingLine(){
+    if(!indexing.visible())
+        return;
+    Fl::remove_timeout(PendingLineCallback, this);
+    indexing.hide();
+    holder.redraw();
+}
+
+void LargeFileViewer::info() const {
+    char buffer[8];
+    const unsigned long long s = file ? file->length : 0;
+
+    unsigned long lines = 0;
+    bool counted = false;
+    if(index){
+        std::lock_guard<std::mutex> lock(index->mutex);
+        lines = index->lines+1;
+        counted = index->scanned>=s;
+    }
+
+    // Reading the whole file just to show this could take a while.
+    char checksum[24] = "not calculated";
+    if(adler_known)
+        snprintf(checksum, sizeof(checksum), "%lu", adler);
+
+    fl_alert("Editor information:\npath: %s\nFilesize: %s %cB\nLines: %s%lu\nAdler32 Checksum: %s\n",
+        path().c_str(), sizeNumberString(buffer, s), sizePrefixChar(s), counted ? "" : "at least ", lines, checksum);
+}
+
+void LargeFileViewer::close(){
+    clearMatches();
+    cancelPendingLine();
+    if(index)
+        index->cancelled = true;
+    index.reset();
+    file.reset();
+    adler_known = false;
+}
+
+bool LargeFileViewer::load(){
+    close();
+
+    unsigned long length;
+    const char * const text = mapFileContents(path_.c_str(), length);
+    if(!text){
+        window.show(0);
+        updateBar();
+        fl_alert("Cannot open file %s\n%s", path_.c_str(), strerror(errno));
+        return false;
+    }
+
+    file = std::make_shared<const MappedFile>(text, length);
+    saved_path = path_;
+    shift = 0;
+    while((length>>shift)>BAR_RANGE)
+        shift++;
+
+    index = std::make_shared<LineIndex>(file);
+    if(pool){
+        const std::shared_ptr<LineIndex> job = index;
+        pool->post([job](){ job->build(); });
+    }
+
+    window.show(0);
+    view.insert_position(0);
+    view.scroll(1, 0);
+    updateBar();
+    return true;
+}
+
+void LargeFileViewer::loadInBackground(WorkerPool &workers, LoadedCallback loaded, void *arg){
+    pool = &workers;
+    loaded(this, load(), arg);
+}
+
+bool LargeFileViewer::save(){
+    if(!file)
+        return false;
+
+    // Nothing can have changed, so only Save As to another file has anything to do.
+    if(path_==saved_path)
+        return true;
+
+    if(!saveFileContents(path_.c_str(), spans(), adler)){
+        fl_alert("Could not save file %s\n%s", path_.c_str(), strerror(errno));
+        return false;
+    }
+
+    adler_known = true;
+    saved_path = path_;
+    return true;
+}
+
+void LargeFileViewer::readOnly() const {
+    fl_alert("File %s is open read-only, since it is too large to edit.", path_.c_str());
+}
+
+void LargeFileViewer::showMatch(unsigned long at, unsigned long length){
+    if(!file)
+        return;
+
+    window.showMatch(at, length);
+    follow();
+}
+
+void LargeFileViewer::find(const char *text){
+    last_find = text;
+    last_find_regex = false;
+    const Searcher searcher(last_find);
+
+    // The file is already one block of text, so it can be searched where it is.
+    const long at = searcher.findWrapping(spans(), cursor());
+    if(at<0){
+        notFound(text);
+        return;
+    }
+
+    showMatch(at, searcher.length());
+}
+
+void LargeFileViewer::findAll(const char *text){
+    clearMatches();
+
+    last_find = text;
+    last_find_regex = false;
+    if(last_find.empty() || !file)
+        return;
+
+    matches.reset(last_find.c_str(), last_find.size(), file->length);
+    Fl::add_idle(ScanCallback, this);
+}
+
+void LargeFileViewer::ScanCallback(void *a){
+    LargeFileViewer * const that = static_cast<LargeFileViewer *>(a);
+
+    unsigned long from, to;
+    if(that->matches.scan(that->spans(), SEARCH_CHUNK, from, to))
+        Fl::remove_idle(ScanCallback, a);
+}
+
+void LargeFileViewer::clearMatches(){
+    if(!matches.active())
+        return;
+
+    Fl::remove_idle(ScanCallback, this);
+    matches.clear();
+}
+
+void LargeFileViewer::findNext(){
+    if(last_find_regex){
+        findRegex(last_find.c_str());
+        return;
+    }
+    if(!matches.active()){
+        if(!last_find.empty())
+            find(last_find.c_str());
+        return;
+    }
+
+    // As with the text editor, step on from the current match if the cursor is still there.
+    const unsigned long n = matches.needleLength();
+    const long current = matches.currentPosition();
+    const long at = (current>=0 && current+n==cursor()) ? matches.next() : matches.seek(cursor());
+
+    if(at>=0)
+        showMatch(at, n);
+}
+
+void LargeFileViewer::findPrevious(){
+    if(last_find.empty())
+        return;
+
+    const unsigned long at = cursor();
+
+    if(last_find_regex){
+        findPreviousRegex(at);
+        return;
+    }
+
+    const unsigned long n = last_find.size();
+    const long current = matches.currentPosition();
+
+    long found;
+    if(!matches.active()){
+        // Skip the match the cursor is at the end of.
+        const Searcher searcher(last_find);
+        found = searcher.findLastWrapping(spans(), (at>=n) ? (at-n) : 0);
+        if(found<0)
+            notFound(last_find.c_str());
+    }
+    else if(current>=0 && current+n==at)
+        found = matches.previous();
+    else{
+        matches.seek(at);
+        found = matches.previous();
+    }
+
+    if(found>=0)
+        showMatch(found, n);
+}
+
+void LargeFileViewer::replace(const char *text, const char *replacement){
+    readOnly();
+}
+
+unsigned long LargeFileViewer::replaceAll(const char *text, const char *replacement){
+    readOnly();
+    return 0;
+}
+
+void LargeFileViewer::findRegex(const char *pattern){
+    if(!compileRegex(pattern))
+        return;
+    last_find = pattern;
+    last_find_regex = true;
+
+    unsigned long start, end;
+    if(!regex.findWrapping(spans(), cursor(), start, end)){
+        notFound(pattern);
+        return;
+    }
+
+    regex_match_start = start;
+    showMatch(start, end-start);
+}
+
+bool LargeFileViewer::findLastRegex(unsigned long before, unsigned long &start, unsigned long &end) const {
+    return regex.findLastWrapping(spans(), before, start, end);
+}
+
+bool LargeFileViewer::regexMatches(unsigned long start, unsigned long end) const {
+    return regex.matchAt(spans(), start)==(long)end;
+}
+
+void LargeFileViewer::replaceRegex(const char *pattern, const char *replacement){
+    readOnly();
+}
+
+unsigned long LargeFileViewer::replaceAllRegex(const char *pattern, const char *replacement){
+    readOnly();
+    return 0;
+}
+
+unsigned long LargeFileViewer::matchCount(bool &complete) const {
+    complete = !matches.active() || matches.complete();
+    return matches.count();
+}
+
+void LargeFileViewer::calculateAdler32(){
+    if(!file)
+        return;
+
+    adler = spansAdler32(spans());
+    adler_known = true;
+}
+
+const Fl_Menu_Item *LargeFileViewer::prepareMenu(void(*OpenCallback_)(Fl_Widget *, void *a), void(*FindCallback_)(Fl_Widget *, void *a), void *arg_) const{
+    return TextEditor::PrepareMenu(this, OpenCallback_, FindCallback_, arg_);
+}
+
+Editor *LargeFileViewer::CreateLargeFileViewer(int x, int y, int w, int h){
+    return new LargeFileViewer(x, y, w, h);
+}
+
+} // namespace Flare
@@ -0,0 +1,168 @@
+#pragma once
+#include "editor.hpp"
+
+#include "text_window.hpp"
+#include "match_index.hpp"
+
+#include <FL/Fl_Text_Display.H>
+#include <FL/Fl_Scrollbar.H>
+#include <FL/Fl_Box.H>
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+namespace Flare {
+
+// A read-only view of a file too big to load, of any size. The file is mapped, so only the
+// parts that are looked at are ever read, and nothing else held grows with the file except
+// a sparse index of where its lines start.
+//
+// As with the PieceTableEditor, the display is only given a window of the text around where
+// it is looking. The scrollbar is over the whole file instead of the window.
+//
+// Lines are counted on a worker thread. Going to a line that has been indexed is immediate.
+// Going to one past that waits for the index to get there, since counting the lines on the
+// UI thread could mean reading gigabytes first.
+//
+// Find All counts the matches and steps through them, but doesn't colour them. There is no
+// snapshot, since a copy of the text is exactly what the viewer is there to avoid.
+class LargeFileViewer : public Editor {
+
+    // The display, which tells the viewer when it has moved and does its own scrolling.
+    class View : public Fl_Text_Display {
+        LargeFileViewer &owner;
+    public:
+        View(LargeFileViewer &o, int x, int y, int w, int h)
+          : Fl_Text_Display(x, y, w, h)
+          , owner(o){}
+
+        int handle(int e) override;
+
+        // The first and last characters that can be seen.
+        int firstVisible() const { return mFirstChar; }
+        int lastVisible() const { return mLastChar; }
+        int visibleLines() const { return mNVisibleLines; }
+        void scrollBy(int lines){ scroll(mTopLineNum+lines, mHorizOffset); }
+    };
+
+    // Unmapped once neither the viewer nor the job indexing it need it.
+    struct MappedFile {
+        const char *text;
+        unsigned long length;
+
+        MappedFile(const char *t, unsigned long l)
+          : text(t), length(l){}
+        ~MappedFile(){ unmapFileContents(text, length); }
+    };
+
+    // Where every LINE_STRIDE'th line starts, filled in a chunk at a time by a worker.
+    struct LineIndex {
+        const std::shared_ptr<const MappedFile> file;
+        // Set when the viewer no longer wants the index.
+        std::atomic<bool> cancelled;
+
+        mutable std::mutex mutex;
+        std::vector<unsigned long> starts;
+        // Everything before this has been indexed, and had this many lines in it.
+        unsigned long scanned, lines;
+
+        explicit LineIndex(const std::shared_ptr<const MappedFile> &f);
+
+        void build();
+        // The closest line at or before `line' whose start is known, and where it starts.
+        unsigned long closest(unsigned long line, unsigned long &start) const;
+        // True once the line has been indexed, so that it is close to a start that is known.
+        bool reached(unsigned long line) const;
+    };
+
+    std::shared_ptr<const MappedFile> file;
+    std::shared_ptr<LineIndex> index;
+    WorkerPool *pool;
+    // Where the text is already saved. Saving anywhere else writes a copy.
+    std::string saved_path;
+
+    uLong adler;
+    bool adler_known;
+
+    // Declared before the display, which still refers to it while being destroyed.
+    TextWindow window;
+    View view;
+    Fl_Scrollbar bar;
+    // Says that the view is waiting for the index to get to a line.
+    Fl_Box indexing;
+    // The scrollbar takes an int, so positions in the file are shifted down to fit.
+    unsigned shift;
+
+    TextSpans spans() const;
+    static unsigned long FileLengthCallback(const void *a);
+    static void FileCopyCallback(unsigned long at, unsigned long length, char *into, const void *a);
+
+    // Moves the window along when the view gets near either end of it, and the scrollbar
+    // with the view.
+    void follow();
+    // Shows the line starting at `at' at the top of the view.
+    void showLine(unsigned long at);
+    // Goes to a line, counting from 0, if it has been indexed.
+    bool jumpToLine(unsigned long line);
+
+    // The line that goToLine is waiting for the index to reach.
+    unsigned long pending_line;
+    static void PendingLineCallback(void *a);
+    void cancelPendingLine();
+    void updateBar();
+    static void BarCallback(Fl_Widget *w, void *a);
+
+    // Scrolls by `lines', or handles a key that moves the view. Returns false for other keys.
+    void scroll(int lines);
+    bool key(int k);
+
+    void close();
+
+    // Matches from Find All, found a chunk at a time whenever FLTK is idle.
+    MatchIndex matches;
+    static void ScanCallback(void *a);
+
+    // Where the cursor is, in the whole file.
+    unsigned long cursor() const { return window.cursor(); }
+
+    unsigned long textLength() const override { return file ? file->length : 0; }
+    void showMatch(unsigned long at, unsigned long length) override;
+    bool findLastRegex(unsigned long before, unsigned long &start, unsigned long &end) const override;
+    bool regexMatches(unsigned long start, unsigned long end) const override;
+    void readOnly() const;
+
+public:
+    const Fl_Menu_Item *prepareMenu(void(*OpenCallback_)(Fl_Widget *, void *a) = nullptr, void(*FindCallback_)(Fl_Widget *, void *a) = nullptr, void *arg_ = nullptr) const override;
+
+    LargeFileViewer(int x, int y, int w, int h);
+    virtual ~LargeFileViewer();
+
+    void info() const override;
+    bool save() override;
+    bool load() override;
+    // Mapping is immediate, the pool is only used to index the lines.
+    void loadInBackground(WorkerPool &pool, LoadedCallback loaded, void *arg) override;
+
+    void find(const char *) override;
+    void findAll(const char *) override;
+    void clearMatches() override;
+    void findNext() override;
+    void findPrevious() override;
+    void replace(const char *text, const char *replacement) override;
+    unsigned long replaceAll(const char *text, const char *replacement) override;
+    void findRegex(const char *) override;
+    void replaceRegex(const char *pattern, const char *replacement) override;
+    unsigned long replaceAllRegex(const char *pattern, const char *replacement) override;
+    unsigned long matchCount(bool &complete) const override;
+    void goToLine(unsigned long line) override;
+
+    void calculateAdler32() override;
+
+    static Editor *CreateLargeFileViewer(int x, int y, int w, int h);
+
+};
+
+}
@@ -0,0 +1,250 @@
+#include "line_index.hpp"
+
+#include <cstring>
+
+namespace Flare {
+
+// Blocks are filled to this many lines, and split once they have twice as many.
+#define BLOCK_LINES 0x100
+
+// Calls f(pos) for each newline in [from, to) of the text. memchr is vectorized by the C
+// library, so this goes as fast as the text can be read.
+template<class F>
+static void forEachNewline(const TextSpans &text, unsigned long from, unsigned long to, F f){
+    if(from<text.first_length){
+        const char *at = text.first+from, * const end = text.first+((to<text.first_length) ? to : text.first_length);
+        while((at = (const char *)memchr(at, '\n', end-at))!=nullptr){
+            f(at-text.first);
+            at++;
+        }
+    }
+    if(to>text.first_length){
+        const char *at = text.second+((from>text.first_length) ? (from-text.first_length) : 0),
+            * const end = text.second+(to-text.first_length);
+        while((at = (const char *)memchr(at, '\n', end-at))!=nullptr){
+            f(text.first_length+(at-text.second));
+            at++;
+        }
+    }
+}
+
+LineIndex::LineIndex(){
+    const TextSpans empty = {"", 0, nullptr, 0};
+    build(empty);
+}
+
+void LineIndex::rebuild(){
+    const size_t n = blocks.size();
+    byte_tree.assign(n+1, 0);
+    line_tree.assign(n+1, 0);
+    total_bytes = 0;
+    total_lines = 0;
+
+    for(size_t i = 1; i<=n; i++){
+        const Block &block = blocks[i-1];
+        byte_tree[i]+=block.bytes;
+        line_tree[i]+=block.lengths.size();
+        total_bytes+=block.bytes;
+        total_lines+=block.lengths.size();
+
+        const size_t parent = i+(i&-i);
+        if(parent<=n){
+            byte_tree[parent]+=byte_tree[i];
+            line_tree[parent]+=line_tree[i];
+        }
+    }
+
+    top_step = 1;
+    while(top_step*2<=n)
+        top_step*=2;
+}
+
+void LineIndex::add(size_t block, unsigned long bytes, unsigned long lines){
+    for(size_t i = block+1; i<byte_tree.size(); i+=i&-i){
+        byte_tree[i]+=bytes;
+        line_tree[i]+=lines;
+    }
+    total_bytes+=bytes;
+    total_lines+=lines;
+}
+
+unsigned long LineIndex::prefix(const std::vector<unsigned long> &tree, size_t block){
+    unsigned long sum = 0;
+    for(size_t i = block; i>0; i-=i&-i)
+        sum+=tree[i];
+    return sum;
+}
+
+size_t LineIndex::find(const std::vector<unsigned long> &tree, unsigned long at, unsigned long &rest) const {
+    // Skip every block that ends at or before `at', halving the step each time.
+    size_t i = 0;
+    rest = at;
+    for(size_t step = top_step; step>0; step>>=1){
+        if(i+step<tree.size() && tree[i+step]<=rest){
+            i+=step;
+            rest-=tree[i];
+        }
+    }
+    return i;
+}
+
+void LineIndex::span(unsigned long line, unsigned long &start, unsigned long &length) const {
+    if(line>=total_lines)
+        line = total_lines-1;
+
+    unsigned long rest;
+    const size_t block = find(line_tree, line, rest);
+    const std::vector<unsigned> &lengths = blocks[block].lengths;
+
+    start = prefix(byte_tree, block);
+    for(size_t i = 0; i<rest; i++)
+        start+=lengths[i];
+    length = lengths[rest];
+}
+
+void LineIndex::locate(unsigned long pos, size_t &block, size_t &index, unsigned long &start) const {
+    // The end of the text is in the last line, which can be empty.
+    if(pos>=total_bytes){
+        block = blocks.size()-1;
+        index = blocks[block].lengths.size()-1;
+        start = total_bytes-blocks[block].lengths[index];
+        return;
+    }
+
+    unsigned long rest;
+    block = find(byte_tree, pos, rest);
+    const std::vector<unsigned> &lengths = blocks[block].lengths;
+
+    start = pos-rest;
+    index = 0;
+    while(rest>=lengths[index]){
+        rest-=lengths[index];
+        start+=lengths[index];
+        index++;
+    }
+}
+
+bool LineIndex::split(size_t block){
+    const std::vector<unsigned> lengths = blocks[block].lengths;
+    if(lengths.size()<=BLOCK_LINES*2)
+        return false;
+
+    std::vector<Block> pieces((lengths.size()+BLOCK_LINES-1)/BLOCK_LINES);
+    for(size_t i = 0; i<lengths.size(); i++){
+        Block &piece = pieces[i/BLOCK_LINES];
+        piece.lengths.push_back(lengths[i]);
+        piece.bytes+=lengths[i];
+    }
+
+    blocks.erase(blocks.begin()+block);
+    blocks.insert(blocks.begin()+block, pieces.begin(), pieces.end());
+    rebuild();
+    return true;
+}
+
+void LineIndex::build(const TextSpans &text){
+    blocks.clear();
+
+    unsigned long previous = 0;
+    const auto append = [this, &previous](unsigned long end){
+        if(blocks.empty() || blocks.back().lengths.size()>=BLOCK_LINES){
+            blocks.push_back(Block());
+            blocks.back().lengths.reserve(BLOCK_LINES);
+        }
+        blocks.back().lengths.push_back(end-previous);
+        blocks.back().bytes+=end-previous;
+        previous = end;
+    };
+
+    forEachNewline(text, 0, text.length(), [&append](unsigned long pos){ append(pos+1); });
+    append(text.length());
+    rebuild();
+}
+
+void LineIndex::update(const TextSpans &text, unsigned long pos, unsigned long inserted, unsigned long deleted){
+    if(inserted==0 && deleted==0)
+        return;
+    // Such as loading a file.
+    if(pos==0 && deleted>=total_bytes){
+        build(text);
+        return;
+    }
+
+    // The lines from the one the edit starts in to the one it ends in are replaced. Their
+    // newlines were all deleted, apart from the last, so the new lines are those of the
+    // inserted text and then the rest of the last line.
+    size_t first, first_index, last, last_index;
+    unsigned long first_start, last_start;
+    locate(pos, first, first_index, first_start);
+    locate(pos+deleted, last, last_index, last_start);
+    const unsigned long last_end = last_start+blocks[last].lengths[last_index];
+
+    std::vector<unsigned> lengths;
+    unsigned long previous = first_start;
+    forEachNewline(text, pos, pos+inserted, [&lengths, &previous](unsigned long at){
+        lengths.push_back(at+1-previous);
+        previous = at+1;
+    });
+    lengths.push_back(last_end+inserted-deleted-previous);
+
+    Block &block = blocks[first];
+
+    // Typing within a line, which is most edits.
+    if(first==last && first_index==last_index && lengths.size()==1){
+        const unsigned long change = (unsigned long)lengths[0]-block.lengths[first_index];
+        block.lengths[first_index] = lengths[0];
+        block.bytes+=change;
+        add(first, change, 0);
+        return;
+    }
+
+    if(first==last){
+        unsigned long removed = 0, added = 0;
+        for(size_t i = first_index; i<=last_index; i++)
+            removed+=block.lengths[i];
+        for(size_t i = 0; i<lengths.size(); i++)
+            added+=lengths[i];
+
+        block.lengths.erase(block.lengths.begin()+first_index, block.lengths.begin()+last_index+1);
+        block.lengths.insert(block.lengths.begin()+first_index, lengths.begin(), lengths.end());
+        block.bytes+=added-removed;
+        if(!split(first))
+            add(first, added-removed, (unsigned long)lengths.size()-(last_index-first_index+1));
+        return;
+    }
+
+    // The edit spans blocks, so they are joined into the first.
+    const std::vector<unsigned> &rest = blocks[last].lengths;
+    block.lengths.resize(first_index);
+    block.lengths.insert(block.lengths.end(), lengths.begin(), lengths.end());
+    block.lengths.insert(block.lengths.end(), rest.begin()+last_index+1, rest.end());
+    block.bytes = 0;
+    for(size_t i = 0; i<block.lengths.size(); i++)
+        block.bytes+=block.lengths[i];
+
+    blocks.erase(blocks.begin()+first+1, blocks.begin()+last+1);
+    if(!split(first))
+        rebuild();
+}
+
+unsigned long LineIndex::start(unsigned long line) const {
+    unsigned long at, length;
+    span(line, at, length);
+    return at;
+}
+
+unsigned long LineIndex::end(unsigned long line) const {
+    unsigned long at, length;
+    span(line, at, length);
+    // Every line but the last ends with a newline.
+    return at+length-((line+1<total_lines) ? 1 : 0);
+}
+
+unsigned long LineIndex::lineAt(unsigned long pos) const {
+    size_t block, index;
+    unsigned long start;
+    locate(pos, block, index, start);
+    return prefix(line_tree, block)+index;
+}
+
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "text_spans.hpp"
+
+#include <vector>
+#include <cstddef>
+
+namespace Flare {
+
+// Where every line of a text starts, kept up to date as the text is edited, so that finding
+// a line by its number or by a position in it is O(log n) in the number of lines rather than
+// a scan of the text. Lines are counted from 0, and there is always at least one.
+//
+// The length of each line, with its newline, is kept in blocks of a few hundred lines, with
+// Fenwick trees over how many bytes and lines each block has. An edit changes the lengths of
+// the lines it touches and updates the trees. Only splitting a block that has grown too big,
+// or an edit that spans blocks, rebuilds the trees, which is linear in the number of blocks.
+class LineIndex {
+
+    struct Block {
+        std::vector<unsigned> lengths;
+        unsigned long bytes;
+
+        Block()
+          : bytes(0){}
+    };
+    std::vector<Block> blocks;
+
+    // Fenwick trees over the blocks, counting from 1.
+    std::vector<unsigned long> byte_tree, line_tree;
+    // The largest power of two no more than the number of blocks.
+    size_t top_step;
+    unsigned long total_bytes, total_lines;
+
+    void rebuild();
+    // Adds to the bytes and lines of a block. Either can wrap around, to take away.
+    void add(size_t block, unsigned long bytes, unsigned long lines);
+    // The total of the blocks before `block' in one of the trees.
+    static unsigned long prefix(const std::vector<unsigned long> &tree, size_t block);
+    // The block that byte or line `at' is in, going by one of the trees. `rest' is how far
+    // into the block it is.
+    size_t find(const std::vector<unsigned long> &tree, unsigned long at, unsigned long &rest) const;
+
+    // Where a line starts, and how long it is.
+    void span(unsigned long line, unsigned long &start, unsigned long &length) const;
+
+    // The line `pos' is in, as a block, a line in the block, and where the line starts.
+    void locate(unsigned long pos, size_t &block, size_t &index, unsigned long &start) const;
+
+    // Splits a block that has grown too big. Returns true if it did.
+    bool split(size_t block);
+
+public:
+
+    LineIndex();
+
+    // Indexes the whole text again.
+    void build(const TextSpans &text);
+    // Updates the index after `deleted' bytes at `pos' were replaced by `inserted' bytes.
+    // `text' is the text after the edit. Only the inserted text is read.
+    void update(const TextSpans &text, unsigned long pos, unsigned long inserted, unsigned long deleted);
+
+    unsigned long count() const { return total_lines; }
+    // Where a line starts, and where it ends, not counting its newline. Lines past the last
+    // are the last.
+    unsigned long start(unsigned long line) const;
+    unsigned long end(unsigned long line) const;
+    // The line that `pos' is in.
+    unsigned long lineAt(unsigned long pos) const;
+
+};
+
+}
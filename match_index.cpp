@@ -0,0 +1,108 @@
+#include "match_index.hpp"
+
+#include <algorithm>
+
+namespace Flare {
+
+void MatchIndex::reset(const char *needle, unsigned long length, unsigned long new_text_length){
+    searcher.reset(new Searcher(needle, length));
+    matches.clear();
+    scanned = 0;
+    text_length = new_text_length;
+    current = 0;
+}
+
+void MatchIndex::clear(){
+    searcher.reset();
+    std::vector<unsigned long>().swap(matches);
+    scanned = 0;
+    text_length = 0;
+    current = 0;
+}
+
+void MatchIndex::collect(const TextSpans &text, unsigned long from, unsigned long to, std::vector<unsigned long> &into) const {
+    long found;
+    while(from<to && (found = searcher->find(text, from, to))>=0){
+        into.push_back(found);
+        from = found+1;
+    }
+}
+
+bool MatchIndex::scan(const TextSpans &text, unsigned long budget, unsigned long &from, unsigned long &to){
+    text_length = text.length();
+    from = scanned;
+    to = (text_length-scanned>budget) ? (scanned+budget) : text_length;
+
+    if(active())
+        collect(text, from, to, matches);
+
+    scanned = to;
+    return complete();
+}
+
+void MatchIndex::update(const TextSpans &text, unsigned long pos, unsigned long inserted, unsigned long deleted){
+    text_length = text.length();
+    if(!active())
+        return;
+
+    const unsigned long n = searcher->length();
+    const unsigned long reach = (pos>=n-1) ? (pos-n+1) : 0;
+
+    // Nothing that has been found yet could have been touched.
+    if(reach>=scanned)
+        return;
+
+    // Matches that started in the n-1 bytes before the edit or in the deleted text are
+    // gone. Matches after the deleted text are still there, just moved.
+    const std::vector<unsigned long>::iterator first = std::lower_bound(matches.begin(), matches.end(), reach),
+        last = std::lower_bound(first, matches.end(), pos+deleted);
+
+    for(std::vector<unsigned long>::iterator i = last; i!=matches.end(); i++)
+        *i = *i+inserted-deleted;
+
+    if(scanned>=pos+deleted)
+        scanned = scanned+inserted-deleted;
+    else if(scanned>pos)
+        scanned = pos+inserted;
+
+    // Search again where matches could have been made or broken.
+    std::vector<unsigned long> found;
+    const unsigned long rescan_end = (pos+inserted<scanned) ? (pos+inserted) : scanned;
+    collect(text, reach, rescan_end, found);
+
+    const size_t at = first-matches.begin();
+    matches.erase(first, last);
+    matches.insert(matches.begin()+at, found.begin(), found.end());
+
+    if(current>=matches.size())
+        current = 0;
+}
+
+size_t MatchIndex::lowerBound(unsigned long pos) const {
+    return std::lower_bound(matches.begin(), matches.end(), pos)-matches.begin();
+}
+
+long MatchIndex::seek(unsigned long pos){
+    if(matches.empty())
+        return -1;
+    current = lowerBound(pos);
+    if(current==matches.size())
+        current = 0;
+    return matches[current];
+}
+
+long MatchIndex::next(){
+    if(matches.empty())
+        return -1;
+    current = (current+1==matches.size()) ? 0 : current+1;
+    return matches[current];
+}
+
+long MatchIndex::previous(){
+    if(matches.empty())
+        return -1;
+    current = (current==0) ? matches.size()-1 : current-1;
+    return matches[current];
+}
+
+}
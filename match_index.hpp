@@ -0,0 +1,68 @@
+#pragma once
+
+#include "search.hpp"
+#include "text_spans.hpp"
+
+#include <vector>
+#include <memory>
+
+namespace Flare {
+
+// Every position a needle occurs at in a text, kept up to date as the text is edited.
+// Matches may overlap, so that whether a position matches only ever depends on the
+// needle's length worth of text after it. That keeps updates local to the edit.
+// The index is built a chunk at a time with scan(), so it can be filled in the background.
+class MatchIndex {
+
+    std::unique_ptr<Searcher> searcher;
+    std::vector<unsigned long> matches;
+
+    // Everything before this has been searched.
+    unsigned long scanned;
+    unsigned long text_length;
+
+    // The match that next() and previous() move from.
+    size_t current;
+
+    void collect(const TextSpans &text, unsigned long from, unsigned long to, std::vector<unsigned long> &into) const;
+
+public:
+
+    MatchIndex()
+      : scanned(0), text_length(0), current(0){}
+
+    bool active() const { return searcher!=nullptr; }
+    bool indexes(const std::string &needle) const { return searcher && searcher->text()==needle; }
+    bool complete() const { return scanned>=text_length; }
+
+    // Starts a new index, which is empty until it is scanned.
+    void reset(const char *needle, unsigned long length, unsigned long new_text_length);
+    void clear();
+
+    // Searches up to `budget' more bytes of the text. The range that was searched is
+    // returned in `from' and `to'. Returns true once the whole text has been searched.
+    bool scan(const TextSpans &text, unsigned long budget, unsigned long &from, unsigned long &to);
+
+    // Updates the index after `deleted' bytes at `pos' were replaced by `inserted' bytes.
+    // Only the text around the edit is searched again. `text' is the text after the edit.
+    void update(const TextSpans &text, unsigned long pos, unsigned long inserted, unsigned long deleted);
+
+    size_t count() const { return matches.size(); }
+    unsigned long needleLength() const { return searcher ? searcher->length() : 0; }
+    const std::vector<unsigned long> &positions() const { return matches; }
+
+    // Index of the first match starting at or after `pos'.
+    size_t lowerBound(unsigned long pos) const;
+
+    // Makes the first match at or after `pos' current, wrapping around to the start.
+    // Returns its position, or -1 if there are no matches.
+    long seek(unsigned long pos);
+    long currentPosition() const { return matches.empty() ? -1 : (long)matches[current]; }
+
+    // Moves to the next or previous match, wrapping around. These are constant time.
+    long next();
+    long previous();
+
+};
+
+}
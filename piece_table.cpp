@@ -0,0 +1,501 @@
+#include "piece_table.hpp"
+
+#include <utility>
+#include <cstdlib>
+#include <cstring>
+
+namespace Flare {
+
+// Typed text is appended to chunks of this size. Anything longer gets a chunk of its own.
+static const unsigned long chunk_size = 0x10000;
+
+PieceTable::PieceTable()
+  : root(none)
+  , random(0x9E3779B9u)
+  , add_end(nullptr)
+  , add_left(0)
+  , joinable(false)
+  , max_steps(0x10000)
+  , adler(adler32(0L, nullptr, 0))
+  , adler_known(true){
+
+}
+
+PieceTable::~PieceTable(){
+    clear();
+}
+
+unsigned PieceTable::allocate(const char *text, unsigned long length){
+    unsigned n;
+    if(!free_nodes.empty()){
+        n = free_nodes.back();
+        free_nodes.pop_back();
+    }
+    else{
+        nodes.push_back(Node());
+        n = nodes.size()-1;
+    }
+
+    // xorshift, only to keep the treap balanced.
+    random ^= random<<13;
+    random ^= random>>17;
+    random ^= random<<5;
+
+    Node &node = nodes[n];
+    node.text = text;
+    node.length = node.total = length;
+    node.priority = random;
+    node.left = node.right = none;
+    return n;
+}
+
+void PieceTable::release(unsigned n){
+    while(n!=none){
+        release(nodes[n].left);
+        free_nodes.push_back(n);
+        n = nodes[n].right;
+    }
+}
+
+void PieceTable::split(unsigned n, unsigned long pos, unsigned &left, unsigned &right){
+    if(n==none){
+        left = right = none;
+        return;
+    }
+
+    const unsigned long before = total(nodes[n].left), end = before+nodes[n].length;
+    if(pos<=before){
+        unsigned rest;
+        split(nodes[n].left, pos, left, rest);
+        nodes[n].left = rest;
+        update(n);
+        right = n;
+    }
+    else if(pos>=end){
+        unsigned rest;
+        split(nodes[n].right, pos-end, rest, right);
+        nodes[n].right = rest;
+        update(n);
+        left = n;
+    }
+    else{
+        // The split is inside this piece, so cut it in two. The first half keeps the node.
+        const unsigned long cut = pos-before;
+        const unsigned after = allocate(nodes[n].text+cut, nodes[n].length-cut);
+        const unsigned rest = nodes[n].right;
+        nodes[n].length = cut;
+        nodes[n].right = none;
+        update(n);
+        left = n;
+        right = merge(after, rest);
+    }
+}
+
+unsigned PieceTable::merge(unsigned left, unsigned right){
+    if(left==none)
+        return right;
+    if(right==none)
+        return left;
+
+    if(nodes[left].priority>nodes[right].priority){
+        const unsigned rest = merge(nodes[left].right, right);
+        nodes[left].right = rest;
+        update(left);
+        return left;
+    }
+    else{
+        const unsigned rest = merge(left, nodes[right].left);
+        nodes[right].left = rest;
+        update(right);
+        return right;
+    }
+}
+
+unsigned PieceTable::copyRange(unsigned n, unsigned long from, unsigned long to, unsigned into){
+    // Gathered first, since adding nodes can move the ones being looked at.
+    std::vector<std::pair<const char *, unsigned long> > pieces;
+    auto gather = [&pieces](const char *text, unsigned long length){
+        pieces.push_back(std::make_pair(text, length));
+    };
+    if(from<to)
+        visit(n, from, to, gather);
+
+    for(std::vector<std::pair<const char *, unsigned long> >::const_iterator i = pieces.begin(); i!=pieces.end(); i++)
+        into = merge(into, allocate(i->first, i->second));
+    return into;
+}
+
+const char *PieceTable::append(const char *text, unsigned long length){
+    if(length>add_left){
+        const unsigned long size = (length>chunk_size) ? length : chunk_size;
+        char * const chunk = (char *)malloc(size);
+        chunks.push_back(chunk);
+        add_end = chunk;
+        add_left = size;
+    }
+
+    char * const that = add_end;
+    memcpy(that, text, length);
+    add_end+=length;
+    add_left-=length;
+    return that;
+}
+
+bool PieceTable::extendLast(unsigned n, const char *text, unsigned long length){
+    if(n==none || length>add_left)
+        return false;
+
+    unsigned last = n;
+    while(nodes[last].right!=none)
+        last = nodes[last].right;
+    if(nodes[last].text+nodes[last].length!=add_end)
+        return false;
+
+    append(text, length);
+    nodes[last].length+=length;
+    for(unsigned i = n; i!=none; i = nodes[i].right)
+        nodes[i].total+=length;
+    return true;
+}
+
+void PieceTable::replace(unsigned long pos, unsigned long length, const char *text, unsigned long text_length){
+    if(length==0 && text_length==0)
+        return;
+
+    unsigned left, rest, removed, right;
+    split(root, pos, left, rest);
+    split(rest, length, removed, right);
+
+    // Typing carries on from the last piece, so it doesn't make a piece per key.
+    if(text_length>0 && !extendLast(left, text, text_length))
+        left = merge(left, allocate(append(text, text_length), text_length));
+    root = merge(left, right);
+
+    const Step step = {pos, text_length, length, removed};
+    record(step);
+}
+
+void PieceTable::apply(const std::vector<Edit> &edits){
+    if(edits.empty())
+        return;
+
+    const unsigned long from = edits.front().pos, to = edits.back().pos+edits.back().length;
+    unsigned left, rest, old, right;
+    split(root, from, left, rest);
+    split(rest, to-from, old, right);
+
+    // Build the new text of the whole range. The same replacement is usually used for every
+    // edit, so it is only added once.
+    unsigned built = none;
+    unsigned long at = from, inserted = 0;
+    const char *last_text = nullptr, *last_added = nullptr;
+    unsigned long last_length = 0;
+    for(std::vector<Edit>::const_iterator i = edits.begin(); i!=edits.end(); i++){
+        built = copyRange(old, at-from, i->pos-from, built);
+        inserted+=i->pos-at;
+
+        if(i->text_length>0){
+            if(i->text!=last_text || i->text_length!=last_length){
+                last_added = append(i->text, i->text_length);
+                last_text = i->text;
+                last_length = i->text_length;
+            }
+            built = merge(built, allocate(last_added, i->text_length));
+            inserted+=i->text_length;
+        }
+        at = i->pos+i->length;
+    }
+    root = merge(merge(left, built), right);
+
+    const Step step = {from, inserted, to-from, old};
+    joinable = false;
+    record(step);
+    joinable = false;
+}
+
+void PieceTable::record(const Step &step){
+    // Anything that could have been redone is gone now.
+    for(std::deque<Step>::const_iterator i = redo_steps.begin(); i!=redo_steps.end(); i++)
+        release(i->removed);
+    redo_steps.clear();
+
+    if(joinable && !undo_steps.empty()){
+        Step &top = undo_steps.back();
+        if(step.removed_length==0 && top.removed_length==0 && top.pos+top.inserted==step.pos){
+            top.inserted+=step.inserted;
+            return;
+        }
+        if(step.inserted==0 && top.inserted==0){
+            // Backspace, so what was removed comes before what already was.
+            if(step.pos+step.removed_length==top.pos){
+                top.removed = merge(step.removed, top.removed);
+                top.removed_length+=step.removed_length;
+                top.pos = step.pos;
+                return;
+            }
+            // Delete, so it comes after.
+            if(step.pos==top.pos){
+                top.removed = merge(top.removed, step.removed);
+                top.removed_length+=step.removed_length;
+                return;
+            }
+        }
+    }
+
+    undo_steps.push_back(step);
+    joinable = true;
+    while(undo_steps.size()>max_steps){
+        release(undo_steps.front().removed);
+        undo_steps.pop_front();
+    }
+}
+
+void PieceTable::swap(Step &step){
+    unsigned left, rest, middle, right;
+    split(root, step.pos, left, rest);
+    split(rest, step.inserted, middle, right);
+    root = merge(merge(left, step.removed), right);
+
+    step.removed = middle;
+    std::swap(step.inserted, step.removed_length);
+}
+
+bool PieceTable::undo(unsigned long &pos, unsigned long &removed, unsigned long &inserted){
+    if(undo_steps.empty())
+        return false;
+
+    Step step = undo_steps.back();
+    undo_steps.pop_back();
+    swap(step);
+    redo_steps.push_back(step);
+    joinable = false;
+
+    pos = step.pos;
+    removed = step.removed_length;
+    inserted = step.inserted;
+    return true;
+}
+
+bool PieceTable::redo(unsigned long &pos, unsigned long &removed, unsigned long &inserted){
+    if(redo_steps.empty())
+        return false;
+
+    Step step = redo_steps.back();
+    redo_steps.pop_back();
+    swap(step);
+    undo_steps.push_back(step);
+    joinable = false;
+
+    pos = step.pos;
+    removed = step.removed_length;
+    inserted = step.inserted;
+    return true;
+}
+
+void PieceTable::clearHistory(){
+    for(std::deque<Step>::const_iterator i = undo_steps.begin(); i!=undo_steps.end(); i++)
+        release(i->removed);
+    for(std::deque<Step>::const_iterator i = redo_steps.begin(); i!=redo_steps.end(); i++)
+        release(i->removed);
+    undo_steps.clear();
+    redo_steps.clear();
+    joinable = false;
+}
+
+void PieceTable::historyLimit(size_t steps){
+    max_steps = steps;
+    while(undo_steps.size()>max_steps){
+        release(undo_steps.front().removed);
+        undo_steps.pop_front();
+    }
+}
+
+void PieceTable::clear(){
+    undo_steps.clear();
+    redo_steps.clear();
+    joinable = false;
+
+    nodes.clear();
+    free_nodes.clear();
+    root = none;
+
+    for(std::vector<char *>::const_iterator i = chunks.begin(); i!=chunks.end(); i++)
+        free(*i);
+    chunks.clear();
+    add_end = nullptr;
+    add_left = 0;
+
+    for(std::vector<Mapping>::const_iterator i = mappings.begin(); i!=mappings.end(); i++)
+        unmapFileContents(i->text, i->length);
+    mappings.clear();
+
+    adler = adler32(0L, nullptr, 0);
+    adler_known = true;
+    stamp = FileStamp();
+}
+
+bool PieceTable::load(const char *path){
+    unsigned long length;
+    FileStamp new_stamp;
+    const char * const text = mapFileContents(path, length, &new_stamp);
+    if(!text)
+        return false;
+
+    clear();
+    const Mapping mapping = {text, length};
+    mappings.push_back(mapping);
+    stamp = new_stamp;
+    adler_known = false;
+
+    if(length>0)
+        root = allocate(text, length);
+    return true;
+}
+
+void PieceTable::reset(const char *text, unsigned long length){
+    clear();
+    if(length>0)
+        root = allocate(append(text, length), length);
+}
+
+// Goes through the pieces in order, without recursion.
+struct PieceIterator {
+    std::vector<unsigned> stack;
+    unsigned next;
+    const PieceTable *table;
+};
+
+bool PieceTable::NextPieceCallback(void *arg, const char *&text, unsigned long &length){
+    PieceIterator * const that = static_cast<PieceIterator *>(arg);
+    const std::vector<Node> &nodes = that->table->nodes;
+
+    while(that->next!=none){
+        that->stack.push_back(that->next);
+        that->next = nodes[that->next].left;
+    }
+    if(that->stack.empty())
+        return false;
+
+    const unsigned n = that->stack.back();
+    that->stack.pop_back();
+    text = nodes[n].text;
+    length = nodes[n].length;
+    that->next = nodes[n].right;
+    return true;
+}
+
+bool PieceTable::save(const char *path){
+    PieceIterator pieces;
+    pieces.next = root;
+    pieces.table = this;
+
+    uLong new_adler;
+    FileStamp new_stamp;
+    if(!savePieces(path, NextPieceCallback, &pieces, new_adler, &new_stamp))
+        return false;
+
+    adler = new_adler;
+    adler_known = true;
+    stamp = new_stamp;
+
+    // The file is now exactly the text, so use it for the text instead of all the pieces.
+    // Steps to undo keep their pieces, so the old file stays mapped for them.
+    unsigned long length;
+    FileStamp mapped_stamp;
+    const char * const text = mapFileContents(path, length, &mapped_stamp);
+    if(text && mapped_stamp==stamp && length==this->length()){
+        const Mapping mapping = {text, length};
+        mappings.push_back(mapping);
+        release(root);
+        root = (length>0) ? allocate(text, length) : none;
+        unmapUnused();
+    }
+    else if(text){
+        unmapFileContents(text, length);
+    }
+
+    return true;
+}
+
+void PieceTable::unmapUnused(){
+    // The text only uses the newest file, so anything else is only kept for steps to undo.
+    std::vector<bool> used(mappings.size(), false);
+    used.back() = true;
+
+    std::vector<unsigned> stack;
+    for(std::deque<Step>::const_iterator i = undo_steps.begin(); i!=undo_steps.end(); i++)
+        stack.push_back(i->removed);
+    for(std::deque<Step>::const_iterator i = redo_steps.begin(); i!=redo_steps.end(); i++)
+        stack.push_back(i->removed);
+
+    while(!stack.empty()){
+        const unsigned n = stack.back();
+        stack.pop_back();
+        if(n==none)
+            continue;
+
+        const char * const text = nodes[n].text;
+        for(size_t i = 0; i<mappings.size(); i++){
+            if(text>=mappings[i].text && text<mappings[i].text+mappings[i].length){
+                used[i] = true;
+                break;
+            }
+        }
+        stack.push_back(nodes[n].left);
+        stack.push_back(nodes[n].right);
+    }
+
+    size_t kept = 0;
+    for(size_t i = 0; i<mappings.size(); i++){
+        if(used[i])
+            mappings[kept++] = mappings[i];
+        else
+            unmapFileContents(mappings[i].text, mappings[i].length);
+    }
+    mappings.resize(kept);
+}
+
+bool PieceTable::changedOnDisk(const char *path) const {
+    FileStamp current;
+    if(!stampFile(path, current) || current==stamp)
+        return false;
+
+    uLong adler_file;
+    return !fileAdler32(path, adler_file) || adler_file!=checksum();
+}
+
+uLong PieceTable::checksum() const {
+    if(!adler_known){
+        // Only the file that was loaded is mapped, and the text is still unread.
+        adler = addAdler32(adler32(0L, nullptr, 0), mappings.front().text, mappings.front().length);
+        adler_known = true;
+    }
+    return adler;
+}
+
+void PieceTable::calculateChecksum(){
+    uLong new_adler = adler32(0L, nullptr, 0);
+    forEach(0, length(), [&new_adler](const char *text, unsigned long length){
+        new_adler = addAdler32(new_adler, text, length);
+    });
+    adler = new_adler;
+    adler_known = true;
+}
+
+void PieceTable::copy(unsigned long pos, unsigned long length, char *into) const {
+    forEach(pos, pos+length, [&into](const char *text, unsigned long length){
+        memcpy(into, text, length);
+        into+=length;
+    });
+}
+
+std::string PieceTable::text(unsigned long pos, unsigned long length) const {
+    std::string that;
+    that.reserve(length);
+    forEach(pos, pos+length, [&that](const char *text, unsigned long length){
+        that.append(text, length);
+    });
+    return that;
+}
+
+}
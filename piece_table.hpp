@@ -0,0 +1,206 @@
+#pragma once
+
+#include "file_utilities.hpp"
+
+#include <zlib.h>
+
+#include <vector>
+#include <deque>
+#include <string>
+
+namespace Flare {
+
+// Text kept as a sequence of pieces, each of which is part of the file as it was opened or
+// part of a buffer that new text is only ever appended to. The file is mapped rather than
+// read, so opening one costs nothing until its text is looked at, and the text never has to
+// be in one block of memory.
+//
+// The pieces are a treap ordered by position, so finding, inserting and removing text
+// anywhere is O(log n) in the number of pieces, however far apart the edits are.
+//
+// Every change is recorded to undo. Since no text is ever overwritten, a step is just the
+// pieces that the change removed, and undoing or redoing swaps them back in.
+class PieceTable {
+public:
+
+    // Replaces `length' bytes at `pos' with `text_length' bytes of `text'.
+    struct Edit {
+        unsigned long pos, length;
+        const char *text;
+        unsigned long text_length;
+    };
+
+private:
+
+    static const unsigned none = ~0u;
+
+    struct Node {
+        const char *text;
+        // Length of this piece, and of every piece in this subtree.
+        unsigned long length, total;
+        unsigned priority;
+        unsigned left, right;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<unsigned> free_nodes;
+    unsigned root;
+    unsigned random;
+
+    unsigned long total(unsigned n) const { return (n==none) ? 0 : nodes[n].total; }
+    void update(unsigned n){ nodes[n].total = total(nodes[n].left)+nodes[n].length+total(nodes[n].right); }
+
+    unsigned allocate(const char *text, unsigned long length);
+    // Frees `n' and everything under it.
+    void release(unsigned n);
+
+    // Splits `n' into the text before `pos' and the text after it, cutting a piece in two
+    // if need be.
+    void split(unsigned n, unsigned long pos, unsigned &left, unsigned &right);
+    unsigned merge(unsigned left, unsigned right);
+    // Appends new pieces for [from, to) of the subtree `n' to the tree `into'. They share
+    // the text of the old ones.
+    unsigned copyRange(unsigned n, unsigned long from, unsigned long to, unsigned into);
+
+    // Typed text goes into chunks that are never moved, so pieces can point into them.
+    std::vector<char *> chunks;
+    char *add_end;
+    unsigned long add_left;
+    const char *append(const char *text, unsigned long length);
+    // Appends to the last piece of `n' instead, if it ends where the added text does.
+    bool extendLast(unsigned n, const char *text, unsigned long length);
+
+    // Every file mapped since the table was cleared. Steps to undo can still refer to the
+    // text of files that have since been saved over.
+    struct Mapping {
+        const char *text;
+        unsigned long length;
+    };
+    std::vector<Mapping> mappings;
+    void unmapUnused();
+
+    // The range of new text a change made, and the pieces of the text it replaced. Undoing a
+    // change swaps the two, which leaves a change that redoes it.
+    struct Step {
+        unsigned long pos, inserted, removed_length;
+        unsigned removed;
+    };
+    std::deque<Step> undo_steps, redo_steps;
+    // Whether the next change can be joined to the last step.
+    bool joinable;
+    size_t max_steps;
+
+    void record(const Step &step);
+    void swap(Step &step);
+
+    // Not known after a load until it is first needed.
+    mutable uLong adler;
+    mutable bool adler_known;
+    FileStamp stamp;
+
+    template<class F>
+    void visit(unsigned n, unsigned long from, unsigned long to, F &f) const;
+
+    static bool NextPieceCallback(void *arg, const char *&text, unsigned long &length);
+
+public:
+
+    PieceTable();
+    ~PieceTable();
+
+    unsigned long length() const { return total(root); }
+    size_t pieces() const { return nodes.size()-free_nodes.size(); }
+
+    //
+    // Files. These return false and set errno on failure.
+    //
+
+    // Replaces the text with the file, without reading it yet. The file must not be changed
+    // in place while it is open, although replacing it, as saving does, is fine.
+    bool load(const char *path);
+    // Writes the text over the file atomically, and then maps the new file, so that the
+    // text is in one piece again.
+    bool save(const char *path);
+    // Replaces the text with a copy of `text', without recording it.
+    void reset(const char *text, unsigned long length);
+
+    // True if the file is no longer what was last loaded or saved.
+    bool changedOnDisk(const char *path) const;
+    // Adler32 of the file as it was last loaded or saved, or as calculated. After a load
+    // this reads the whole file the first time it is asked for.
+    uLong checksum() const;
+    void calculateChecksum();
+
+    //
+    // Text.
+    //
+
+    // Copies `length' bytes from `pos' into `into'.
+    void copy(unsigned long pos, unsigned long length, char *into) const;
+    std::string text(unsigned long pos, unsigned long length) const;
+
+    // Calls f(const char *text, unsigned long length) for each piece of [from, to), in order.
+    template<class F>
+    void forEach(unsigned long from, unsigned long to, F f) const {
+        if(from<to)
+            visit(root, from, to, f);
+    }
+
+    //
+    // Changes, each of which is one step to undo. Typing and deleting a character at a time
+    // are joined into one step, as long as they carry on from the last change.
+    //
+
+    void replace(unsigned long pos, unsigned long length, const char *text, unsigned long text_length);
+    void insert(unsigned long pos, const char *text, unsigned long length){ replace(pos, 0, text, length); }
+    void remove(unsigned long pos, unsigned long length){ replace(pos, length, "", 0); }
+    // Makes edits that are sorted by position and don't overlap, with positions in the text
+    // as it was before any of them. The text between them isn't copied, only its pieces.
+    void apply(const std::vector<Edit> &edits);
+
+    //
+    // History.
+    //
+
+    bool canUndo() const { return !undo_steps.empty(); }
+    bool canRedo() const { return !redo_steps.empty(); }
+    // These get the range that changed: the text at `pos' that was `removed' bytes long is
+    // now `inserted' bytes long.
+    bool undo(unsigned long &pos, unsigned long &removed, unsigned long &inserted);
+    bool redo(unsigned long &pos, unsigned long &removed, unsigned long &inserted);
+    // Makes sure the next change is a step of its own.
+    void separate(){ joinable = false; }
+    void clearHistory();
+    // The oldest steps are forgotten past this many.
+    void historyLimit(size_t steps);
+
+    void clear();
+
+};
+
+template<class F>
+void PieceTable::visit(unsigned n, unsigned long from, unsigned long to, F &f) const {
+    // `from' and `to' are relative to the start of this subtree.
+    while(n!=none){
+        const unsigned long left = total(nodes[n].left);
+        if(from<left)
+            visit(nodes[n].left, from, (to<left) ? to : left, f);
+        if(to<=left)
+            return;
+
+        const unsigned long end = left+nodes[n].length;
+        if(from<end){
+            const unsigned long start = (from>left) ? from : left;
+            f(nodes[n].text+(start-left), ((to<end) ? to : end)-start);
+        }
+        if(to<=end)
+            return;
+
+        // The right subtree, as a loop rather than recursion.
+        from = (from>end) ? (from-end) : 0;
+        to-=end;
+        n = nodes[n].right;
+    }
+}
+
+}
@@ -0,0 +1,530 @@
+#include "piece_table_editor.hpp"
+#include "text_editor.hpp"
+#include "size_utilities.hpp"
+#include "search.hpp"
+
+#include <FL/Fl.H>
+#include <FL/fl_ask.H>
+
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+namespace Flare {
+
+// How much of the text the widget is given at once, and how close the view can get to either
+// end of that before the window is moved.
+#define WINDOW_SIZE 0x400000
+#define WINDOW_MARGIN 0x80000
+
+// How much text is searched at once. Find All searches this much each time FLTK is idle.
+#define SEARCH_CHUNK 0x800000
+// Regular expressions are given this much text past each chunk, so that matches can run
+// past the end of it. Longer matches are cut short or missed.
+#define REGEX_OVERLAP 0x10000
+
+PieceTableEditor::PieceTableEditor(int x, int y, int w, int h)
+  : Editor(x, y, w, h)
+  , window(WINDOW_SIZE, WINDOW_MARGIN, TableLengthCallback, TableCopyCallback, &table)
+  , view(*this, x, y, w, h)
+  , scanned(0)
+  , scanning(false){
+
+    window.buffer().add_modify_callback(WindowModifiedCallback, this);
+    window.attach(view);
+    view.textfont(FL_SCREEN);
+
+    holder.resizable(view);
+    holder.end();
+}
+
+PieceTableEditor::~PieceTableEditor(){
+    Fl::remove_idle(ScanCallback, this);
+    window.buffer().remove_modify_callback(WindowModifiedCallback, this);
+}
+
+int PieceTableEditor::View::handle(int e){
+    const int that = Text_Editor_Widget::handle(e);
+    owner.follow();
+    return that;
+}
+
+unsigned long PieceTableEditor::TableLengthCallback(const void *a){
+    return static_cast<const PieceTable *>(a)->length();
+}
+
+void PieceTableEditor::TableCopyCallback(unsigned long at, unsigned long length, char *into, const void *a){
+    static_cast<const PieceTable *>(a)->copy(at, length, into);
+}
+
+void PieceTableEditor::WindowModifiedCallback(int pos, int inserted, int deleted, int restyled, const char *deleted_text, void *a){
+    PieceTableEditor * const that = static_cast<PieceTableEditor *>(a);
+    if(that->window.mirroring() || (inserted==0 && deleted==0))
+        return;
+
+    std::string text;
+    if(inserted>0){
+        const TextSpans spans = that->window.buffer().spans();
+        text.reserve(inserted);
+        for(int i = pos; i<pos+inserted; i++)
+            text.push_back(spans.at(i));
+    }
+
+    that->table.replace(that->window.start()+pos, deleted, text.data(), text.size());
+    that->clearMatches();
+}
+
+void PieceTableEditor::follow(){
+    window.follow(view.firstVisible(), view.lastVisible());
+}
+
+void PieceTableEditor::showChange(unsigned long pos, unsigned long removed, unsigned long inserted){
+    clearMatches();
+    window.mirror(pos, removed, inserted);
+    view.insert_position(pos+inserted-window.start());
+    view.show_insert_position();
+}
+
+void PieceTableEditor::undo(){
+    unsigned long pos, removed, inserted;
+    if(table.undo(pos, removed, inserted))
+        showChange(pos, removed, inserted);
+}
+
+void PieceTableEditor::redo(){
+    unsigned long pos, removed, inserted;
+    if(table.redo(pos, removed, inserted))
+        showChange(pos, removed, inserted);
+}
+
+void PieceTableEditor::info() const {
+    char buffer[8];
+    unsigned long long s = table.length();
+    fl_alert("Editor information:\npath: %s\nFilesize: %s %cB\nPieces: %lu\nAdler32 Checksum: %lu\n",
+        path().c_str(), sizeNumberString(buffer, s), sizePrefixChar(s), (unsigned long)table.pieces(), table.checksum());
+}
+
+bool PieceTableEditor::load(){
+    if(!table.load(path_.c_str())){
+        fl_alert("Cannot open file %s\n%s", path_.c_str(), strerror(errno));
+        return false;
+    }
+
+    clearMatches();
+    window.show(0);
+    view.insert_position(0);
+    view.scroll(1, 0);
+    return true;
+}
+
+bool PieceTableEditor::save(){
+    if(table.changedOnDisk(path_.c_str())){
+        if(!fl_choice("File %s was changed outside of the editor. Would you like to save anyway?",
+            fl_cancel, fl_yes, nullptr, path_.c_str()))
+            return false;
+    }
+
+    if(!table.save(path_.c_str())){
+        fl_alert("Could not save file %s\n%s", path_.c_str(), strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+long PieceTableEditor::findText(const Searcher &searcher, unsigned long from, unsigned long to) const {
+    const unsigned long n = searcher.length(), length = table.length();
+    if(n==0)
+        return -1;
+
+    // Each chunk has the text that a match starting in it could run into.
+    while(from<to){
+        const unsigned long chunk_end = (to-from>SEARCH_CHUNK) ? (from+SEARCH_CHUNK) : to;
+        const unsigned long text_end = (length-chunk_end>n-1) ? (chunk_end+n-1) : length;
+        const std::string text = table.text(from, text_end-from);
+        const TextSpans spans = {text.data(), text.size(), nullptr, 0};
+
+        const long at = searcher.find(spans, 0, chunk_end-from);
+        if(at>=0)
+            return from+at;
+        from = chunk_end;
+    }
+    return -1;
+}
+
+long PieceTableEditor::findLastText(const Searcher &searcher, unsigned long from, unsigned long to) const {
+    const unsigned long n = searcher.length(), length = table.length();
+    if(n==0)
+        return -1;
+
+    while(from<to){
+        const unsigned long chunk_start = (to-from>SEARCH_CHUNK) ? (to-SEARCH_CHUNK) : from;
+        const unsigned long text_end = (length-to>n-1) ? (to+n-1) : length;
+        const std::string text = table.text(chunk_start, text_end-chunk_start);
+        const TextSpans spans = {text.data(), text.size(), nullptr, 0};
+
+        const long at = searcher.findLast(spans, 0, to-chunk_start);
+        if(at>=0)
+            return chunk_start+at;
+        to = chunk_start;
+    }
+    return -1;
+}
+
+bool PieceTableEditor::findRegexIn(unsigned long from, unsigned long to, unsigned long &start, unsigned long &end) const {
+    const unsigned long length = table.length();
+
+    // Each chunk also has the byte before it, so ^ knows whether it is at the start of a line.
+    while(from<to){
+        const unsigned long chunk_end = (to-from>SEARCH_CHUNK) ? (from+SEARCH_CHUNK) : to;
+        const unsigned long text_start = (from>0) ? (from-1) : 0;
+        const unsigned long text_end = (length-chunk_end>REGEX_OVERLAP) ? (chunk_end+REGEX_OVERLAP) : length;
+        const std::string text = table.text(text_start, text_end-text_start);
+        const TextSpans spans = {text.data(), text.size(), nullptr, 0};
+
+        if(regex.find(spans, from-text_start, chunk_end-text_start, start, end)){
+            start+=text_start;
+            end+=text_start;
+            return true;
+        }
+        from = chunk_end;
+    }
+    return false;
+}
+
+bool PieceTableEditor::findLastRegexIn(unsigned long from, unsigned long to, unsigned long &start, unsigned long &end) const {
+    const unsigned long length = table.length();
+
+    while(from<to){
+        const unsigned long chunk_start = (to-from>SEARCH_CHUNK) ? (to-SEARCH_CHUNK) : from;
+        const unsigned long text_start = (chunk_start>0) ? (chunk_start-1) : 0;
+        const unsigned long text_end = (length-to>REGEX_OVERLAP) ? (to+REGEX_OVERLAP) : length;
+        const std::string text = table.text(text_start, text_end-text_start);
+        const TextSpans spans = {text.data(), text.size(), nullptr, 0};
+
+        if(regex.findLast(spans, chunk_start-text_start, to-text_start, start, end)){
+            start+=text_start;
+            end+=text_start;
+            return true;
+        }
+        to = chunk_start;
+    }
+    return false;
+}
+
+void PieceTableEditor::find(const char *text){
+    last_find = text;
+    last_find_regex = false;
+    const Searcher searcher(last_find);
+
+    // Start from the cursor, which is left at the end of the last match, and wrap around.
+    const unsigned long from = cursor();
+    long at = findText(searcher, from, table.length());
+    if(at<0)
+        at = findText(searcher, 0, from);
+    if(at<0){
+        notFound(text);
+        return;
+    }
+
+    showMatch(at, searcher.length());
+}
+
+void PieceTableEditor::findAll(const char *text){
+    clearMatches();
+
+    last_find = text;
+    last_find_regex = false;
+    if(last_find.empty())
+        return;
+
+    scanning = true;
+    Fl::add_idle(ScanCallback, this);
+}
+
+void PieceTableEditor::ScanCallback(void *a){
+    PieceTableEditor * const that = static_cast<PieceTableEditor *>(a);
+    const Searcher searcher(that->last_find);
+    const unsigned long n = searcher.length(), length = that->table.length();
+
+    const unsigned long to = (length-that->scanned>SEARCH_CHUNK) ? (that->scanned+SEARCH_CHUNK) : length;
+    const unsigned long text_end = (length-to>n-1) ? (to+n-1) : length;
+    const std::string text = that->table.text(that->scanned, text_end-that->scanned);
+    const TextSpans spans = {text.data(), text.size(), nullptr, 0};
+
+    // Matches can overlap, as with the text editor.
+    long at = 0;
+    while((at = searcher.find(spans, at, to-that->scanned))>=0){
+        that->matches.push_back(that->scanned+at);
+        at++;
+    }
+
+    that->scanned = to;
+    if(to==length){
+        that->scanning = false;
+        Fl::remove_idle(ScanCallback, a);
+    }
+}
+
+void PieceTableEditor::clearMatches(){
+    if(!scanning && matches.empty() && scanned==0)
+        return;
+
+    Fl::remove_idle(ScanCallback, this);
+    scanning = false;
+    matches.clear();
+    scanned = 0;
+}
+
+void PieceTableEditor::findNext(){
+    if(last_find_regex){
+        findRegex(last_find.c_str());
+        return;
+    }
+    if(matches.empty()){
+        if(!last_find.empty())
+            find(last_find.c_str());
+        return;
+    }
+
+    // The first match that starts at or after the cursor, which is the next one if the
+    // cursor is at the end of a match.
+    std::vector<unsigned long>::const_iterator i = std::lower_bound(matches.begin(), matches.end(), cursor());
+    if(i==matches.end()){
+        if(scanning){
+            find(last_find.c_str());
+            return;
+        }
+        i = matches.begin();
+    }
+    showMatch(*i, last_find.size());
+}
+
+void PieceTableEditor::findPrevious(){
+    if(last_find.empty())
+        return;
+
+    const unsigned long at = cursor(), n = last_find.size();
+
+    if(last_find_regex){
+        findPreviousRegex(at);
+        return;
+    }
+
+    // Skip the match the cursor is at the end of.
+    const unsigned long before = (at>=n) ? (at-n) : 0;
+
+    if(matches.empty()){
+        const Searcher searcher(last_find);
+        long found = findLastText(searcher, 0, before);
+        if(found<0)
+            found = findLastText(searcher, before, table.length());
+        if(found<0){
+            notFound(last_find.c_str());
+            return;
+        }
+        showMatch(found, n);
+        return;
+    }
+
+    std::vector<unsigned long>::const_iterator i = std::lower_bound(matches.begin(), matches.end(), before);
+    if(i==matches.begin()){
+        if(scanning)
+            return;
+        i = matches.end();
+    }
+    showMatch(*(i-1), n);
+}
+
+void PieceTableEditor::replace(const char *text, const char *replacement){
+    const Searcher searcher(text, strlen(text));
+    const unsigned long n = searcher.length(), at = view.insert_position();
+
+    // The match was shown, so it is in the window.
+    if(n>0 && at>=n && searcher.matchesAt(window.buffer().spans(), at-n)){
+        window.buffer().replace(at-n, at, replacement);
+        view.insert_position(at-n+strlen(replacement));
+    }
+
+    find(text);
+}
+
+unsigned long PieceTableEditor::replaceAll(const char *text, const char *replacement){
+    const Searcher searcher(text, strlen(text));
+    const unsigned long n = searcher.length(), replacement_length = strlen(replacement);
+    if(n==0)
+        return 0;
+
+    // As in findText, but every match in each chunk.
+    std::vector<PieceTable::Edit> edits;
+    const unsigned long length = table.length();
+    unsigned long from = 0;
+    while(from<length){
+        const unsigned long chunk_end = (length-from>SEARCH_CHUNK) ? (from+SEARCH_CHUNK) : length;
+        const unsigned long text_end = (length-chunk_end>n-1) ? (chunk_end+n-1) : length;
+        const std::string text = table.text(from, text_end-from);
+        const TextSpans spans = {text.data(), text.size(), nullptr, 0};
+
+        unsigned long next = 0;
+        long at;
+        while((at = searcher.find(spans, next, chunk_end-from))>=0){
+            const PieceTable::Edit edit = {from+at, n, replacement, replacement_length};
+            edits.push_back(edit);
+            next = at+n;
+        }
+        // A match can run past the chunk, so the next one starts after it.
+        from = (from+next>chunk_end) ? (from+next) : chunk_end;
+    }
+
+    // All at once, so that it is a single step to undo.
+    table.apply(edits);
+    clearMatches();
+    window.move(window.start()+view.firstVisible());
+    return edits.size();
+}
+
+void PieceTableEditor::findRegex(const char *pattern){
+    if(!compileRegex(pattern))
+        return;
+    last_find = pattern;
+    last_find_regex = true;
+
+    const unsigned long from = cursor();
+    unsigned long start, end;
+    if(!findRegexIn(from, table.length(), start, end) && !findRegexIn(0, from, start, end)){
+        notFound(pattern);
+        return;
+    }
+
+    regex_match_start = start;
+    showMatch(start, end-start);
+}
+
+bool PieceTableEditor::findLastRegex(unsigned long before, unsigned long &start, unsigned long &end) const {
+    return findLastRegexIn(0, before, start, end) || findLastRegexIn(before, table.length(), start, end);
+}
+
+bool PieceTableEditor::regexMatches(unsigned long start, unsigned long end) const {
+    // Only matches that fit in the overlap are looked for, as when searching.
+    if(end-start>REGEX_OVERLAP)
+        return false;
+    const std::string text = table.text(start, end-start);
+    const TextSpans spans = {text.data(), text.size(), nullptr, 0};
+    return regex.matchAt(spans, 0)==(long)text.size();
+}
+
+void PieceTableEditor::replaceRegex(const char *pattern, const char *replacement){
+    if(!compileRegex(pattern))
+        return;
+
+    // Only replace the match the last find stopped at, and only if it would still match
+    // exactly the same text. It was shown, so it is in the window.
+    const TextSpans spans = window.buffer().spans();
+    const unsigned long at = view.insert_position();
+    if(last_find_regex && last_find==pattern && regex_match_start>=window.start()){
+        const unsigned long start = regex_match_start-window.start();
+        if(start<at && regex.matchAt(spans, start)==(long)at){
+            std::vector<long> groups;
+            regex.captures(spans, start, at, groups);
+            std::string text;
+            Regex::expand(replacement, spans, groups, text);
+
+            window.buffer().replace(start, at, text.c_str());
+            view.insert_position(start+text.size());
+        }
+    }
+
+    findRegex(pattern);
+}
+
+unsigned long PieceTableEditor::replaceAllRegex(const char *pattern, const char *replacement){
+    if(!compileRegex(pattern))
+        return 0;
+
+    const bool use_groups = Regex::usesGroups(replacement);
+    const unsigned long length = table.length();
+
+    // As in findRegexIn, but every match in each chunk, expanded while its text is at hand.
+    // The edits can only point into the replacements once they have stopped growing.
+    std::vector<unsigned long> bounds, offsets;
+    std::string replacements;
+    std::vector<long> groups;
+
+    unsigned long from = 0;
+    while(from<length){
+        const unsigned long chunk_end = (length-from>SEARCH_CHUNK) ? (from+SEARCH_CHUNK) : length;
+        const unsigned long text_start = (from>0) ? (from-1) : 0;
+        const unsigned long text_end = (length-chunk_end>REGEX_OVERLAP) ? (chunk_end+REGEX_OVERLAP) : length;
+        const std::string text = table.text(text_start, text_end-text_start);
+        const TextSpans spans = {text.data(), text.size(), nullptr, 0};
+
+        unsigned long at = from-text_start, start, end;
+        while(regex.find(spans, at, chunk_end-text_start, start, end)){
+            if(use_groups)
+                regex.captures(spans, start, end, groups);
+            offsets.push_back(replacements.size());
+            Regex::expand(replacement, spans, groups, replacements);
+            bounds.push_back(text_start+start);
+            bounds.push_back(text_start+end);
+            at = end;
+        }
+        // A match can run past the chunk, so the next one starts after it.
+        from = (text_start+at>chunk_end) ? (text_start+at) : chunk_end;
+    }
+    offsets.push_back(replacements.size());
+
+    const unsigned long count = bounds.size()/2;
+    std::vector<PieceTable::Edit> edits;
+    edits.reserve(count);
+    for(unsigned long i = 0; i<count; i++){
+        const PieceTable::Edit edit = {bounds[i*2], bounds[i*2+1]-bounds[i*2],
+            replacements.data()+offsets[i], offsets[i+1]-offsets[i]};
+        edits.push_back(edit);
+    }
+
+    table.apply(edits);
+    clearMatches();
+    window.move(window.start()+view.firstVisible());
+    return count;
+}
+
+unsigned long PieceTableEditor::matchCount(bool &complete) const {
+    complete = !scanning;
+    return matches.size();
+}
+
+std::shared_ptr<const std::string> PieceTableEditor::snapshot() const {
+    return std::make_shared<const std::string>(table.text(0, table.length()));
+}
+
+void PieceTableEditor::goToLine(unsigned long line){
+    // Count newlines a piece at a time, until the one before the line.
+    unsigned long left = (line>0) ? (line-1) : 0, pos = 0, at = 0;
+    table.forEach(0, table.length(), [&left, &pos, &at](const char *text, unsigned long length){
+        const char *from = text, * const end = text+length;
+        while(left>0 && (from = (const char *)memchr(from, '\n', end-from))!=nullptr){
+            from++;
+            left--;
+            at = pos+(from-text);
+        }
+        pos+=length;
+    });
+
+    window.showLine(at);
+    view.insert_position(at-window.start());
+    follow();
+}
+
+void PieceTableEditor::calculateAdler32(){
+    table.calculateChecksum();
+}
+
+const Fl_Menu_Item *PieceTableEditor::prepareMenu(void(*OpenCallback_)(Fl_Widget *, void *a), void(*FindCallback_)(Fl_Widget *, void *a), void *arg_) const{
+    return TextEditor::PrepareMenu(this, OpenCallback_, FindCallback_, arg_);
+}
+
+Editor *PieceTableEditor::CreatePieceTableEditor(int x, int y, int w, int h){
+    return new PieceTableEditor(x, y, w, h);
+}
+
+} // namespace Flare
@@ -0,0 +1,116 @@
+#pragma once
+#include "editor.hpp"
+
+#include "flare_text_editor_widget.hpp"
+#include "text_window.hpp"
+#include "piece_table.hpp"
+
+#include <vector>
+#include <string>
+#include <memory>
+
+namespace Flare {
+
+class Searcher;
+
+// An editor that keeps the text in a PieceTable instead of a gap buffer, for files too big to
+// edit comfortably in one block of memory. The file is mapped rather than read, and edits
+// anywhere in it cost the same.
+//
+// FLTK can only show text that is in an Fl_Text_Buffer, so the widget is given a window of a
+// few megabytes of the text around where it is looking, and the window is moved as the view
+// gets near either end of it. Edits in the window are made to the table as they happen.
+// Undo is the table's, so it covers the whole file, not just the window.
+//
+// Find All counts the matches and steps through them, but doesn't colour them.
+class PieceTableEditor : public Editor {
+
+    // The widget, which tells the editor when it has moved, and whose undo is the table's.
+    class View : public Text_Editor_Widget {
+        PieceTableEditor &owner;
+    public:
+        View(PieceTableEditor &o, int x, int y, int w, int h)
+          : Text_Editor_Widget(x, y, w, h)
+          , owner(o){}
+
+        int handle(int e) override;
+
+        void undo() override { owner.undo(); }
+        void redo() override { owner.redo(); }
+        void earlier() override { owner.undo(); }
+        void later() override { owner.redo(); }
+
+        // The first and last characters that can be seen.
+        int firstVisible() const { return mFirstChar; }
+        int lastVisible() const { return mLastChar; }
+    };
+
+    PieceTable table;
+
+    // Declared before the view, which still refers to it while being destroyed.
+    TextWindow window;
+    View view;
+
+    static unsigned long TableLengthCallback(const void *a);
+    static void TableCopyCallback(unsigned long at, unsigned long length, char *into, const void *a);
+    static void WindowModifiedCallback(int pos, int inserted, int deleted, int restyled, const char *deleted_text, void *a);
+
+    // Moves the window along when the view gets near either end of it.
+    void follow();
+
+    // Shows a change made by undoing or redoing.
+    void showChange(unsigned long pos, unsigned long removed, unsigned long inserted);
+    void undo();
+    void redo();
+
+    // Searching goes over the table a chunk at a time. Positions are in the whole text.
+    long findText(const Searcher &searcher, unsigned long from, unsigned long to) const;
+    long findLastText(const Searcher &searcher, unsigned long from, unsigned long to) const;
+    bool findRegexIn(unsigned long from, unsigned long to, unsigned long &start, unsigned long &end) const;
+    bool findLastRegexIn(unsigned long from, unsigned long to, unsigned long &start, unsigned long &end) const;
+
+    // Matches from Find All, found a chunk at a time whenever FLTK is idle.
+    std::vector<unsigned long> matches;
+    unsigned long scanned;
+    bool scanning;
+    static void ScanCallback(void *a);
+
+    // Where the cursor is, in the whole text.
+    unsigned long cursor() const { return window.cursor(); }
+
+    unsigned long textLength() const override { return table.length(); }
+    void showMatch(unsigned long at, unsigned long length) override { window.showMatch(at, length); }
+    bool findLastRegex(unsigned long before, unsigned long &start, unsigned long &end) const override;
+    bool regexMatches(unsigned long start, unsigned long end) const override;
+
+public:
+    const Fl_Menu_Item *prepareMenu(void(*OpenCallback_)(Fl_Widget *, void *a) = nullptr, void(*FindCallback_)(Fl_Widget *, void *a) = nullptr, void *arg_ = nullptr) const override;
+
+    PieceTableEditor(int x, int y, int w, int h);
+    virtual ~PieceTableEditor();
+
+    void info() const override;
+    bool save() override;
+    bool load() override;
+
+    void find(const char *) override;
+    void findAll(const char *) override;
+    void clearMatches() override;
+    void findNext() override;
+    void findPrevious() override;
+    void replace(const char *text, const char *replacement) override;
+    unsigned long replaceAll(const char *text, const char *replacement) override;
+    void findRegex(const char *) override;
+    void replaceRegex(const char *pattern, const char *replacement) override;
+    unsigned long replaceAllRegex(const char *pattern, const char *replacement) override;
+    unsigned long matchCount(bool &complete) const override;
+    std::shared_ptr<const std::string> snapshot() const override;
+    void goToLine(unsigned long line) override;
+
+    void calculateAdler32() override;
+
+    static Editor *CreatePieceTableEditor(int x, int y, int w, int h);
+
+};
+
+}
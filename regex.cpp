@@ -0,0 +1,894 @@
+#include "regex.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+namespace Flare {
+
+// Keeps both the size of compiled patterns and the memory used by the DFA in check.
+static const unsigned max_program_size = 0x4000;
+static const unsigned max_dfa_states = 0x1000;
+
+// Step::order for the usual cases, where the groups are kept as they are, one is added at
+// the end, or none are left.
+static const int kept_groups = -1, added_group = -2, no_groups = -3;
+
+// How far findLast looks back at a time.
+static const unsigned long backwards_window = 0x100000;
+
+typedef std::vector<Regex::Inst> Fragment;
+
+// Appends one fragment of a program to another, moving its jump targets along with it.
+// A target one past the end of a fragment means whatever comes after it.
+static void appendFragment(Fragment &to, const Fragment &from){
+    const int offset = to.size();
+    for(Fragment::const_iterator i = from.begin(); i!=from.end(); i++){
+        Regex::Inst inst = *i;
+        if(inst.op==Regex::Split){
+            inst.x+=offset;
+            inst.y+=offset;
+        }
+        else if(inst.op==Regex::Jump)
+            inst.x+=offset;
+        to.push_back(inst);
+    }
+}
+
+static Regex::Inst makeInst(Regex::Op op, int x = 0, int y = 0){
+    const Regex::Inst inst = {op, x, y};
+    return inst;
+}
+
+namespace {
+
+class Parser {
+
+    const char *at;
+    std::vector<std::bitset<0x100> > &classes;
+    unsigned &groups;
+    std::string &error;
+    std::string &prefix;
+    bool prefix_open;
+
+    int addClass(const std::bitset<0x100> &set){
+        classes.push_back(set);
+        return classes.size()-1;
+    }
+
+    bool tooLarge(const Fragment &f){
+        if(f.size()<=max_program_size)
+            return false;
+        error = "Pattern is too large";
+        return true;
+    }
+
+    static int hexValue(char c){
+        if(c>='0' && c<='9') return c-'0';
+        if(c>='a' && c<='f') return c-'a'+10;
+        if(c>='A' && c<='F') return c-'A'+10;
+        return -1;
+    }
+
+    // Parses the escape after a backslash. Sets either `literal' to a byte, or `set' to a class.
+    bool escape(std::bitset<0x100> &set, int &literal){
+        literal = -1;
+        set.reset();
+        const char c = *at;
+        if(c==0){
+            error = "Trailing backslash";
+            return false;
+        }
+        at++;
+
+        switch(c){
+            case 'd': case 'D':
+                for(int i = '0'; i<='9'; i++) set.set(i);
+                if(c=='D') set.flip();
+                return true;
+            case 'w': case 'W':
+                for(int i = 'a'; i<='z'; i++) set.set(i);
+                for(int i = 'A'; i<='Z'; i++) set.set(i);
+                for(int i = '0'; i<='9'; i++) set.set(i);
+                set.set('_');
+                if(c=='W') set.flip();
+                return true;
+            case 's': case 'S':
+                set.set(' '); set.set('\t'); set.set('\n'); set.set('\r'); set.set('\f'); set.set('\v');
+                if(c=='S') set.flip();
+                return true;
+            case 'n': literal = '\n'; return true;
+            case 't': literal = '\t'; return true;
+            case 'r': literal = '\r'; return true;
+            case 'f': literal = '\f'; return true;
+            case 'v': literal = '\v'; return true;
+            case 'x':{
+                const int high = hexValue(at[0]), low = (high<0) ? -1 : hexValue(at[1]);
+                if(low<0){
+                    error = "Bad \\x escape";
+                    return false;
+                }
+                at+=2;
+                literal = (high<<4)|low;
+                return true;
+            }
+            default:
+                literal = (unsigned char)c;
+                return true;
+        }
+    }
+
+    bool bracket(std::bitset<0x100> &set){
+        set.reset();
+        bool negate = false;
+        if(*at=='^'){
+            negate = true;
+            at++;
+        }
+
+        bool first = true;
+        while(first || *at!=']'){
+            first = false;
+            if(*at==0){
+                error = "Missing ]";
+                return false;
+            }
+
+            int low;
+            if(*at=='\\'){
+                at++;
+                std::bitset<0x100> escaped;
+                if(!escape(escaped, low))
+                    return false;
+                if(low<0){
+                    set|=escaped;
+                    continue;
+                }
+            }
+            else
+                low = (unsigned char)*at++;
+
+            int high = low;
+            if(at[0]=='-' && at[1]!=']' && at[1]!=0){
+                at++;
+                if(*at=='\\'){
+                    at++;
+                    std::bitset<0x100> escaped;
+                    if(!escape(escaped, high))
+                        return false;
+                    if(high<0){
+                        error = "Bad range in []";
+                        return false;
+                    }
+                }
+                else
+                    high = (unsigned char)*at++;
+
+                if(high<low){
+                    error = "Bad range in []";
+                    return false;
+                }
+            }
+
+            for(int i = low; i<=high; i++)
+                set.set(i);
+        }
+        at++;
+
+        if(negate)
+            set.flip();
+        return true;
+    }
+
+    // `literal' is set to the byte if the atom is a single plain byte.
+    bool atom(Fragment &out, int depth, int &literal){
+        literal = -1;
+        std::bitset<0x100> set;
+
+        switch(*at){
+            case '(':{
+                at++;
+                bool capture = true;
+                if(at[0]=='?' && at[1]==':'){
+                    capture = false;
+                    at+=2;
+                }
+                const unsigned group = capture ? ++groups : 0;
+
+                Fragment inner;
+                if(!alternation(inner, depth+1))
+                    return false;
+                if(*at!=')'){
+                    error = "Missing )";
+                    return false;
+                }
+                at++;
+
+                if(capture){
+                    out.push_back(makeInst(Regex::Save, group*2));
+                    appendFragment(out, inner);
+                    out.push_back(makeInst(Regex::Save, group*2+1));
+                }
+                else
+                    out = inner;
+                return true;
+            }
+            case '[':
+                at++;
+                if(!bracket(set))
+                    return false;
+                out.push_back(makeInst(Regex::Class, addClass(set)));
+                return true;
+            case '.':
+                at++;
+                set.set();
+                set.reset('\n');
+                out.push_back(makeInst(Regex::Class, addClass(set)));
+                return true;
+            case '^':
+                at++;
+                out.push_back(makeInst(Regex::LineStart));
+                return true;
+            case '$':
+                at++;
+                out.push_back(makeInst(Regex::LineEnd));
+                return true;
+            case '*': case '+': case '?':
+                error = "Nothing to repeat";
+                return false;
+            case '\\':
+                at++;
+                if(!escape(set, literal))
+                    return false;
+                break;
+            default:
+                literal = (unsigned char)*at++;
+        }
+
+        if(literal>=0)
+            set.set(literal);
+        out.push_back(makeInst(Regex::Class, addClass(set)));
+        return true;
+    }
+
+    // Reads {m}, {m,} or {m,n}. Leaves `at' alone if it isn't one, so { can be a literal.
+    bool counts(int &low, int &high){
+        const char *p = at+1;
+        if(*p<'0' || *p>'9')
+            return false;
+        low = strtol(p, (char **)&p, 10);
+        high = low;
+        if(*p==','){
+            p++;
+            if(*p>='0' && *p<='9')
+                high = strtol(p, (char **)&p, 10);
+            else
+                high = -1;
+        }
+        if(*p!='}')
+            return false;
+        at = p+1;
+        return true;
+    }
+
+    bool quantifiers(Fragment &piece, bool &quantified){
+        quantified = false;
+        while(true){
+            int low, high;
+            const char c = *at;
+            if(c=='*'){ low = 0; high = -1; at++; }
+            else if(c=='+'){ low = 1; high = -1; at++; }
+            else if(c=='?'){ low = 0; high = 1; at++; }
+            else if(c=='{' && counts(low, high)){
+                if((high>=0 && high<low) || low>1000 || high>1000){
+                    error = "Bad repeat count";
+                    return false;
+                }
+            }
+            else
+                return true;
+
+            bool greedy = true;
+            if(*at=='?'){
+                greedy = false;
+                at++;
+            }
+
+            quantified = true;
+            const Fragment single = piece;
+            const int n = single.size();
+            piece.clear();
+
+            for(int i = 0; i<low; i++){
+                appendFragment(piece, single);
+                if(tooLarge(piece))
+                    return false;
+            }
+
+            if(high<0){
+                // x* is: Split(x, end) x Jump(Split)
+                Fragment star;
+                star.push_back(greedy ? makeInst(Regex::Split, 1, n+2) : makeInst(Regex::Split, n+2, 1));
+                appendFragment(star, single);
+                star.push_back(makeInst(Regex::Jump, 0));
+                appendFragment(piece, star);
+            }
+            else for(int i = low; i<high; i++){
+                // Each optional copy is: Split(x, end) x
+                Fragment optional;
+                optional.push_back(greedy ? makeInst(Regex::Split, 1, n+1) : makeInst(Regex::Split, n+1, 1));
+                appendFragment(optional, single);
+                appendFragment(piece, optional);
+                if(tooLarge(piece))
+                    return false;
+            }
+            if(tooLarge(piece))
+                return false;
+        }
+    }
+
+    bool concat(Fragment &out, int depth){
+        while(*at && *at!='|' && *at!=')'){
+            Fragment piece;
+            int literal;
+            bool quantified;
+            if(!atom(piece, depth, literal) || !quantifiers(piece, quantified))
+                return false;
+
+            // Every match starts with the plain bytes at the start of the pattern.
+            if(depth==0 && prefix_open){
+                if(literal>=0 && !quantified)
+                    prefix+=(char)literal;
+                else
+                    prefix_open = false;
+            }
+
+            appendFragment(out, piece);
+            if(tooLarge(out))
+                return false;
+        }
+        return true;
+    }
+
+    bool alternation(Fragment &out, int depth){
+        Fragment left;
+        if(!concat(left, depth))
+            return false;
+
+        while(*at=='|'){
+            at++;
+            if(depth==0){
+                prefix.clear();
+                prefix_open = false;
+            }
+
+            Fragment right;
+            if(!concat(right, depth))
+                return false;
+
+            // Split(left, right) left Jump(end) right
+            Fragment both;
+            both.push_back(makeInst(Regex::Split, 1, left.size()+2));
+            appendFragment(both, left);
+            both.push_back(makeInst(Regex::Jump, left.size()+2+right.size()));
+            appendFragment(both, right);
+            if(tooLarge(both))
+                return false;
+            left.swap(both);
+        }
+
+        out.swap(left);
+        return true;
+    }
+
+public:
+
+    Parser(const char *pattern, std::vector<std::bitset<0x100> > &c, unsigned &g, std::string &e, std::string &p)
+      : at(pattern), classes(c), groups(g), error(e), prefix(p), prefix_open(true){}
+
+    bool parse(Fragment &out){
+        if(!alternation(out, 0))
+            return false;
+        if(*at){
+            error = "Unmatched )";
+            return false;
+        }
+        return true;
+    }
+
+};
+
+} // namespace
+
+Regex::Regex()
+  : groups(0)
+  , generation(0){
+    resetDFA();
+}
+
+Regex::Regex(const Regex &other)
+  : program(other.program)
+  , classes(other.classes)
+  , groups(other.groups)
+  , prefix(other.prefix)
+  , prefix_searcher(other.prefix_searcher)
+  , generation(0){
+    resetDFA();
+}
+
+Regex &Regex::operator=(const Regex &other){
+    program = other.program;
+    classes = other.classes;
+    groups = other.groups;
+    prefix = other.prefix;
+    prefix_searcher = other.prefix_searcher;
+    resetDFA();
+    return *this;
+}
+
+bool Regex::compile(const char *pattern, std::string &error){
+    Fragment compiled;
+    std::vector<std::bitset<0x100> > new_classes;
+    unsigned new_groups = 0;
+    std::string new_prefix;
+
+    Parser parser(pattern, new_classes, new_groups, error, new_prefix);
+    if(!parser.parse(compiled))
+        return false;
+
+    compiled.push_back(makeInst(Match));
+
+    program.swap(compiled);
+    classes.swap(new_classes);
+    groups = new_groups;
+    prefix.swap(new_prefix);
+    if(prefix.empty())
+        prefix_searcher.reset();
+    else
+        prefix_searcher = std::make_shared<Searcher>(prefix);
+
+    resetDFA();
+    return true;
+}
+
+void Regex::resetDFA() const {
+    states.clear();
+    steps.clear();
+    orders.clear();
+    order_ids.clear();
+    state_ids.clear();
+    start_states[0][0] = start_states[0][1] = start_states[1][0] = start_states[1][1] = -1;
+    generation++;
+    can_start_ready = false;
+}
+
+int Regex::addState(const std::vector<std::vector<int> > &groups, bool line_start, bool last) const {
+    const StateKey key(groups, (line_start ? 1 : 0)|(last ? 2 : 0));
+    const std::map<StateKey, int>::const_iterator found = state_ids.find(key);
+    if(found!=state_ids.end())
+        return found->second;
+
+    // Start over rather than let a pathological pattern use unbounded memory.
+    if(states.size()>=max_dfa_states)
+        resetDFA();
+
+    const State state = {groups, line_start, last, -2};
+    states.push_back(state);
+    const Step unknown = {-1, -1, 0};
+    steps.resize(states.size()*0x200, unknown);
+
+    const int id = states.size()-1;
+    state_ids[key] = id;
+    return id;
+}
+
+int Regex::addOrder(const std::vector<int> &order) const {
+    const std::map<std::vector<int>, int>::const_iterator found = order_ids.find(order);
+    if(found!=order_ids.end())
+        return found->second;
+
+    orders.push_back(order);
+    const int id = orders.size()-1;
+    order_ids[order] = id;
+    return id;
+}
+
+void Regex::closure(const std::vector<int> &pcs, bool line_start, bool line_end, std::vector<int> &into, bool &matched) const {
+    into.clear();
+    matched = false;
+
+    std::vector<char> seen(program.size(), 0);
+    std::vector<int> stack(pcs.rbegin(), pcs.rend());
+    while(!stack.empty()){
+        const int pc = stack.back();
+        stack.pop_back();
+        if(seen[pc])
+            continue;
+        seen[pc] = 1;
+
+        const Inst &inst = program[pc];
+        switch(inst.op){
+            case Class:
+                into.push_back(pc);
+                break;
+            case Match:
+                matched = true;
+                break;
+            case Split:
+                stack.push_back(inst.y);
+                stack.push_back(inst.x);
+                break;
+            case Jump:
+                stack.push_back(inst.x);
+                break;
+            case Save:
+                stack.push_back(pc+1);
+                break;
+            case LineStart:
+                if(line_start)
+                    stack.push_back(pc+1);
+                break;
+            case LineEnd:
+                if(line_end)
+                    stack.push_back(pc+1);
+                break;
+        }
+    }
+}
+
+Regex::Step Regex::transition(int state, unsigned char c, bool start) const {
+    const unsigned long index = (state*0x100ul+c)*2+(start ? 1 : 0);
+    if(steps[index].next>=0)
+        return steps[index];
+
+    // Copied, since adding a state can move or clear the others.
+    std::vector<std::vector<int> > groups = states[state].groups;
+    const size_t kept = groups.size();
+    std::vector<int> from(groups.size());
+    for(unsigned i = 0; i<groups.size(); i++)
+        from[i] = i;
+
+    const bool line_start = states[state].line_start, last = states[state].last;
+    if(start){
+        const std::vector<int> first(1, 0);
+        groups.insert(last ? groups.begin() : groups.end(), first);
+        from.insert(last ? from.begin() : from.end(), -1);
+    }
+
+    Step step = {0, -1, 0};
+    std::vector<std::vector<int> > next_groups;
+    std::vector<int> order, active, next;
+    std::vector<char> seen(program.size(), 0);
+    for(unsigned i = 0; i<groups.size(); i++){
+        bool matched;
+        closure(groups[i], line_start, c=='\n', active, matched);
+
+        next.clear();
+        for(std::vector<int>::const_iterator pc = active.begin(); pc!=active.end(); pc++){
+            if(seen[*pc])
+                continue;
+            seen[*pc] = 1;
+            if(classes[program[*pc].x][c])
+                next.push_back(*pc+1);
+        }
+        if(!next.empty()){
+            std::sort(next.begin(), next.end());
+            next_groups.push_back(next);
+            order.push_back(from[i]);
+        }
+
+        // The group just started can only have matched nothing. Otherwise the groups after
+        // this one can only find a match that would be worse.
+        if(matched && from[i]>=0){
+            step.matched = from[i];
+            break;
+        }
+    }
+
+    const unsigned long before = generation;
+    step.next = addState(next_groups, c=='\n', last);
+    // The groups that were there, in order, and possibly the new one at the end.
+    bool same = order.size()==kept || (order.size()==kept+1 && order.back()<0);
+    for(unsigned i = 0; i<kept && same; i++)
+        same = order[i]==(int)i;
+    if(order.empty())
+        step.order = no_groups;
+    else if(same)
+        step.order = (order.size()==kept) ? kept_groups : added_group;
+    else
+        step.order = addOrder(order);
+
+    // If the DFA was just reset then `state' is gone, and there is nowhere to keep this.
+    if(generation==before)
+        steps[index] = step;
+    return step;
+}
+
+int Regex::matchesAtEnd(int state) const {
+    if(states[state].matches_at_end<-1){
+        int matches = -1;
+        const std::vector<std::vector<int> > &groups = states[state].groups;
+        for(unsigned i = 0; i<groups.size() && matches<0; i++){
+            std::vector<int> active;
+            bool matched;
+            closure(groups[i], states[state].line_start, true, active, matched);
+            if(matched)
+                matches = i;
+        }
+        states[state].matches_at_end = matches;
+    }
+    return states[state].matches_at_end;
+}
+
+int Regex::startState(bool line_start, bool last) const {
+    int &id = start_states[last ? 1 : 0][line_start ? 1 : 0];
+    if(id<0){
+        const int state = addState(std::vector<std::vector<int> >(), line_start, last);
+        // addState could have reset the DFA, which also clears the start states.
+        start_states[last ? 1 : 0][line_start ? 1 : 0] = state;
+        return state;
+    }
+    return id;
+}
+
+void Regex::prepareCanStart() const {
+    if(can_start_ready)
+        return;
+
+    std::vector<int> active;
+    bool matched;
+    for(int line_start = 0; line_start<2; line_start++){
+        for(int c = 0; c<0x100; c++){
+            closure(std::vector<int>(1, 0), line_start!=0, c=='\n', active, matched);
+            can_start[line_start][c] = false;
+            for(std::vector<int>::const_iterator pc = active.begin(); pc!=active.end(); pc++)
+                if(classes[program[*pc].x][c])
+                    can_start[line_start][c] = true;
+        }
+    }
+    can_start_ready = true;
+}
+
+bool Regex::search(const TextSpans &text, unsigned long from, unsigned long to, bool last, unsigned long &start, unsigned long &end) const {
+    if(!valid())
+        return false;
+
+    const unsigned long length = text.length();
+    if(to>length)
+        to = length;
+
+    if(!prefix_searcher)
+        prepareCanStart();
+
+    // Where each group of the current state started.
+    std::vector<unsigned long> starts, next_starts;
+    bool found = false;
+    unsigned long p = from;
+    int state = -1;
+    while(true){
+        // Once the leftmost match has been found, only the groups that started before it
+        // can do better. The last start can be anywhere up to `to'.
+        const bool start_here = p<to && (last || !found);
+        if(starts.empty()){
+            if(!start_here)
+                break;
+
+            // Nothing is running, so skip bytes that can't start a match without running
+            // the DFA on them.
+            if(prefix_searcher){
+                const long at = prefix_searcher->find(text, p, to);
+                if(at<0)
+                    break;
+                p = at;
+            }
+            else{
+                bool line_start = (p==0 || text.at(p-1)=='\n');
+                while(p<to){
+                    const unsigned char c = text.at(p);
+                    if(can_start[line_start ? 1 : 0][c])
+                        break;
+                    line_start = (c=='\n');
+                    p++;
+                }
+                if(p>=to)
+                    break;
+            }
+            state = startState(p==0 || text.at(p-1)=='\n', last);
+        }
+
+        if(p==length){
+            const int matched = matchesAtEnd(state);
+            if(matched>=0){
+                found = true;
+                start = starts[matched];
+                end = p;
+            }
+            break;
+        }
+
+        const unsigned char c = text.at(p);
+        const unsigned long index = (state*0x100ul+c)*2+(start_here ? 1 : 0);
+        const Step step = (steps[index].next>=0) ? steps[index] : transition(state, c, start_here);
+        if(step.matched>=0){
+            found = true;
+            start = starts[step.matched];
+            end = p;
+        }
+
+        if(step.order==no_groups)
+            starts.clear();
+        else if(step.order==added_group)
+            starts.push_back(p);
+        else if(step.order>=0){
+            const std::vector<int> &order = orders[step.order];
+            next_starts.resize(order.size());
+            for(unsigned i = 0; i<order.size(); i++)
+                next_starts[i] = (order[i]<0) ? p : starts[order[i]];
+            starts.swap(next_starts);
+        }
+
+        state = step.next;
+        p++;
+    }
+    return found;
+}
+
+long Regex::matchAt(const TextSpans &text, unsigned long start) const {
+    unsigned long match_start, match_end;
+    if(!search(text, start, start+1, false, match_start, match_end))
+        return -1;
+    return match_end;
+}
+
+bool Regex::find(const TextSpans &text, unsigned long from, unsigned long to, unsigned long &start, unsigned long &end) const {
+    return search(text, from, to, false, start, end);
+}
+
+bool Regex::findWrapping(const TextSpans &text, unsigned long from, unsigned long &start, unsigned long &end) const {
+    if(find(text, from, text.length(), start, end))
+        return true;
+    return from>0 && find(text, 0, from, start, end);
+}
+
+bool Regex::findLast(const TextSpans &text, unsigned long from, unsigned long to, unsigned long &start, unsigned long &end) const {
+    // Like Searcher::findLast, search forwards through windows working backwards from `to'.
+    unsigned long high = to;
+    while(high>from){
+        const unsigned long low = (high-from>backwards_window) ? (high-backwards_window) : from;
+        if(search(text, low, high, true, start, end))
+            return true;
+        high = low;
+    }
+    return false;
+}
+
+bool Regex::findLastWrapping(const TextSpans &text, unsigned long before, unsigned long &start, unsigned long &end) const {
+    if(findLast(text, 0, before, start, end))
+        return true;
+    return findLast(text, before, text.length(), start, end);
+}
+
+void Regex::captures(const TextSpans &text, unsigned long start, unsigned long end, std::vector<long> &into) const {
+    // A backtracking-free NFA simulation over just the matched text. Threads are kept in
+    // priority order, so the first one to match at `end' decides what the groups hold.
+    const unsigned slots = (groups+1)*2;
+    into.assign(slots, -1);
+    into[0] = start;
+    into[1] = end;
+    if(!valid())
+        return;
+
+    struct Thread {
+        int pc;
+        std::vector<long> saved;
+    };
+
+    const unsigned long length = text.length();
+    std::vector<Thread> current, next;
+    std::vector<unsigned long> seen(program.size(), (unsigned long)-1);
+
+    struct Adder {
+        const Regex &regex;
+        const TextSpans &text;
+        unsigned long length;
+        std::vector<unsigned long> &seen;
+
+        void add(std::vector<Thread> &list, int pc, std::vector<long> saved, unsigned long at){
+            if(seen[pc]==at)
+                return;
+            seen[pc] = at;
+
+            const Inst &inst = regex.program[pc];
+            switch(inst.op){
+                case Split:
+                    add(list, inst.x, saved, at);
+                    add(list, inst.y, saved, at);
+                    return;
+                case Jump:
+                    add(list, inst.x, saved, at);
+                    return;
+                case Save:
+                    if((unsigned)inst.x<saved.size())
+                        saved[inst.x] = at;
+                    add(list, pc+1, saved, at);
+                    return;
+                case LineStart:
+                    if(at==0 || text.at(at-1)=='\n')
+                        add(list, pc+1, saved, at);
+                    return;
+                case LineEnd:
+                    if(at==length || text.at(at)=='\n')
+                        add(list, pc+1, saved, at);
+                    return;
+                default:{
+                    const Thread thread = {pc, saved};
+                    list.push_back(thread);
+                }
+            }
+        }
+    } adder = {*this, text, length, seen};
+
+    adder.add(current, 0, into, start);
+
+    for(unsigned long p = start; ; p++){
+        next.clear();
+        const unsigned char c = (p<length) ? text.at(p) : 0;
+
+        for(std::vector<Thread>::const_iterator i = current.begin(); i!=current.end(); i++){
+            const Inst &inst = program[i->pc];
+            if(inst.op==Match){
+                if(p==end){
+                    into = i->saved;
+                    into[0] = start;
+                    into[1] = end;
+                    return;
+                }
+            }
+            else if(p<end && classes[inst.x][c]){
+                // `seen' is keyed by position, so threads for p+1 don't collide with these.
+                adder.add(next, i->pc+1, i->saved, p+1);
+            }
+        }
+
+        if(p>=end || next.empty())
+            return;
+        current.swap(next);
+    }
+}
+
+void Regex::expand(const char *replacement, const TextSpans &text, const std::vector<long> &captures, std::string &into){
+    for(const char *c = replacement; *c; c++){
+        if(*c!='\\' || c[1]==0){
+            into+=*c;
+            continue;
+        }
+
+        c++;
+        if(*c>='0' && *c<='9'){
+            const unsigned group = *c-'0';
+            if(group*2+1<captures.size() && captures[group*2]>=0){
+                for(long i = captures[group*2]; i<captures[group*2+1]; i++)
+                    into+=text.at(i);
+            }
+        }
+        else if(*c=='n')
+            into+='\n';
+        else if(*c=='t')
+            into+='\t';
+        else
+            into+=*c;
+    }
+}
+
+bool Regex::usesGroups(const char *replacement){
+    for(const char *c = replacement; *c; c++){
+        if(*c=='\\' && c[1]!=0){
+            if(c[1]>='0' && c[1]<='9')
+                return true;
+            c++;
+        }
+    }
+    return false;
+}
+
+}
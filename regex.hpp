@@ -0,0 +1,140 @@
+#pragma once
+
+#include "search.hpp"
+#include "text_spans.hpp"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <map>
+#include <bitset>
+
+namespace Flare {
+
+// A small regular expression engine that works directly on TextSpans, so it never needs the
+// text copied out of a gap buffer.
+//
+// Patterns are compiled to a Thompson NFA. Searching runs a DFA that is built lazily from
+// the NFA as the text is scanned. Its states keep the running threads grouped by where their
+// match started, so one pass over the text finds the leftmost-longest match, in time linear
+// in the length of the text. When the pattern starts with a literal string, candidate
+// positions are found with a Searcher first. Capture groups are only resolved for a match
+// once it has been found, by running the NFA over just the matched text.
+//
+// Supported syntax: literals, `.', [classes] with ranges and negation, \d \w \s and their
+// negations, \n \t \r \f \v \xHH, ^ and $ (at line boundaries), groups, (?:non-capturing)
+// groups, |, *, +, ?, {m}, {m,} and {m,n}. A trailing ? on a repeat makes it lazy, which
+// only affects which text the groups capture.
+//
+// Searching fills in the DFA, so a Regex must not be used by more than one thread at a
+// time. Copies can be used independently.
+class Regex {
+public:
+
+    enum Op { Class, Split, Jump, Save, LineStart, LineEnd, Match };
+
+    struct Inst {
+        Op op;
+        // Jump targets for Split and Jump, class index for Class, slot for Save.
+        int x, y;
+    };
+
+private:
+
+    std::vector<Inst> program;
+    std::vector<std::bitset<0x100> > classes;
+    unsigned groups;
+
+    // A literal every match starts with, if there is one.
+    std::string prefix;
+    std::shared_ptr<const Searcher> prefix_searcher;
+
+    // Lazily built DFA. Each state is the threads that are running, in groups by where
+    // their match started, and in order of preference. A thread that is also in a group
+    // before it is dropped, since it would only do the same again. The search keeps where
+    // each group started itself, so the states don't depend on it.
+    struct State {
+        std::vector<std::vector<int> > groups;
+        bool line_start;
+        // Looking for the last start of a match, so newer groups come first.
+        bool last;
+        // The group that matches at the end of the text, -1 for none, or -2 if not known yet.
+        int matches_at_end;
+    };
+    struct Step {
+        // -1 if not known yet.
+        int next;
+        // The group that a match ended in just before the byte, or -1.
+        int matched;
+        // Index into `orders' of the group that each group of the next state came from,
+        // with -1 for the one started at this byte. Negative for the usual cases, which
+        // are spelled out in regex.cpp.
+        int order;
+    };
+    typedef std::pair<std::vector<std::vector<int> >, int> StateKey;
+    mutable std::vector<State> states;
+    // Two entries for each byte of each state, without and with a new group started at it.
+    mutable std::vector<Step> steps;
+    mutable std::vector<std::vector<int> > orders;
+    mutable std::map<std::vector<int>, int> order_ids;
+    mutable std::map<StateKey, int> state_ids;
+    mutable int start_states[2][2];
+    // Counts resets of the DFA, so that a step worked out across one isn't kept.
+    mutable unsigned long generation;
+    // Bytes that can start a nonempty match, depending on whether we are at a line start.
+    mutable bool can_start[2][0x100];
+    mutable bool can_start_ready;
+
+    void resetDFA() const;
+    int addState(const std::vector<std::vector<int> > &groups, bool line_start, bool last) const;
+    int addOrder(const std::vector<int> &order) const;
+    void closure(const std::vector<int> &pcs, bool line_start, bool line_end, std::vector<int> &into, bool &matched) const;
+    Step transition(int state, unsigned char c, bool start) const;
+    int matchesAtEnd(int state) const;
+    int startState(bool line_start, bool last) const;
+    void prepareCanStart() const;
+
+    // Finds the leftmost-longest nonempty match starting in [from, to) or, with `last', the
+    // longest one with the last start there.
+    bool search(const TextSpans &text, unsigned long from, unsigned long to, bool last, unsigned long &start, unsigned long &end) const;
+
+public:
+
+    Regex();
+    Regex(const Regex &other);
+    Regex &operator=(const Regex &other);
+
+    // Returns false and describes the problem in `error' if the pattern is not valid.
+    bool compile(const char *pattern, std::string &error);
+
+    bool valid() const { return !program.empty(); }
+    unsigned groupCount() const { return groups; }
+
+    // Returns the end of the longest nonempty match starting exactly at `start', or -1.
+    long matchAt(const TextSpans &text, unsigned long start) const;
+
+    // Finds the leftmost-longest nonempty match that starts in [from, to).
+    bool find(const TextSpans &text, unsigned long from, unsigned long to, unsigned long &start, unsigned long &end) const;
+
+    // Finds the first match at or after `from', wrapping around to the start of the text.
+    bool findWrapping(const TextSpans &text, unsigned long from, unsigned long &start, unsigned long &end) const;
+
+    // Finds the match with the last start in [from, to), and the wrapping version of that,
+    // which looks before `before' first.
+    bool findLast(const TextSpans &text, unsigned long from, unsigned long to, unsigned long &start, unsigned long &end) const;
+    bool findLastWrapping(const TextSpans &text, unsigned long before, unsigned long &start, unsigned long &end) const;
+
+    // Fills in where each group of a match found by find or matchAt starts and ends, as pairs
+    // of positions. Group 0 is the whole match. Groups that did not take part are -1.
+    void captures(const TextSpans &text, unsigned long start, unsigned long end, std::vector<long> &into) const;
+
+    // Appends the replacement for a match to `into'. \0 to \9 are replaced with the text of
+    // that group, and \n, \t and \\ are the usual escapes.
+    static void expand(const char *replacement, const TextSpans &text, const std::vector<long> &captures, std::string &into);
+
+    // True if the replacement refers to any groups, so that captures are needed at all.
+    static bool usesGroups(const char *replacement);
+
+};
+
+}
@@ -0,0 +1,196 @@
+#include "search.hpp"
+
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace Flare {
+
+// How far findLast looks back at a time.
+static const unsigned long backwards_window = 0x100000;
+
+// Past this length, skipping ahead with Horspool beats checking every position.
+static const unsigned long long_needle_length = 64;
+
+Searcher::Searcher(const char *text, unsigned long length)
+  : needle(text, length){
+
+    if(useHorspool()){
+        const unsigned long n = needle.size();
+        for(unsigned i = 0; i<0x100; i++)
+            shift[i] = n;
+        for(unsigned long i = 0; i+1<n; i++)
+            shift[(unsigned char)needle[i]] = n-1-i;
+    }
+}
+
+Searcher::Searcher(const std::string &text)
+  : Searcher(text.c_str(), text.size()){}
+
+bool Searcher::useHorspool() const {
+    return needle.size()>=long_needle_length;
+}
+
+const char *Searcher::find(const char *begin, const char *end) const {
+    const unsigned long n = needle.size();
+    if(n==0 || end-begin<(long)n)
+        return nullptr;
+    if(n==1)
+        return (const char *)memchr(begin, needle[0], end-begin);
+    if(useHorspool())
+        return findHorspool(begin, end);
+    return findSimple(begin, end);
+}
+
+const char *Searcher::findSimple(const char *begin, const char *end) const {
+    const unsigned long n = needle.size();
+    const char first = needle[0], last = needle[n-1];
+    const char * const rest = needle.c_str()+1;
+
+    const char *at = begin;
+
+#ifdef __SSE2__
+    // Compare 16 candidate positions at once against the first and last bytes of the
+    // needle, and only look at the middle where both of them match.
+    const __m128i firsts = _mm_set1_epi8(first), lasts = _mm_set1_epi8(last);
+    while(end-at>=(long)(n+15)){
+        const __m128i block_first = _mm_loadu_si128((const __m128i *)at);
+        const __m128i block_last = _mm_loadu_si128((const __m128i *)(at+n-1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(
+            _mm_cmpeq_epi8(block_first, firsts), _mm_cmpeq_epi8(block_last, lasts)));
+
+        while(mask){
+            const unsigned bit = __builtin_ctz(mask);
+            if(memcmp(at+bit+1, rest, n-2)==0)
+                return at+bit;
+            mask &= mask-1;
+        }
+        at+=16;
+    }
+#endif
+
+    // Whatever is left, or everything without SSE2.
+    const char * const last_start = end-n;
+    while(at<=last_start){
+        at = (const char *)memchr(at, first, last_start-at+1);
+        if(!at)
+            return nullptr;
+        if(at[n-1]==last && memcmp(at+1, rest, n-2)==0)
+            return at;
+        at++;
+    }
+    return nullptr;
+}
+
+const char *Searcher::findHorspool(const char *begin, const char *end) const {
+    const unsigned long n = needle.size();
+    const char * const text = needle.c_str();
+    const char last = text[n-1];
+
+    const char *at = begin;
+    const char * const last_start = end-n;
+    while(at<=last_start){
+        const char c = at[n-1];
+        if(c==last && memcmp(at, text, n-1)==0)
+            return at;
+        at+=shift[(unsigned char)c];
+    }
+    return nullptr;
+}
+
+bool Searcher::matchesAt(const TextSpans &text, unsigned long pos) const {
+    const unsigned long n = needle.size();
+    if(pos+n>text.length())
+        return false;
+    for(unsigned long i = 0; i<n; i++)
+        if(text.at(pos+i)!=needle[i])
+            return false;
+    return true;
+}
+
+long Searcher::find(const TextSpans &text, unsigned long from, unsigned long to) const {
+    const unsigned long n = needle.size(), length = text.length();
+    if(n==0 || n>length)
+        return -1;
+
+    // No match can start after this.
+    if(to>length-n+1)
+        to = length-n+1;
+    if(from>=to)
+        return -1;
+
+    const unsigned long split = text.first_length;
+
+    // Matches entirely before the gap.
+    if(from+n<=split){
+        const unsigned long end = (to+n-1<split) ? (to+n-1) : split;
+        const char * const found = find(text.first+from, text.first+end);
+        if(found)
+            return found-text.first;
+    }
+
+    // Matches that straddle the gap. These are found in a copy of at most 2n-2 bytes
+    // from around the gap.
+    if(split>0 && split<length){
+        const unsigned long low = (from+n-1>split) ? from : (split-n+1),
+            high = (to<split) ? to : split;
+        if(low<high){
+            std::string around(text.first+low, split-low);
+            around.append(text.second, high-1+n-split);
+
+            const char * const found = find(around.c_str(), around.c_str()+around.size());
+            if(found)
+                return low+(found-around.c_str());
+        }
+    }
+
+    // Matches entirely after the gap.
+    const unsigned long low = (from>split) ? from : split;
+    if(low<to){
+        const char * const begin = text.second+(low-split);
+        const char * const found = find(begin, text.second+(to-split)+n-1);
+        if(found)
+            return split+(found-text.second);
+    }
+
+    return -1;
+}
+
+long Searcher::findWrapping(const TextSpans &text, unsigned long from) const {
+    const long found = find(text, from, text.length());
+    if(found>=0 || from==0)
+        return found;
+    return find(text, 0, from);
+}
+
+long Searcher::findLast(const TextSpans &text, unsigned long from, unsigned long to) const {
+    // Search forwards through windows of the text, working backwards from `to'. This way the
+    // fast forward search does the work, and we only look at the text near the match.
+    unsigned long high = to;
+    while(high>from){
+        const unsigned long low = (high-from>backwards_window) ? (high-backwards_window) : from;
+
+        long last = -1, found;
+        unsigned long at = low;
+        while(at<high && (found = find(text, at, high))>=0){
+            last = found;
+            at = found+1;
+        }
+        if(last>=0)
+            return last;
+
+        high = low;
+    }
+    return -1;
+}
+
+long Searcher::findLastWrapping(const TextSpans &text, unsigned long before) const {
+    const long found = findLast(text, 0, before);
+    if(found>=0)
+        return found;
+    return findLast(text, before, text.length());
+}
+
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "text_spans.hpp"
+
+#include <string>
+
+namespace Flare {
+
+// Finds a fixed string in text. The needle is prepared once, so the same Searcher can be
+// used for any number of searches over any number of buffers.
+// Short needles are found by scanning for their first and last bytes 16 positions at a
+// time, long needles with Boyer-Moore-Horspool.
+class Searcher {
+
+    std::string needle;
+    // Horspool shift table, only filled in for long needles.
+    unsigned long shift[0x100];
+
+    bool useHorspool() const;
+
+    const char *findSimple(const char *begin, const char *end) const;
+    const char *findHorspool(const char *begin, const char *end) const;
+
+public:
+
+    Searcher(const char *text, unsigned long length);
+    explicit Searcher(const std::string &text);
+
+    unsigned long length() const { return needle.size(); }
+    const std::string &text() const { return needle; }
+
+    // True if the needle is at `pos' in the text.
+    bool matchesAt(const TextSpans &text, unsigned long pos) const;
+
+    // Finds the first match that lies entirely within [begin, end), or returns nullptr.
+    const char *find(const char *begin, const char *end) const;
+
+    // Finds the first match in the spans that starts in [from, to). The match itself may
+    // extend past `to', and may straddle the two spans. Returns -1 if there is no match.
+    long find(const TextSpans &text, unsigned long from, unsigned long to) const;
+
+    // Finds the first match at or after `from', wrapping around to the start of the text.
+    long findWrapping(const TextSpans &text, unsigned long from) const;
+
+    // Finds the last match that starts in [from, to), or returns -1.
+    long findLast(const TextSpans &text, unsigned long from, unsigned long to) const;
+
+    // Finds the last match that starts before `before', wrapping around to the end of the text.
+    long findLastWrapping(const TextSpans &text, unsigned long before) const;
+
+};
+
+}
@@ -0,0 +1,372 @@
+#include "search_results.hpp"
+
+#include "editor_window.hpp"
+#include "worker_pool.hpp"
+#include "file_search.hpp"
+#include "file_utilities.hpp"
+
+#include <FL/Fl.H>
+#include <FL/fl_ask.H>
+
+#include <atomic>
+#include <mutex>
+#include <cstring>
+#include <cstdio>
+
+namespace Flare {
+
+// Tabs bigger than this are searched in pieces, so that one huge file still uses every core.
+#define SEARCH_CHUNK 0x400000
+
+// Listing more than this makes the browser slow, and isn't much use anyway.
+#define MAX_LISTED 10000
+
+// Searches for match starts in [from, to) of one tab.
+struct SearchResults::Job {
+    size_t tab;
+    unsigned long from, to;
+
+    std::vector<SearchMatch> matches;
+    unsigned long found;
+    // Newlines in [from, to).
+    unsigned long lines;
+    // Guarded by Search::mutex.
+    bool done;
+};
+
+struct SearchResults::Search {
+    std::vector<Tab> tabs;
+    SearchPattern pattern;
+
+    std::vector<Job> jobs;
+    std::mutex mutex;
+    std::atomic<bool> cancelled;
+
+    // Only used on the UI thread. The owner is null once the search is cancelled.
+    SearchResults *owner;
+    size_t next_job;
+    unsigned long line_base, total;
+};
+
+struct SearchResults::Files {
+    std::shared_ptr<FileSearch> search;
+    std::string directory;
+
+    // Only used on the UI thread, like Search::owner.
+    SearchResults *owner;
+    unsigned long total, files_found;
+    bool done;
+};
+
+// Handed from the workers to the UI thread.
+struct SearchResults::FilesFound {
+    std::shared_ptr<Files> files;
+    std::vector<FileSearch::File> found;
+};
+
+void SearchResults::RunJob(Search &s, size_t i){
+    Job &job = s.jobs[i];
+    const Tab &tab = s.tabs[job.tab];
+
+    // Each job needs its own copy, since searching fills in the DFA.
+    Regex regex;
+    if(s.pattern.use_regex)
+        regex = s.pattern.regex;
+
+    if(tab.text){
+        job.found = CollectMatches(s.pattern, regex, tab.text->data(), tab.text->size(), job.from, job.to,
+            MAX_LISTED, job.matches, job.lines, s.cancelled);
+        return;
+    }
+
+    // The tab hasn't been loaded, so the file is searched as a whole. It is mapped rather
+    // than read, since it could be one too large to open other than in a LargeFileViewer.
+    unsigned long length;
+    const char * const text = mapFileContents(tab.path.c_str(), length);
+    if(!text)
+        return;
+    job.to = length;
+    job.found = CollectMatches(s.pattern, regex, text, length, 0, length,
+        MAX_LISTED, job.matches, job.lines, s.cancelled);
+    unmapFileContents(text, length);
+}
+
+void SearchResults::JobDoneCallback(void *a){
+    const std::unique_ptr<std::shared_ptr<Search> > s(static_cast<std::shared_ptr<Search> *>(a));
+    if((*s)->owner)
+        (*s)->owner->collect();
+}
+
+void SearchResults::collect(){
+    Search &s = *search;
+
+    while(s.next_job<s.jobs.size()){
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            if(!s.jobs[s.next_job].done)
+                break;
+        }
+
+        Job &job = s.jobs[s.next_job];
+        const Tab &tab = s.tabs[job.tab];
+        if(job.from==0)
+            s.line_base = 0;
+
+        for(std::vector<SearchMatch>::const_iterator i = job.matches.begin(); i!=job.matches.end(); i++)
+            addResult(tab.editor, tab.editor ? std::string() : tab.path, tab.name, i->pos, i->length, s.line_base+i->line, i->excerpt);
+
+        s.total+=job.found;
+        s.line_base+=job.lines;
+        std::vector<SearchMatch>().swap(job.matches);
+        s.next_job++;
+    }
+
+    updateStatus();
+}
+
+void SearchResults::FilesFoundCallback(void *a){
+    const std::unique_ptr<FilesFound> batch(static_cast<FilesFound *>(a));
+    Files &files = *batch->files;
+    if(!files.owner)
+        return;
+
+    for(std::vector<FileSearch::File>::const_iterator file = batch->found.begin(); file!=batch->found.end(); file++){
+        // Show paths relative to the directory that was searched.
+        const std::string name = file->path.substr(files.directory.size()+1);
+        for(std::vector<SearchMatch>::const_iterator i = file->matches.begin(); i!=file->matches.end(); i++)
+            files.owner->addResult(nullptr, file->path, name, i->pos, i->length, i->line, i->excerpt);
+
+        files.total+=file->found;
+        files.files_found++;
+    }
+
+    files.owner->updateStatus();
+}
+
+void SearchResults::FilesDoneCallback(void *a){
+    const std::unique_ptr<std::shared_ptr<Files> > files(static_cast<std::shared_ptr<Files> *>(a));
+    (*files)->done = true;
+    if((*files)->owner)
+        (*files)->owner->updateStatus();
+}
+
+void SearchResults::StatusCallback(void *a){
+    SearchResults * const that = static_cast<SearchResults *>(a);
+    that->updateStatus();
+}
+
+void SearchResults::addResult(const Editor *editor, const std::string &path, const std::string &name, unsigned long pos,
+    unsigned long length, unsigned long line, const std::string &excerpt){
+
+    if(results.size()>=MAX_LISTED)
+        return;
+
+    const Result result = {editor, path, pos, length};
+    results.push_back(result);
+
+    char number[0x20];
+    snprintf(number, sizeof(number), ":%lu: ", line+1);
+    list.add((name+number+excerpt).c_str());
+}
+
+void SearchResults::updateStatus(){
+    bool running = false;
+    unsigned long total = 0;
+
+    if(search){
+        running = search->next_job<search->jobs.size();
+        total = search->total;
+        snprintf(status_label, sizeof(status_label), "%lu matches in %u tabs",
+            total, (unsigned)search->tabs.size());
+    }
+    else if(files){
+        running = !files->done;
+        total = files->total;
+        snprintf(status_label, sizeof(status_label), "%lu matches in %lu of %lu files",
+            total, files->files_found, files->search->filesSearched());
+    }
+    else
+        status_label[0] = 0;
+
+    if(total>results.size())
+        strncat(status_label, ", only the first ones are listed", sizeof(status_label)-strlen(status_label)-1);
+    if(running)
+        strncat(status_label, "...", sizeof(status_label)-strlen(status_label)-1);
+
+    status.label(status_label);
+    status.redraw();
+
+    if(running){
+        stop_button.activate();
+        if(!Fl::has_timeout(StatusCallback, this))
+            Fl::add_timeout(0.25, StatusCallback, this);
+    }
+    else
+        stop_button.deactivate();
+}
+
+void SearchResults::ListCallback(Fl_Widget *w, void *a){
+    SearchResults * const that = static_cast<SearchResults *>(a);
+    const int line = that->list.value();
+    if(line<1 || line>(int)that->results.size())
+        return;
+
+    const Result &result = that->results[line-1];
+    if(result.editor)
+        that->window.reveal(result.editor, result.pos, result.length);
+    else
+        that->window.revealFile(result.path, result.pos, result.length);
+}
+
+void SearchResults::StopCallback(Fl_Widget *w, void *a){
+    static_cast<SearchResults *>(a)->cancel();
+}
+
+void SearchResults::reset(){
+    cancel();
+    search.reset();
+    files.reset();
+    list.clear();
+    results.clear();
+}
+
+void SearchResults::start(WorkerPool &pool, const std::vector<Tab> &tabs, const char *text, bool regex){
+    reset();
+
+    const std::shared_ptr<Search> s = std::make_shared<Search>();
+    std::string error;
+    if(!s->pattern.compile(text, regex, error)){
+        fl_alert("Invalid regular expression:\n%s\n%s", text, error.c_str());
+        updateStatus();
+        return;
+    }
+
+    s->tabs = tabs;
+    s->cancelled = false;
+    s->owner = this;
+    s->next_job = 0;
+    s->line_base = s->total = 0;
+
+    // A regular expression match could cross from one piece into the next, so those search
+    // each tab as a whole.
+    for(size_t i = 0; i<tabs.size(); i++){
+        if(!tabs[i].text){
+            if(!tabs[i].path.empty()){
+                const Job job = {i, 0, 0, std::vector<SearchMatch>(), 0, 0, false};
+                s->jobs.push_back(job);
+            }
+            continue;
+        }
+        const unsigned long length = tabs[i].text->size();
+        const unsigned long chunk = regex ? length : SEARCH_CHUNK;
+        unsigned long from = 0;
+        do{
+            const unsigned long to = (length-from>chunk) ? (from+chunk) : length;
+            const Job job = {i, from, to, std::vector<SearchMatch>(), 0, 0, false};
+            s->jobs.push_back(job);
+            from = to;
+        }while(from<length);
+    }
+
+    search = s;
+    show();
+    updateStatus();
+
+    WorkerPool * const workers_pool = &pool;
+    for(size_t i = 0; i<s->jobs.size(); i++){
+        pool.post([workers_pool, s, i](){
+            if(s->cancelled)
+                return;
+            RunJob(*s, i);
+            {
+                std::lock_guard<std::mutex> lock(s->mutex);
+                s->jobs[i].done = true;
+            }
+            AwakeUI(*workers_pool, JobDoneCallback, new std::shared_ptr<Search>(s));
+        });
+    }
+}
+
+void SearchResults::startFiles(WorkerPool &pool, const std::string &directory, const char *text, bool regex){
+    reset();
+
+    SearchPattern pattern;
+    std::string error;
+    if(!pattern.compile(text, regex, error)){
+        fl_alert("Invalid regular expression:\n%s\n%s", text, error.c_str());
+        updateStatus();
+        return;
+    }
+
+    const std::shared_ptr<Files> f = std::make_shared<Files>();
+    f->directory = directory;
+    f->owner = this;
+    f->total = f->files_found = 0;
+    f->done = false;
+
+    // The search keeps these callbacks, so they must not keep the bookkeeping alive too.
+    const std::weak_ptr<Files> weak = f;
+    WorkerPool * const workers_pool = &pool;
+    f->search = FileSearch::Start(pool, directory, pattern, MAX_LISTED,
+        [workers_pool, weak](std::vector<FileSearch::File> &found){
+            FilesFound * const batch = new FilesFound;
+            batch->files = weak.lock();
+            if(!batch->files){
+                delete batch;
+                return;
+            }
+            batch->found.swap(found);
+            AwakeUI(*workers_pool, FilesFoundCallback, batch);
+        },
+        [workers_pool, weak](){
+            const std::shared_ptr<Files> files = weak.lock();
+            if(files)
+                AwakeUI(*workers_pool, FilesDoneCallback, new std::shared_ptr<Files>(files));
+        });
+
+    files = f;
+    show();
+    updateStatus();
+}
+
+void SearchResults::cancel(){
+    if(search){
+        search->cancelled = true;
+        search->owner = nullptr;
+        // Jobs that never ran count as finished, so the status stops saying it's running.
+        search->next_job = search->jobs.size();
+    }
+    if(files){
+        files->search->cancel();
+        files->owner = nullptr;
+        files->done = true;
+    }
+    updateStatus();
+}
+
+SearchResults::SearchResults(EditorWindow &w)
+  : Fl_Window(500, 300, "Search Results")
+  , window(w)
+  , list(8, 8, 484, 252)
+  , status(8, 268, 404, 24)
+  , stop_button(420, 268, 72, 24, "Stop"){
+
+    status_label[0] = 0;
+    status.align(FL_ALIGN_LEFT|FL_ALIGN_INSIDE);
+
+    // Matches are shown as they are, not as browser formatting.
+    list.format_char(0);
+    list.callback(ListCallback, this);
+    stop_button.callback(StopCallback, this);
+    stop_button.deactivate();
+
+    resizable(list);
+    end();
+}
+
+SearchResults::~SearchResults(){
+    cancel();
+    Fl::remove_timeout(StatusCallback, this);
+}
+
+}
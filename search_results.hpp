@@ -0,0 +1,88 @@
+#pragma once
+
+#include <FL/Fl_Window.H>
+#include <FL/Fl_Hold_Browser.H>
+#include <FL/Fl_Button.H>
+#include <FL/Fl_Box.H>
+
+#include <string>
+#include <vector>
+#include <memory>
+
+namespace Flare {
+
+class EditorWindow;
+class Editor;
+class WorkerPool;
+class FileSearch;
+struct SearchPattern;
+
+// Searches every open tab, or every file in a directory, on the worker threads and lists
+// the matches as they are found. Clicking on a match shows it in its tab, opening the file
+// first if it has to.
+class SearchResults : public Fl_Window {
+public:
+
+    // What to search in one tab. The text is a copy, so the tab can be edited meanwhile.
+    // A tab that hasn't been loaded yet has no editor or text, and its file is read instead.
+    struct Tab {
+        const Editor *editor;
+        std::string name;
+        std::shared_ptr<const std::string> text;
+        std::string path;
+    };
+
+private:
+
+    EditorWindow &window;
+    Fl_Hold_Browser list;
+    Fl_Box status;
+    Fl_Button stop_button;
+    char status_label[0x100];
+
+    // Matches in files have a path, matches in tabs have an editor.
+    struct Result {
+        const Editor *editor;
+        std::string path;
+        unsigned long pos, length;
+    };
+    std::vector<Result> results;
+
+    struct Job;
+    struct Search;
+    std::shared_ptr<Search> search;
+
+    // Bookkeeping for a search of the files in a directory.
+    struct Files;
+    struct FilesFound;
+    std::shared_ptr<Files> files;
+
+    static void RunJob(Search &s, size_t i);
+    static void JobDoneCallback(void *a);
+    static void FilesFoundCallback(void *a);
+    static void FilesDoneCallback(void *a);
+    static void ListCallback(Fl_Widget *w, void *a);
+    static void StopCallback(Fl_Widget *w, void *a);
+    // Keeps the count of files searched up to date.
+    static void StatusCallback(void *a);
+
+    // Lists the matches of every finished job that all the jobs before it have been listed for.
+    void collect();
+    void addResult(const Editor *editor, const std::string &path, const std::string &name, unsigned long pos,
+        unsigned long length, unsigned long line, const std::string &excerpt);
+    void updateStatus();
+    void reset();
+
+public:
+
+    SearchResults(EditorWindow &w);
+    virtual ~SearchResults();
+
+    void start(WorkerPool &pool, const std::vector<Tab> &tabs, const char *text, bool regex);
+    void startFiles(WorkerPool &pool, const std::string &directory, const char *text, bool regex);
+    // Stops the current search. Matches that were already listed stay.
+    void cancel();
+
+};
+
+}
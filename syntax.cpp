@@ -0,0 +1,44 @@
+#include "syntax.hpp"
+
+namespace Flare {
+
+// C and C++ together, since headers are shared between them.
+static const char *const c_keywords[] = {
+    "alignas", "alignof", "auto", "bool", "break", "case", "catch", "char", "class", "const",
+    "constexpr", "continue", "decltype", "default", "delete", "do", "double", "else", "enum",
+    "explicit", "extern", "false", "float", "for", "friend", "goto", "if", "inline", "int",
+    "long", "mutable", "namespace", "new", "noexcept", "nullptr", "operator", "override",
+    "private", "protected", "public", "register", "return", "short", "signed", "sizeof",
+    "static", "static_assert", "static_cast", "struct", "switch", "template", "this",
+    "throw", "true", "try", "typedef", "typename", "union", "unsigned", "using", "virtual",
+    "void", "volatile", "while",
+    nullptr
+};
+
+const Syntax c_syntax = {
+    "C/C++", c_keywords, "//", "/*", "*/", "\"'", '\\', '#'
+};
+
+static const char *const python_keywords[] = {
+    "False", "None", "True", "and", "as", "assert", "async", "await", "break", "class",
+    "continue", "def", "del", "elif", "else", "except", "finally", "for", "from", "global",
+    "if", "import", "in", "is", "lambda", "nonlocal", "not", "or", "pass", "raise",
+    "return", "self", "try", "while", "with", "yield",
+    nullptr
+};
+
+const Syntax python_syntax = {
+    "Python", python_keywords, "#", nullptr, nullptr, "\"'", '\\', 0
+};
+
+static const char *const shell_keywords[] = {
+    "case", "do", "done", "elif", "else", "esac", "export", "fi", "for", "function", "if",
+    "in", "local", "return", "then", "until", "while",
+    nullptr
+};
+
+const Syntax shell_syntax = {
+    "Shell", shell_keywords, "#", nullptr, nullptr, "\"'`", '\\', 0
+};
+
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+namespace Flare {
+
+// How a language looks, as far as highlighting it goes. Anything the language doesn't have
+// is null, or 0 for a character.
+struct Syntax {
+    const char *name;
+    // Sorted by strcmp, and ending with a null.
+    const char *const *keywords;
+    const char *line_comment;
+    const char *block_comment_start, *block_comment_end;
+    // Each of these characters starts a string that the same character ends.
+    const char *quotes;
+    // Escapes the next character in a string. At the end of a line, it continues the string
+    // or preprocessor line onto the next.
+    char escape;
+    // Lines whose first character other than spaces is this are preprocessor lines.
+    char preprocessor;
+};
+
+// The styles that highlighting gives the text, as used in an Fl_Text_Display style buffer.
+// STYLE_MATCH is never given by highlighting, it is for editors to show search matches with.
+enum Style {
+    STYLE_PLAIN = 'A',
+    STYLE_MATCH,
+    STYLE_COMMENT,
+    STYLE_STRING,
+    STYLE_KEYWORD,
+    STYLE_NUMBER,
+    STYLE_PREPROCESSOR
+};
+
+extern const Syntax c_syntax;
+extern const Syntax python_syntax;
+extern const Syntax shell_syntax;
+
+}
@@ -0,0 +1,139 @@
+#include "tab_strip.hpp"
+
+#include <FL/Fl.H>
+#include <FL/fl_draw.H>
+
+#include <algorithm>
+
+namespace Flare {
+
+// Room around the label of a tab, in pixels.
+#define TAB_PADDING 12
+
+TabStrip::TabStrip(int x, int y, int w, int h, ButtonFactory f, void *arg)
+  : Fl_Group(x, y, w, h)
+  , factory(f)
+  , factory_arg(arg)
+  , first(0)
+  , offset_(0)
+  , selected(-1){
+
+    // Buttons are only partly in view at either end.
+    clip_children(1);
+    box(FL_FLAT_BOX);
+    end();
+}
+
+void TabStrip::layout(){
+    first = std::upper_bound(ends.begin(), ends.end(), offset_)-ends.begin();
+
+    unsigned used = 0;
+    for(unsigned i = first; i<tabs.size() && start(i)<offset_+w(); i++, used++){
+        if(used==buttons.size()){
+            Fl_Button * const button = factory(factory_arg);
+            Fl_Group::add(button);
+            buttons.push_back(button);
+        }
+
+        Fl_Button * const button = buttons[used];
+        button->resize(x()+start(i)-offset_, y(), ends[i]-start(i), h());
+        button->label(tabs[i].label.c_str());
+
+        const bool open = (long)i==selected;
+        button->box(open ? FL_GLEAM_DOWN_BOX : FL_UP_BOX);
+        button->labelcolor(open ? 1 : FL_FOREGROUND_COLOR);
+        button->color(open ? FL_BLUE : FL_BACKGROUND_COLOR);
+        button->labelfont(tabs[i].loading ? (labelfont()|FL_ITALIC) : labelfont());
+        button->tooltip(tabs[i].loading ? "Loading..." : nullptr);
+        button->show();
+    }
+
+    for(unsigned i = used; i<buttons.size(); i++)
+        buttons[i]->hide();
+    redraw();
+}
+
+int TabStrip::handle(int e){
+    if(e==FL_MOUSEWHEEL){
+        if(Fl::event_dx()>0)
+            scrollTo(maxOffset());
+        else if(Fl::event_dx()<0)
+            scrollTo(0);
+        else
+            scrollBy(Fl::event_dy()<<3);
+        return 1;
+    }
+
+    return Fl_Group::handle(e);
+}
+
+void TabStrip::resize(int x, int y, int w, int h){
+    // The buttons are placed by layout, not moved along with the strip.
+    Fl_Widget::resize(x, y, w, h);
+    scrollTo(offset_);
+}
+
+void TabStrip::append(const std::string &label){
+    fl_font(labelfont(), labelsize());
+    const Tab tab = {label, false};
+    tabs.push_back(tab);
+    ends.push_back(start(tabs.size()-1)+(long)fl_width(label.c_str(), label.size())+TAB_PADDING);
+
+    // The buttons point at the labels, which may have moved.
+    layout();
+}
+
+void TabStrip::erase(unsigned i){
+    const long width = ends[i]-start(i);
+    tabs.erase(tabs.begin()+i);
+    ends.erase(ends.begin()+i);
+    for(std::vector<long>::iterator end = ends.begin()+i; end!=ends.end(); end++)
+        *end-=width;
+
+    if(selected==(long)i)
+        selected = -1;
+    else if(selected>(long)i)
+        selected--;
+
+    // The strip may be scrolled past the end now.
+    scrollTo(offset_);
+}
+
+void TabStrip::select(long i){
+    selected = i;
+    layout();
+}
+
+void TabStrip::loading(unsigned i, bool l){
+    tabs[i].loading = l;
+    if(i>=first && i<first+buttons.size())
+        layout();
+}
+
+long TabStrip::tabOf(const Fl_Widget *button) const {
+    for(unsigned i = 0; i<buttons.size(); i++){
+        if(buttons[i]==button)
+            return buttons[i]->visible() ? (long)(first+i) : -1;
+    }
+    return -1;
+}
+
+long TabStrip::maxOffset() const {
+    const long length = ends.empty() ? 0 : ends.back();
+    return (length>w()) ? (length-w()) : 0;
+}
+
+void TabStrip::scrollTo(long to){
+    const long most = maxOffset();
+    offset_ = (to<0) ? 0 : ((to>most) ? most : to);
+    layout();
+}
+
+void TabStrip::reveal(unsigned i){
+    if(start(i)<offset_)
+        scrollTo(start(i));
+    else if(ends[i]>offset_+w())
+        scrollTo(ends[i]-w());
+}
+
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <FL/Fl_Group.H>
+#include <FL/Fl_Button.H>
+
+#include <string>
+#include <vector>
+
+namespace Flare {
+
+// A row of tab buttons that scrolls sideways. The tabs are only a label and a width each,
+// and buttons are made just for the ones in view, then reused as it scrolls, so it costs
+// the same to draw with thousands of tabs as with a few.
+//
+// Where each tab ends is kept as a running sum of the widths, so finding the tab at a
+// position is a binary search, and scrolling anywhere is O(log n) plus the tabs in view.
+class TabStrip : public Fl_Group {
+public:
+
+    // Makes a button for the strip to show tabs with. Its callback, and anything else that
+    // doesn't change from tab to tab, is up to the factory.
+    typedef Fl_Button *(*ButtonFactory)(void *arg);
+
+private:
+
+    struct Tab {
+        std::string label;
+        bool loading;
+    };
+    std::vector<Tab> tabs;
+    // Where each tab ends, from the left of the first.
+    std::vector<long> ends;
+
+    const ButtonFactory factory;
+    void * const factory_arg;
+    // Showing the tabs from `first' on, in order.
+    std::vector<Fl_Button *> buttons;
+    unsigned first;
+
+    long offset_;
+    long selected;
+
+    long start(unsigned i) const { return (i>0) ? ends[i-1] : 0; }
+    // Puts buttons on the tabs in view.
+    void layout();
+
+public:
+
+    TabStrip(int x, int y, int w, int h, ButtonFactory f, void *arg);
+
+    int handle(int e) override;
+    void resize(int x, int y, int w, int h) override;
+
+    unsigned count() const { return tabs.size(); }
+    const char *tabLabel(unsigned i) const { return tabs[i].label.c_str(); }
+
+    void append(const std::string &label);
+    // This is O(n), which is no worse than closing the tab is anyway.
+    void erase(unsigned i);
+
+    // Shows the tab as the one that is open, or none with -1.
+    void select(long i);
+    // Shows the tab in italics while its file loads.
+    void loading(unsigned i, bool l);
+
+    // The tab a button is showing, or -1 if it isn't one of the strip's.
+    long tabOf(const Fl_Widget *button) const;
+
+    //
+    // Scrolling, in pixels from the start of the first tab. These are O(log n).
+    //
+
+    long offset() const { return offset_; }
+    long maxOffset() const;
+    void scrollTo(long to);
+    void scrollBy(long by){ scrollTo(offset_+by); }
+    // Scrolls just far enough that all of the tab is in view.
+    void reveal(unsigned i);
+
+};
+
+}
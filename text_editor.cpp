@@ -1,5 +1,9 @@
 #include "text_editor.hpp"
+#include "flare_text_buffer.hpp"
 #include "size_utilities.hpp"
+#include "file_utilities.hpp"
+#include "worker_pool.hpp"
+#include "search.hpp"
 
 #include <FL/Fl_Window.H>
 #include <FL/Fl_Text_Editor.H>
@@ -16,151 +20,700 @@
 
 #include <string>
 #include <cstring>
+#include <cstdlib>
 #include <cstdio>
 #include <cassert>
+#include <cerrno>
 
 namespace Flare {
 
-// Shorthand.
-static inline Fl_Text_Buffer *CreateTextBuffer(){ return new Fl_Text_Buffer(0x100, 0x100); }
+// How much text findAll searches each time FLTK is idle. This takes a couple of milliseconds.
+#define MATCH_SCAN_CHUNK 0x800000
+
+// How many lines are highlighted on the UI thread at a time, which takes about a millisecond.
+// The rest are left to a worker thread.
+#define HIGHLIGHT_BUDGET 0x1000
+// How long the text has to be left alone before the rest is highlighted, in seconds, so
+// that the text isn't copied for every key typed.
+#define HIGHLIGHT_DELAY 0.1
+
+// In the order of Style, from STYLE_PLAIN.
+static const Fl_Text_Display::Style_Table_Entry styles[] = {
+    {FL_FOREGROUND_COLOR, FL_COURIER, FL_NORMAL_SIZE},
+    {FL_RED, FL_COURIER_BOLD, FL_NORMAL_SIZE},
+    {FL_DARK_GREEN, FL_COURIER, FL_NORMAL_SIZE},
+    {FL_DARK_RED, FL_COURIER, FL_NORMAL_SIZE},
+    {FL_DARK_BLUE, FL_COURIER_BOLD, FL_NORMAL_SIZE},
+    {FL_DARK_MAGENTA, FL_COURIER, FL_NORMAL_SIZE},
+    {FL_DARK_CYAN, FL_COURIER, FL_NORMAL_SIZE}
+};
 
 TextEditor::TextEditor(int x, int y, int w, int h) 
   : Editor(x, y, w, h)
-  , editor(x, y, w, h){
+  , editor(x, y, w, h)
+  , pool(nullptr)
+  , hibernated_view(){
 
-    editor.buffer(CreateTextBuffer());
+    editor.document(document);
     editor.textfont(FL_SCREEN);
 
-    editor.buffer()->add_modify_callback(Text_Editor_Widget::text_buffer_change_cb, &editor);
+    document.changeCallback(DocumentChangedCallback, this);
 
     holder.resizable(editor);
     holder.end();
 }
 
 TextEditor::~TextEditor(){
+    cancelLoad();
+    cancelHibernation();
+    cancelHighlight();
+    Fl::remove_idle(ScanCallback, this);
+    document.changeCallback(nullptr, nullptr);
+}
+
+void TextEditor::DocumentChangedCallback(unsigned long pos, unsigned long inserted, unsigned long deleted, void *a){
+    TextEditor * const that = static_cast<TextEditor *>(a);
+
+    if(!that->styled())
+        return;
+
+    // Keep the styles lined up with the text.
+    if(deleted>0)
+        that->style.remove(pos, pos+deleted);
+    if(inserted>0){
+        const std::string filler(inserted, STYLE_PLAIN);
+        that->style.insert(pos, filler.c_str());
+    }
+
+    // The document has already updated its lines, so only the lines the change reaches
+    // need to be highlighted again. Whatever was being lexed in the background is out of
+    // date now.
+    unsigned long from = pos, to = pos+inserted;
+    if(that->highlighter.active()){
+        that->cancelHighlight();
+        that->highlighter.update(that->document.spans(), that->document.lineIndex(), that->style, pos, inserted, from, to);
+        that->scheduleHighlight();
+    }
+
+    if(!that->matches.active()){
+        that->editor.redisplay_range(from, to);
+        return;
+    }
+
+    // Only the text around the change needs to be searched and styled again.
+    that->matches.update(that->document.spans(), pos, inserted, deleted);
+
+    const unsigned long n = that->matches.needleLength();
+    const unsigned long before = (pos>=n-1) ? (pos-n+1) : 0, after = pos+inserted+n-1;
+    that->restyle((before<from) ? before : from, (after>to) ? after : to);
+}
+
+void TextEditor::ScanCallback(void *a){
+    TextEditor * const that = static_cast<TextEditor *>(a);
+
+    unsigned long from, to;
+    if(that->matches.scan(that->document.spans(), MATCH_SCAN_CHUNK, from, to))
+        Fl::remove_idle(ScanCallback, a);
+
+    // Scanning only finds more matches, so what is under them is already styled.
+    to+=that->matches.needleLength()-1;
+    that->overlayMatches(from, to);
+    that->editor.redisplay_range(from, to);
+}
+
+void TextEditor::overlayMatches(unsigned long from, unsigned long to){
+    const unsigned long length = style.length();
+    if(to>length)
+        to = length;
+    if(from>=to || !matches.active())
+        return;
+
+    // Matches that started a little before `from' can still reach into the range.
+    const unsigned long n = matches.needleLength();
+    const std::vector<unsigned long> &at = matches.positions();
+    for(size_t i = matches.lowerBound((from>=n-1) ? (from-n+1) : 0); i<at.size() && at[i]<to; i++){
+        const unsigned long start = (at[i]>from) ? at[i] : from,
+            end = (at[i]+n<to) ? (at[i]+n) : to;
+        style.overwrite(start, end, STYLE_MATCH);
+    }
+}
+
+unsigned long TextEditor::restyle(unsigned long from, unsigned long to){
+    const unsigned long length = style.length();
+    if(to>length)
+        to = length;
+    if(from>=to)
+        return to;
+
+    if(highlighter.active()){
+        highlighter.restyle(document.spans(), document.lineIndex(), style, from, to);
+        scheduleHighlight();
+    }
+    else
+        style.overwrite(from, to, STYLE_PLAIN);
+    overlayMatches(from, to);
+
+    editor.redisplay_range(from, to);
+    return to;
+}
+
+void TextEditor::showStyles(){
+    if(styled())
+        editor.highlight_data(&style, styles, sizeof(styles)/sizeof(styles[0]), STYLE_PLAIN, nullptr, nullptr);
+    else{
+        editor.highlight_data(nullptr, nullptr, 0, STYLE_PLAIN, nullptr, nullptr);
+        style.fill(STYLE_PLAIN, 0);
+    }
+    editor.redraw();
+}
+
+void TextEditor::highlight(){
+    cancelHighlight();
+
+    // Nothing is highlighted while loading, since the text is only a placeholder.
+    highlighter.syntax(loading() ? nullptr : GetSyntaxForExtension(Extension(path_)));
+
+    if(styled()){
+        const unsigned long length = document.length();
+        style.fill(STYLE_PLAIN, length);
+        highlighter.highlight(document.spans(), document.lineIndex(), style);
+        overlayMatches(0, length);
+    }
+
+    showStyles();
+    scheduleHighlight();
+}
+
+struct TextEditor::PendingHighlight {
+    // Only touched on the UI thread. Cleared if the results are no longer wanted.
+    TextEditor *editor;
+    const std::shared_ptr<Highlighter::Job> job;
+
+    // A chunk of styles on its way to the UI thread.
+    struct Result {
+        std::shared_ptr<PendingHighlight> request;
+        std::unique_ptr<Highlighter::Chunk> chunk;
+    };
+
+    PendingHighlight(TextEditor *e, const std::shared_ptr<Highlighter::Job> &j)
+      : editor(e)
+      , job(j){}
+};
+
+void TextEditor::scheduleHighlight(){
+    if(!pool || highlighting || !highlighter.active() || highlighter.finished())
+        return;
+
+    Fl::remove_timeout(HighlightTimeout, this);
+    Fl::add_timeout(HIGHLIGHT_DELAY, HighlightTimeout, this);
+}
+
+void TextEditor::cancelHighlight(){
+    Fl::remove_timeout(HighlightTimeout, this);
+    if(!highlighting) return;
+
+    highlighting->editor = nullptr;
+    highlighting->job->cancel();
+    highlighting.reset();
+}
 
+void TextEditor::HighlightTimeout(void *a){
+    TextEditor * const that = static_cast<TextEditor *>(a);
+
+    // Start with the lines on screen.
+    unsigned long from, to;
+    that->editor.visibleRange(from, to);
+    const std::shared_ptr<Highlighter::Job> job =
+        that->highlighter.job(that->document.spans(), that->document.lineIndex(), that->document.version(), from, to);
+    if(!job) return;
+
+    const std::shared_ptr<PendingHighlight> request = std::make_shared<PendingHighlight>(that, job);
+    that->highlighting = request;
+    WorkerPool * const workers_pool = that->pool;
+    workers_pool->post([workers_pool, request](){
+        request->job->run([workers_pool, &request](Highlighter::Chunk *chunk){
+            PendingHighlight::Result * const result = new PendingHighlight::Result;
+            result->request = request;
+            result->chunk.reset(chunk);
+            AwakeUI(*workers_pool, FinishHighlight, result);
+        });
+    });
+}
+
+void TextEditor::FinishHighlight(void *a){
+    const std::unique_ptr<PendingHighlight::Result> result(static_cast<PendingHighlight::Result *>(a));
+
+    TextEditor * const ed = result->request->editor;
+    // The text changed, or the editor was closed, while we were lexing.
+    if(!ed) return;
+
+    unsigned long from, to;
+    if(ed->highlighter.merge(*result->chunk, ed->document.version(), ed->style, from, to)){
+        ed->overlayMatches(from, to);
+        ed->editor.redisplay_range(from, to);
+    }
+
+    if(result->chunk->last){
+        ed->highlighting.reset();
+        // In case a chunk was out of date, and there are lines left.
+        ed->scheduleHighlight();
+    }
 }
 
 // Basically dump what we know.
 void TextEditor::info() const {
     char buffer[8];
-    unsigned long long s = editor.buffer()->length();
-    fl_alert("Editor information:\npath: %s\nFilesize: %s %cB\nAdler32 Checksum: %lu\n", 
-        path().c_str(), sizeNumberString(buffer, s), sizePrefixChar(s), adler);
+    unsigned long long s = document.length();
+    fl_alert("Editor information:\npath: %s\nFilesize: %s %cB\nLines: %lu\nAdler32 Checksum: %lu\n", 
+        path().c_str(), sizeNumberString(buffer, s), sizePrefixChar(s), document.lineCount(), document.checksum());
 }
 
-bool TextEditor::load(){
+struct TextEditor::PendingHibernation {
+    // Only touched on the UI thread. Cleared if the text is no longer to be freed.
+    TextEditor *editor;
+    const unsigned long version;
+
+    // Emptied by the worker once it is compressed.
+    std::shared_ptr<const std::string> text;
+    std::vector<unsigned char> compressed;
+    bool compressed_ok;
+
+    PendingHibernation(TextEditor *e, const std::shared_ptr<const std::string> &t)
+      : editor(e)
+      , version(e->document.version())
+      , text(t)
+      , compressed_ok(false){}
+};
 
-    FILE *that = fopen(path_.c_str(), "r");
-    if(!that){
-        fl_alert("Cannot open file %s", path_.c_str());
+bool TextEditor::hibernate(WorkerPool &workers){
+    // Matches would have to be found again on waking, and a load will replace the text anyway.
+    if(loading() || hibernating() || matches.active())
         return false;
+
+    const std::shared_ptr<PendingHibernation> job = std::make_shared<PendingHibernation>(this, snapshot());
+    hibernation = job;
+    WorkerPool * const workers_pool = &workers;
+    workers.post([workers_pool, job](){
+        const TextSpans spans = {job->text->data(), job->text->size(), job->text->data()+job->text->size(), 0};
+        job->compressed_ok = compressText(spans, job->compressed);
+        job->text.reset();
+        AwakeUI(*workers_pool, FinishHibernation, new std::shared_ptr<PendingHibernation>(job));
+    });
+    return true;
+}
+
+void TextEditor::cancelHibernation(){
+    if(!hibernation) return;
+
+    hibernation->editor = nullptr;
+    hibernation.reset();
+}
+
+void TextEditor::FinishHibernation(void *a){
+    std::shared_ptr<PendingHibernation> * const that = static_cast<std::shared_ptr<PendingHibernation> *>(a);
+    const std::shared_ptr<PendingHibernation> job = *that;
+    delete that;
+
+    TextEditor * const ed = job->editor;
+    // The editor was shown or closed while we were compressing.
+    if(!ed) return;
+    ed->hibernation.reset();
+
+    // If the text changed since it was copied, what was compressed is out of date.
+    if(!job->compressed_ok || job->version!=ed->document.version() || ed->matches.active())
+        return;
+
+    // The styles are dropped with the text, and made again on waking.
+    ed->hibernated_view.insert = ed->editor.insert_position();
+    ed->hibernated_view.top_line = ed->editor.topLine();
+    ed->hibernated_view.horizontal = ed->editor.horizontalOffset();
+    ed->cancelHighlight();
+    ed->highlighter.syntax(nullptr);
+    ed->showStyles();
+
+    if(!ed->document.hibernate(job->compressed, job->version))
+        ed->highlight();
+}
+
+void TextEditor::wake(){
+    cancelHibernation();
+    if(!document.hibernating())
+        return;
+
+    if(!document.wake()){
+        fl_alert("Could not restore file %s\n%s", path_.c_str(), strerror(errno));
+        return;
     }
-    // Buffer the file in.
-    char buffer[0x100];
-    unsigned to = 0;
 
-    adler = adler32(0L, nullptr, 0);
+    editor.insert_position(hibernated_view.insert);
+    editor.scroll(hibernated_view.top_line, hibernated_view.horizontal);
+    highlight();
+}
 
-    // Clear the buffer
-    editor.buffer()->text(nullptr);
-    // Load the file.
-    do{
-        to = fread(buffer, 1, 0xFF, that);
+struct TextEditor::PendingLoad {
+    // Only touched on the UI thread. Cleared if the load is no longer wanted.
+    TextEditor *editor;
+    const LoadedCallback loaded;
+    void * const arg;
+    const std::string path;
+
+    // Filled in by the worker.
+    char *text;
+    unsigned long length;
+    uLong adler;
+    FileStamp stamp;
+    int error;
+
+    PendingLoad(TextEditor *e, LoadedCallback l, void *a)
+      : editor(e)
+      , loaded(l)
+      , arg(a)
+      , path(e->path())
+      , text(nullptr)
+      , length(0)
+      , adler(0)
+      , error(0){}
+
+    ~PendingLoad(){
+        free(text);
+    }
+};
 
-        adler = adler32(adler, (unsigned char *)buffer, to);
+void TextEditor::cancelLoad(){
+    if(!pending) return;
 
-        buffer[to] = 0;
-        editor.buffer()->append(buffer);
-    }while(to==0xFF);
+    pending->editor = nullptr;
+    pending.reset();
+    editor.activate();
+}
+
+bool TextEditor::load(){
 
-    fclose(that);
+    cancelLoad();
+    cancelHibernation();
 
-    editor.clearHistory();
+    // Rather than highlighting the new text as it replaces the old.
+    highlighter.syntax(nullptr);
+
+    const bool loaded = document.load(path_.c_str());
+    highlight();
+
+    if(!loaded){
+        fl_alert("Cannot open file %s\n%s", path_.c_str(), strerror(errno));
+        return false;
+    }
 
     return true;
 }
 
-bool TextEditor::save(){
+void TextEditor::loadInBackground(WorkerPool &workers, LoadedCallback loaded, void *arg){
+
+    cancelLoad();
+    cancelHibernation();
+    pool = &workers;
+    highlighter.lineBudget(HIGHLIGHT_BUDGET);
 
-    char buffer[0x100];
+    pending = std::make_shared<PendingLoad>(this, loaded, arg);
+    highlight();
 
-    unsigned to = 0;
+    // Show a placeholder until the file arrives.
+    document.reset("Loading...");
+    editor.deactivate();
 
-    // Check if the file contents are what we saw when we last loaded/saved the file.
-    uLong adler_file = adler32(0L, nullptr, 0);
+    const std::shared_ptr<PendingLoad> job = pending;
+    WorkerPool * const workers_pool = pool;
+    pool->post([workers_pool, job](){
+        job->text = loadFileContents(job->path.c_str(), job->length, job->adler, Document::gap, &job->stamp);
+        job->error = job->text ? 0 : errno;
+
+        AwakeUI(*workers_pool, FinishLoad, new std::shared_ptr<PendingLoad>(job));
+    });
+}
 
-    FILE *that = fopen(path_.c_str(), "r");
-    // Load the file.
-    do{
-        to = fread(buffer, 1, 0xFF, that);
+void TextEditor::FinishLoad(void *a){
+    std::shared_ptr<PendingLoad> * const that = static_cast<std::shared_ptr<PendingLoad> *>(a);
+    const std::shared_ptr<PendingLoad> job = *that;
+    delete that;
 
-        adler_file = adler32(adler_file, (unsigned char *)buffer, to);
-    }while(to==0xFF);
+    TextEditor * const ed = job->editor;
+    // The editor was closed, or the file was loaded again, while we were reading.
+    if(!ed) return;
 
-    fclose(that);
+    ed->pending.reset();
+    ed->editor.activate();
 
-    if(adler_file!=adler){
+    if(job->text){
+        ed->document.adopt(job->text, job->length, job->adler, job->stamp);
+        job->text = nullptr;
+    }
+    else{
+        ed->document.reset(nullptr);
+        fl_alert("Cannot open file %s\n%s", job->path.c_str(), strerror(job->error));
+    }
+    ed->highlight();
+
+    job->loaded(ed, job->error==0, job->arg);
+}
+
+bool TextEditor::save(){
+
+    wake();
+
+    // Don't write the placeholder over the file.
+    if(loading()){
+        fl_alert("File %s is still loading.", path_.c_str());
+        return false;
+    }
+
+    // Check if the file is what we saw when we last loaded/saved it.
+    if(document.changedOnDisk(path_.c_str())){
         if(!fl_choice("File %s was changed outside of the editor. Would you like to save anyway?", 
             fl_cancel, fl_yes, nullptr, path_.c_str()))
             return false;
     }
 
-    // Create a backup of the original file, just in case :)
-    const std::string new_file_name = path_+".baku";
-    rename(path_.c_str(), new_file_name.c_str());
+    if(!document.save(path_.c_str())){
+        fl_alert("Could not save file %s\n%s", path_.c_str(), strerror(errno));
+        return false;
+    }
 
-    that = fopen(path_.c_str(), "w");
-    if(that){
+    return true;
+}
 
-        const char *text = editor.buffer()->text();
-        const unsigned length = strlen(text);
-        // Try to write the file.
-        if(fwrite(text, 1, length, that)!=length){
-            fl_alert("Could not save file %s.", path_.c_str());
-            return false;
-        }
+void TextEditor::showMatch(unsigned long at, unsigned long length){
+    const int end = at+length;
+    document.buffer().highlight(at, end);
+    editor.insert_position(end);
+    editor.show_insert_position();
+    editor.redraw();
+}
+
+void TextEditor::find(const char *text){
+    last_find = text;
+    last_find_regex = false;
+    const Searcher searcher(last_find);
+
+    // Start from the cursor, which is left at the end of the last match, and wrap around.
+    const long to = searcher.findWrapping(document.spans(), editor.insert_position());
+    if(to<0){
+        notFound(text);
+        return;
+    }
 
-        fclose(that);
-        // If we succeeded, we don't need the backup any more.
-        remove(new_file_name.c_str());
+    showMatch(to, searcher.length());
+}
+
+void TextEditor::findAll(const char *text){
+    clearMatches();
+
+    last_find = text;
+    last_find_regex = false;
+    if(last_find.empty())
+        return;
+
+    const int length = document.length();
+    if(!highlighter.active())
+        style.fill(STYLE_PLAIN, length);
+
+    // The search itself happens a chunk at a time whenever the UI is idle.
+    matches.reset(last_find.c_str(), last_find.size(), length);
+    showStyles();
+    Fl::add_idle(ScanCallback, this);
+}
 
-        // Calculate the new checksum and free the buffer.
-        adler = adler32(adler32(0L, nullptr, 0), (unsigned char *)text, strlen(text));
+void TextEditor::clearMatches(){
+    if(!matches.active())
+        return;
 
-        free((void *)text);
+    Fl::remove_idle(ScanCallback, this);
+
+    if(!highlighter.active()){
+        matches.clear();
+        showStyles();
+        return;
     }
-    else{ // Alert if we couldn't open the file for saving.
-        fl_alert("Could open file %s for saving.", path_.c_str());
-        return false;
+
+    // Put back the highlighting that was under each match.
+    const std::vector<unsigned long> at = matches.positions();
+    const unsigned long n = matches.needleLength();
+    matches.clear();
+
+    unsigned long styled_to = 0;
+    for(size_t i = 0; i<at.size(); i++){
+        if(at[i]+n>styled_to)
+            styled_to = restyle((at[i]>styled_to) ? at[i] : styled_to, at[i]+n);
     }
+}
 
-    return true;
+void TextEditor::findNext(){
+    if(last_find_regex){
+        findRegex(last_find.c_str());
+        return;
+    }
+    if(!matches.active()){
+        if(!last_find.empty())
+            find(last_find.c_str());
+        return;
+    }
+
+    // Step from the current match if the cursor is still at the end of it, otherwise
+    // start again from wherever the cursor has been moved to.
+    const unsigned long n = matches.needleLength();
+    const long current = matches.currentPosition();
+    const long at = (current>=0 && current+n==(unsigned long)editor.insert_position()) ?
+        matches.next() : matches.seek(editor.insert_position());
+
+    if(at>=0)
+        showMatch(at, n);
 }
 
-void TextEditor::find(const char *text){
-    const unsigned len = strlen(text);
-    int cur_pos = editor.insert_position()+1, to = cur_pos+1;
-    while(editor.buffer()->findchar_forward(cur_pos, text[0], &to) && (to+len<editor.buffer()->length())){
-        if(memcmp(editor.buffer()->address(to), text, len)==0){
-            editor.buffer()->highlight(to, to+len);
-            editor.insert_position(to);
-            editor.show_insert_position();
-            editor.redraw();
-            return;
-        }
-        cur_pos = to+1;
+void TextEditor::findPrevious(){
+    if(last_find.empty())
+        return;
+
+    if(last_find_regex){
+        findPreviousRegex(editor.insert_position());
+        return;
+    }
+
+    const unsigned long n = last_find.size();
+    const unsigned long cursor = editor.insert_position();
+    const long current = matches.currentPosition();
+
+    long at;
+    if(!matches.active()){
+        // Skip the match the cursor is at the end of.
+        const Searcher searcher(last_find);
+        at = searcher.findLastWrapping(document.spans(), (cursor>=n) ? (cursor-n) : 0);
+        if(at<0)
+            notFound(last_find.c_str());
     }
-    fl_alert("Could not find text:\n%s", text);
+    else if(current>=0 && current+n==cursor)
+        at = matches.previous();
+    else{
+        matches.seek(cursor);
+        at = matches.previous();
+    }
+
+    if(at>=0)
+        showMatch(at, n);
 }
 
-void TextEditor::calculateAdler32(){
-    const char *text = editor.buffer()->text();
-   
-    // Calculate the new checksum and free the buffer.
-    adler = adler32(adler32(0L, nullptr, 0), (unsigned char *)text, strlen(text));
+void TextEditor::replace(const char *text, const char *replacement){
+    const Searcher searcher(text, strlen(text));
+    const unsigned long n = searcher.length(), cursor = editor.insert_position();
+
+    if(n>0 && cursor>=n && searcher.matchesAt(document.spans(), cursor-n)){
+        document.buffer().replace(cursor-n, cursor, replacement);
+        editor.insert_position(cursor-n+strlen(replacement));
+    }
+
+    find(text);
+}
+
+unsigned long TextEditor::replaceAll(const char *text, const char *replacement){
+    const Searcher searcher(text, strlen(text));
+
+    // Reuse the matches from Find All if we have all of them.
+    const bool indexed = matches.indexes(searcher.text()) && matches.complete();
+    const unsigned long count = document.replaceAll(searcher, replacement, indexed ? &matches.positions() : nullptr);
+    editor.redraw();
+
+    return count;
+}
+
+void TextEditor::findRegex(const char *pattern){
+    if(!compileRegex(pattern))
+        return;
+    last_find = pattern;
+    last_find_regex = true;
+
+    unsigned long start, end;
+    if(!regex.findWrapping(document.spans(), editor.insert_position(), start, end)){
+        notFound(pattern);
+        return;
+    }
+
+    regex_match_start = start;
+    showMatch(start, end-start);
+}
+
+bool TextEditor::findLastRegex(unsigned long before, unsigned long &start, unsigned long &end) const {
+    return regex.findLastWrapping(document.spans(), before, start, end);
+}
+
+bool TextEditor::regexMatches(unsigned long start, unsigned long end) const {
+    return regex.matchAt(document.spans(), start)==(long)end;
+}
+
+void TextEditor::replaceRegex(const char *pattern, const char *replacement){
+    if(!compileRegex(pattern))
+        return;
+
+    // Only replace the match the last find stopped at, and only if it would still match
+    // exactly the same text.
+    const TextSpans spans = document.spans();
+    const unsigned long start = regex_match_start, cursor = editor.insert_position();
+    if(last_find_regex && last_find==pattern && start<cursor && regex.matchAt(spans, start)==(long)cursor){
+        std::vector<long> groups;
+        regex.captures(spans, start, cursor, groups);
+        std::string text;
+        Regex::expand(replacement, spans, groups, text);
+
+        document.buffer().replace(start, cursor, text.c_str());
+        editor.insert_position(start+text.size());
+    }
+
+    findRegex(pattern);
+}
 
-    free((void *)text);
+unsigned long TextEditor::replaceAllRegex(const char *pattern, const char *replacement){
+    if(!compileRegex(pattern))
+        return 0;
+
+    const unsigned long count = document.replaceAll(regex, replacement);
+    editor.redraw();
+
+    return count;
+}
+
+unsigned long TextEditor::matchCount(bool &complete) const {
+    complete = matches.complete();
+    return matches.count();
+}
+
+std::shared_ptr<const std::string> TextEditor::snapshot() const {
+    if(loading())
+        return nullptr;
+
+    // Rather than waking the whole editor just to copy its text.
+    if(document.hibernating()){
+        std::string text;
+        if(!document.copyHibernated(text))
+            return nullptr;
+        return std::make_shared<const std::string>(std::move(text));
+    }
+
+    const TextSpans spans = document.spans();
+    const std::shared_ptr<std::string> text = std::make_shared<std::string>();
+    text->reserve(spans.length());
+    text->append(spans.first, spans.first_length);
+    text->append(spans.second, spans.second_length);
+    return text;
+}
+
+void TextEditor::goToLine(unsigned long line){
+    if(loading())
+        return;
+
+    // Lines are counted from 1 here.
+    editor.insert_position(document.lineStart((line>0) ? (line-1) : 0));
+    editor.show_insert_position();
+}
+
+void TextEditor::calculateAdler32(){
+    wake();
+    document.calculateChecksum();
 }
 
 void TextEditor::infoCallback(Fl_Widget *w, void *a){
@@ -182,6 +735,28 @@ void TextEditor::saveAsCallback(Fl_Widget *w, void *a){
     }
 }
 
+void TextEditor::findNextCallback(Fl_Widget *w, void *a){
+    Editor *ed = static_cast<Editor *>(a);
+    ed->findNext();
+}
+
+void TextEditor::findPreviousCallback(Fl_Widget *w, void *a){
+    Editor *ed = static_cast<Editor *>(a);
+    ed->findPrevious();
+}
+
+void TextEditor::clearMatchesCallback(Fl_Widget *w, void *a){
+    Editor *ed = static_cast<Editor *>(a);
+    ed->clearMatches();
+}
+
+void TextEditor::goToLineCallback(Fl_Widget *w, void *a){
+    Editor *ed = static_cast<Editor *>(a);
+    const char *line = fl_input("Go to line", nullptr);
+    if(line)
+        ed->goToLine(strtoul(line, nullptr, 10));
+}
+
 void TextEditor::loadCallback(Fl_Widget *w, void *a){
     Editor *ed = static_cast<Editor *>(a);
     
@@ -205,7 +780,7 @@ void TextEditor::loadCallback(Fl_Widget *w, void *a){
 }
 
 
-#define MENU_SIZE 10
+#define MENU_SIZE 14
 #define MENU_DUMMY (void *)0xDEAD
 
 static const Fl_Menu_Item menu_[MENU_SIZE] = {
@@ -217,6 +792,10 @@ static const Fl_Menu_Item menu_[MENU_SIZE] = {
         {"Edit", 0, 0, 0, FL_SUBMENU},
         {"Properties", FL_COMMAND+'h', TextEditor::infoCallback, MENU_DUMMY},
         {"Find", FL_COMMAND+'f', 0, MENU_DUMMY},
+        {"Find Next", FL_F+3, TextEditor::findNextCallback, MENU_DUMMY},
+        {"Find Previous", FL_SHIFT+FL_F+3, TextEditor::findPreviousCallback, MENU_DUMMY},
+        {"Clear Matches", 0, TextEditor::clearMatchesCallback, MENU_DUMMY},
+        {"Go to Line", FL_COMMAND+'l', TextEditor::goToLineCallback, MENU_DUMMY},
     {0},
 {0}
 };
@@ -228,10 +807,14 @@ Fl_Menu_Item *TextEditor::menu(){
 }
 
 const Fl_Menu_Item *TextEditor::prepareMenu(void(*OpenCallback_)(Fl_Widget *, void *a), void(*FindCallback_)(Fl_Widget *, void *a), void *arg_) const{
+    return PrepareMenu(this, OpenCallback_, FindCallback_, arg_);
+}
+
+const Fl_Menu_Item *TextEditor::PrepareMenu(const Editor *editor, void(*OpenCallback_)(Fl_Widget *, void *a), void(*FindCallback_)(Fl_Widget *, void *a), void *arg_){
     Fl_Menu_Item *m = menu();
     for(int i = 0; i<MENU_SIZE; i++){
         if(m[i].user_data()==MENU_DUMMY)
-            m[i].user_data((void *)this);
+            m[i].user_data((void *)editor);
     }
 
     m[1].callback(OpenCallback_);
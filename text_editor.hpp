@@ -2,13 +2,75 @@
 #include "editor.hpp"
 
 #include "flare_text_editor_widget.hpp"
+#include "flare_text_buffer.hpp"
+#include "match_index.hpp"
+#include "highlighter.hpp"
+#include "regex.hpp"
+
+#include <memory>
 
 namespace Flare {
 
 class TextEditor : public Editor {
 
+    // Declared before the widget, which still refers to it while being destroyed.
+    Document document;
     Text_Editor_Widget editor;
 
+    // Styles for highlighting and the matches of findAll. Only filled in while there is
+    // either to show.
+    Text_Buffer style;
+    Highlighter highlighter;
+    MatchIndex matches;
+
+    bool styled() const { return highlighter.active() || matches.active(); }
+    // Highlights the text as the path's extension says, or stops highlighting it.
+    void highlight();
+    // Shows the styles if there are any, otherwise stops using them.
+    void showStyles();
+
+    static void DocumentChangedCallback(unsigned long pos, unsigned long inserted, unsigned long deleted, void *a);
+    static void ScanCallback(void *a);
+    // Styles [from, to) again, and returns where that stopped, which can be further on.
+    unsigned long restyle(unsigned long from, unsigned long to);
+    void overlayMatches(unsigned long from, unsigned long to);
+
+    unsigned long textLength() const override { return document.length(); }
+    void showMatch(unsigned long at, unsigned long length) override;
+    bool findLastRegex(unsigned long before, unsigned long &start, unsigned long &end) const override;
+    bool regexMatches(unsigned long start, unsigned long end) const override;
+
+    // A load running on a worker thread. See loadInBackground.
+    struct PendingLoad;
+    std::shared_ptr<PendingLoad> pending;
+
+    static void FinishLoad(void *a);
+    void cancelLoad();
+
+    // Where loads and highlighting run. Null until the first load in the background, and
+    // until then everything is highlighted on the UI thread.
+    WorkerPool *pool;
+
+    // Lines that are left to highlight, being lexed on a worker thread.
+    struct PendingHighlight;
+    std::shared_ptr<PendingHighlight> highlighting;
+
+    static void HighlightTimeout(void *a);
+    static void FinishHighlight(void *a);
+    void scheduleHighlight();
+    void cancelHighlight();
+
+    // The text being compressed on a worker thread, before it is freed. See hibernate.
+    struct PendingHibernation;
+    std::shared_ptr<PendingHibernation> hibernation;
+    // Where the view was when the text was freed, to put it back on waking.
+    struct {
+        int insert, top_line, horizontal;
+    } hibernated_view;
+
+    static void FinishHibernation(void *a);
+    void cancelHibernation();
+
     static Fl_Menu_Item *menu();
 
 public:
@@ -20,13 +82,37 @@ public:
     void info() const override;
     bool save() override;
     bool load() override;
+    void loadInBackground(WorkerPool &pool, LoadedCallback loaded, void *arg) override;
+    bool loading() const override { return pending!=nullptr; }
+    bool hibernate(WorkerPool &pool) override;
+    void wake() override;
+    bool hibernating() const override { return hibernation!=nullptr || document.hibernating(); }
 
     void find(const char *) override;
+    void findAll(const char *) override;
+    void clearMatches() override;
+    void findNext() override;
+    void findPrevious() override;
+    void replace(const char *text, const char *replacement) override;
+    unsigned long replaceAll(const char *text, const char *replacement) override;
+    void findRegex(const char *) override;
+    void replaceRegex(const char *pattern, const char *replacement) override;
+    unsigned long replaceAllRegex(const char *pattern, const char *replacement) override;
+    unsigned long matchCount(bool &complete) const override;
+    std::shared_ptr<const std::string> snapshot() const override;
+    void goToLine(unsigned long line) override;
+
+    // The usual menu, for any editor whose callbacks are the same as these.
+    static const Fl_Menu_Item *PrepareMenu(const Editor *editor, void(*OpenCallback_)(Fl_Widget *, void *a), void(*FindCallback_)(Fl_Widget *, void *a), void *arg_);
 
     static void infoCallback(Fl_Widget *w, void *a);
     static void saveCallback(Fl_Widget *w, void *a);
     static void saveAsCallback(Fl_Widget *w, void *a);
     static void loadCallback(Fl_Widget *w, void *a);
+    static void findNextCallback(Fl_Widget *w, void *a);
+    static void findPreviousCallback(Fl_Widget *w, void *a);
+    static void clearMatchesCallback(Fl_Widget *w, void *a);
+    static void goToLineCallback(Fl_Widget *w, void *a);
 
     void calculateAdler32() override;
 
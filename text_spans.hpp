@@ -0,0 +1,20 @@
+#pragma once
+
+namespace Flare {
+
+// A read-only view of text that is stored in two contiguous pieces, such as the text on
+// either side of the gap in a gap buffer.
+struct TextSpans {
+    const char *first;
+    unsigned long first_length;
+    const char *second;
+    unsigned long second_length;
+
+    unsigned long length() const { return first_length+second_length; }
+
+    char at(unsigned long i) const {
+        return (i<first_length) ? first[i] : second[i-first_length];
+    }
+};
+
+}
@@ -0,0 +1,125 @@
+#include "text_window.hpp"
+
+#include <string>
+#include <cstring>
+#include <cstdlib>
+
+namespace Flare {
+
+// Slack after the text of the window, as with a loaded file.
+#define WINDOW_GAP 0x100
+
+// How far to look for the start or end of a line to begin or end the window at.
+#define LINE_SEARCH 0x10000
+
+TextWindow::TextWindow(unsigned long s, unsigned long m, LengthCallback length, CopyCallback copy, const void *a)
+  : window(0, WINDOW_GAP)
+  , start_(0)
+  , mirroring_(0)
+  , size(s)
+  , margin(m)
+  , display(nullptr)
+  , length_callback(length)
+  , copy_callback(copy)
+  , arg(a){
+
+    // Whoever owns the text keeps its history.
+    window.canUndo(0);
+}
+
+void TextWindow::attach(Fl_Text_Display &d){
+    display = &d;
+    display->buffer(&window);
+}
+
+unsigned long TextWindow::lineStart(unsigned long at) const {
+    const unsigned long back = (at>LINE_SEARCH) ? (at-LINE_SEARCH) : 0;
+    std::string before(at-back, '\0');
+    copy_callback(back, at-back, &before[0], arg);
+
+    const std::string::size_type newline = before.rfind('\n');
+    if(newline!=std::string::npos)
+        return back+newline+1;
+    return (back==0) ? 0 : at;
+}
+
+void TextWindow::show(unsigned long at){
+    const unsigned long length = length_callback(arg);
+    if(at>length)
+        at = length;
+
+    const unsigned long from = (at>size/2) ? lineStart(at-size/2) : 0;
+    unsigned long to = length, copied = length;
+    if(length-from>size){
+        // The text up to the next line is copied along with the window, and what isn't
+        // needed of it is left in the gap.
+        to = from+size;
+        copied = (length-to>LINE_SEARCH) ? (to+LINE_SEARCH) : length;
+    }
+
+    char * const block = (char *)malloc(copied-from+WINDOW_GAP);
+    if(copied>from)
+        copy_callback(from, copied-from, block, arg);
+
+    if(to<copied){
+        const char * const newline = (const char *)memchr(block+(to-from), '\n', copied-to);
+        to = newline ? (from+(newline-block)+1) : ((copied==length) ? length : to);
+    }
+
+    mirroring_++;
+    window.adopt(block, to-from, copied-to+WINDOW_GAP);
+    mirroring_--;
+    start_ = from;
+}
+
+void TextWindow::move(unsigned long top){
+    const unsigned long at = cursor();
+    show(top);
+
+    display->insert_position((at>=start_ && at<=end()) ? (at-start_) : (top-start_));
+    display->scroll(display->count_lines(0, top-start_, true)+1, 0);
+}
+
+bool TextWindow::follow(int first, int last){
+    const unsigned long length = window.length();
+    if((start_>0 && (unsigned long)first<margin) ||
+        (end()<length_callback(arg) && last+margin>length)){
+        move(start_+first);
+        return true;
+    }
+    return false;
+}
+
+void TextWindow::showLine(unsigned long at){
+    if(at<start_ || at>end())
+        show(at);
+    display->scroll(display->count_lines(0, at-start_, true)+1, 0);
+}
+
+void TextWindow::showMatch(unsigned long at, unsigned long length){
+    if(at<start_ || at+length>end())
+        show(at);
+
+    const int from = at-start_, to = from+length;
+    window.highlight(from, to);
+    display->insert_position(to);
+    display->show_insert_position();
+    display->redraw();
+}
+
+void TextWindow::mirror(unsigned long at, unsigned long removed, unsigned long inserted){
+    if(at<start_ || at+removed>end()){
+        show(at);
+        return;
+    }
+
+    std::string text(inserted, '\0');
+    if(inserted>0)
+        copy_callback(at, inserted, &text[0], arg);
+
+    mirroring_++;
+    window.replace(at-start_, at-start_+removed, text.c_str());
+    mirroring_--;
+}
+
+}
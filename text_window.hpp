@@ -0,0 +1,76 @@
+#pragma once
+
+#include "flare_text_buffer.hpp"
+
+#include <FL/Fl_Text_Display.H>
+
+namespace Flare {
+
+// A window of a few megabytes of a text too big to give a display all at once, since FLTK can
+// only show text that is in an Fl_Text_Buffer. The window is moved as the display gets near
+// either end of it. Positions are in the whole text, except where they say otherwise.
+//
+// The text itself is only reached through the callbacks, so it can be anything that can copy
+// a range of itself out.
+class TextWindow {
+public:
+
+    // How long the whole text is, and copying `length' bytes of it from `at' into `into'.
+    typedef unsigned long (*LengthCallback)(const void *arg);
+    typedef void (*CopyCallback)(unsigned long at, unsigned long length, char *into, const void *arg);
+
+private:
+
+    Text_Buffer window;
+    unsigned long start_;
+    // Set while the window is being changed to match the text.
+    unsigned mirroring_;
+
+    // How much text is in the window, and how close the display can get to either end of it.
+    const unsigned long size, margin;
+
+    Fl_Text_Display *display;
+
+    const LengthCallback length_callback;
+    const CopyCallback copy_callback;
+    const void * const arg;
+
+public:
+
+    TextWindow(unsigned long size, unsigned long margin, LengthCallback length, CopyCallback copy, const void *arg);
+
+    // Shows the window in the display. Has to be called before anything is shown.
+    void attach(Fl_Text_Display &d);
+
+    Text_Buffer &buffer(){ return window; }
+    const Text_Buffer &buffer() const { return window; }
+    // Where the window starts and ends in the text.
+    unsigned long start() const { return start_; }
+    unsigned long end() const { return start_+window.length(); }
+    // Where the display's cursor is.
+    unsigned long cursor() const { return start_+display->insert_position(); }
+    // True while the window is being changed to match the text, rather than being edited.
+    bool mirroring() const { return mirroring_>0u; }
+
+    // The start of the line `at' is in, if it is close enough to find.
+    unsigned long lineStart(unsigned long at) const;
+
+    // Fills the window with the text around `at', starting and ending at lines if it can.
+    void show(unsigned long at);
+    // Moves the window so that `top' stays where it is in the display.
+    void move(unsigned long top);
+    // Moves the window if the display, which shows [first, last) of it, is near either end
+    // of it. Returns true if it moved.
+    bool follow(int first, int last);
+
+    // Scrolls the display so that the line starting at `at' is at the top.
+    void showLine(unsigned long at);
+    // Highlights some text and moves the cursor to the end of it.
+    void showMatch(unsigned long at, unsigned long length);
+    // Makes the same change to the window as was made to the text, or shows the window
+    // around it if the change wasn't all inside the window.
+    void mirror(unsigned long at, unsigned long removed, unsigned long inserted);
+
+};
+
+}
@@ -0,0 +1,100 @@
+#include "undo_arena.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace Flare {
+
+UndoArena::UndoArena(unsigned long chunk_size_)
+  : chunk_size(chunk_size_)
+  , current(nullptr)
+  , spare(nullptr){}
+
+UndoArena::~UndoArena(){
+    // Anything still referring to text in the chunks must be gone by now.
+    free(current);
+    free(spare);
+}
+
+UndoArena::Chunk *UndoArena::newChunk(unsigned long size){
+    if(size==chunk_size && spare){
+        Chunk * const chunk = spare;
+        spare = nullptr;
+        return chunk;
+    }
+
+    Chunk * const chunk = static_cast<Chunk *>(malloc(sizeof(Chunk)+size));
+    chunk->arena = this;
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->refs = 0;
+    return chunk;
+}
+
+void UndoArena::retire(Chunk *chunk){
+    if(!spare && chunk->size==chunk_size){
+        chunk->used = 0;
+        spare = chunk;
+    }
+    else
+        free(chunk);
+}
+
+char *UndoArena::allocate(unsigned long length, Chunk *&chunk){
+    if(!current || current->size-current->used<length){
+        // Text too big for a normal chunk gets one of its own, and the current one stays.
+        if(length>chunk_size/4){
+            chunk = newChunk(length);
+            chunk->used = length;
+            chunk->refs = 1;
+            return chunk->data();
+        }
+
+        if(current && current->refs==0)
+            retire(current);
+        current = newChunk(chunk_size);
+    }
+
+    chunk = current;
+    char * const text = current->data()+current->used;
+    current->used+=length;
+    current->refs++;
+    return text;
+}
+
+char *UndoArena::extend(char *text, unsigned long length, unsigned long extra, Chunk *&chunk){
+    if(text+length==chunk->data()+chunk->used && chunk->size-chunk->used>=extra){
+        chunk->used+=extra;
+        return text;
+    }
+
+    // Text with a chunk of its own is grown by at least double, so that adding to a big step
+    // a key at a time doesn't copy all of it each time.
+    if(chunk!=current && chunk->refs==1 && text==chunk->data() && length==chunk->used){
+        const unsigned long needed = length+extra, size = (needed>chunk->size*2) ? needed : chunk->size*2;
+        chunk = static_cast<Chunk *>(realloc(chunk, sizeof(Chunk)+size));
+        chunk->size = size;
+        chunk->used = needed;
+        return chunk->data();
+    }
+
+    Chunk * const old_chunk = chunk;
+    char * const moved = allocate(length+extra, chunk);
+    memcpy(moved, text, length);
+    Release(old_chunk);
+    return moved;
+}
+
+void UndoArena::Release(Chunk *chunk){
+    UndoArena * const arena = chunk->arena;
+    if(--chunk->refs>0)
+        return;
+
+    // The current chunk can just be reused from the start.
+    if(chunk==arena->current)
+        chunk->used = 0;
+    else
+        arena->retire(chunk);
+}
+
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+namespace Flare {
+
+// Holds the text of undo steps in large chunks, so that recording an edit doesn't need
+// its own allocation. Each chunk counts the steps whose text it holds, and is freed as a
+// whole once the last of them is dropped.
+//
+// Space is handed out from the end of the newest chunk. The last piece handed out can
+// also grow in place, which is what lets typing be added to the current undo step
+// without copying it.
+class UndoArena {
+public:
+
+    class Chunk {
+        friend class UndoArena;
+        UndoArena *arena;
+        unsigned long size, used;
+        unsigned refs;
+
+        char *data(){ return reinterpret_cast<char *>(this+1); }
+    };
+
+private:
+
+    unsigned long chunk_size;
+    // Where new text goes. Not freed while it is current, even when nothing refers to it.
+    Chunk *current;
+    // An empty chunk kept back so that filling chunks up in turn doesn't keep calling malloc.
+    Chunk *spare;
+
+    Chunk *newChunk(unsigned long size);
+    void retire(Chunk *chunk);
+
+public:
+
+    explicit UndoArena(unsigned long chunk_size_ = 0x10000);
+    ~UndoArena();
+
+    // Returns room for `length' bytes, and sets `chunk' to the chunk it is in. The chunk
+    // holds a reference for the text until Release is called.
+    char *allocate(unsigned long length, Chunk *&chunk);
+
+    // Makes `length' bytes of text at `text', allocated from `chunk', `extra' bytes longer.
+    // This is done in place if it was the last text allocated and the chunk has room.
+    // Otherwise the text is copied somewhere new, and `chunk' is updated. Text too big to
+    // share a chunk grows geometrically, so growing it a little at a time is amortized O(1).
+    char *extend(char *text, unsigned long length, unsigned long extra, Chunk *&chunk);
+
+    // Drops the reference to a chunk for one piece of text.
+    static void Release(Chunk *chunk);
+
+};
+
+}
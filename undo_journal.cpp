@@ -0,0 +1,142 @@
+#include "undo_journal.hpp"
+
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+namespace Flare {
+
+// Fixed size fields, so the file doesn't depend on how the compiler lays out Record.
+static const unsigned long header_length = 12, trailer_length = 4;
+
+static bool WriteAll(int fd, const void *data, unsigned long length, unsigned long at){
+    const char *from = static_cast<const char *>(data);
+    while(length>0){
+        const ssize_t written = pwrite(fd, from, length, at);
+        if(written<0){
+            if(errno==EINTR)
+                continue;
+            return false;
+        }
+        from+=written;
+        at+=written;
+        length-=written;
+    }
+    return true;
+}
+
+static void Shrink(int fd, unsigned long length){
+    // Failing to give the space back is harmless, the next push just writes over it.
+    const int result = ftruncate(fd, length);
+    (void)result;
+}
+
+static void PutInt(unsigned char *into, uint32_t value){
+    into[0] = value;
+    into[1] = value>>8;
+    into[2] = value>>16;
+    into[3] = value>>24;
+}
+
+static uint32_t GetInt(const unsigned char *from){
+    return from[0] | (from[1]<<8) | (from[2]<<16) | ((uint32_t)from[3]<<24);
+}
+
+UndoJournal::UndoJournal()
+  : fd(-1)
+  , end(0){}
+
+UndoJournal::~UndoJournal(){
+    if(fd>=0)
+        close(fd);
+}
+
+bool UndoJournal::open(){
+    if(fd>=0)
+        return true;
+
+    const char *directory = getenv("TMPDIR");
+    if(!directory || directory[0]==0)
+        directory = "/tmp";
+
+    std::string path = directory;
+    path+="/flare-undo-XXXXXX";
+    fd = mkstemp(&(path[0]));
+    if(fd<0)
+        return false;
+
+    // Nothing else needs to find it, and this way it can't be left behind.
+    unlink(path.c_str());
+    return true;
+}
+
+bool UndoJournal::push(const Record &record, const char *text, unsigned long length){
+    const unsigned long total = header_length+length+trailer_length;
+    if(total>UINT32_MAX || !open())
+        return false;
+
+    unsigned char header[header_length], trailer[trailer_length];
+    PutInt(header, record.pos);
+    PutInt(header+4, record.add);
+    PutInt(header+8, record.del);
+    PutInt(trailer, total);
+
+    if(!WriteAll(fd, header, header_length, end) ||
+        !WriteAll(fd, text, length, end+header_length) ||
+        !WriteAll(fd, trailer, trailer_length, end+header_length+length)){
+        // Whatever was written past the end will just be written over.
+        return false;
+    }
+
+    end+=total;
+    return true;
+}
+
+bool UndoJournal::pop(Record &record, UndoArena &arena, char *&text, UndoArena::Chunk *&chunk){
+    if(end==0)
+        return false;
+
+    unsigned char trailer[trailer_length];
+    if(pread(fd, trailer, trailer_length, end-trailer_length)!=(ssize_t)trailer_length)
+        return false;
+
+    const unsigned long total = GetInt(trailer), start = end-total;
+    if(total<header_length+trailer_length || total>end)
+        return false;
+
+    // Map just the pages the record is on.
+    const unsigned long page = sysconf(_SC_PAGESIZE), map_start = start-(start%page),
+        map_length = end-map_start;
+    void * const mapped = mmap(nullptr, map_length, PROT_READ, MAP_SHARED, fd, map_start);
+    if(mapped==MAP_FAILED)
+        return false;
+
+    const unsigned char * const data = static_cast<const unsigned char *>(mapped)+(start-map_start);
+    record.pos = GetInt(data);
+    record.add = GetInt(data+4);
+    record.del = GetInt(data+8);
+
+    const unsigned long length = total-header_length-trailer_length;
+    text = arena.allocate(length, chunk);
+    memcpy(text, data+header_length, length);
+
+    munmap(mapped, map_length);
+
+    end = start;
+    Shrink(fd, end);
+    return true;
+}
+
+void UndoJournal::clear(){
+    end = 0;
+    if(fd>=0)
+        Shrink(fd, 0);
+}
+
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "undo_arena.hpp"
+
+namespace Flare {
+
+// An append-only file of undo steps that no longer fit in memory. Steps are pushed and
+// popped at the end, like a stack, and read back by mapping just the step being popped.
+//
+// Each record is the step's position and lengths, then its text, then the length of the
+// whole record so that the one before it can be found. That way nothing about the steps
+// has to be kept in memory at all.
+//
+// The file is created on the first push and unlinked right away, so it goes away with
+// the editor even if Flare doesn't exit cleanly.
+class UndoJournal {
+
+    int fd;
+    // Everything after this in the file has been popped.
+    unsigned long end;
+
+    bool open();
+
+public:
+
+    struct Record {
+        int pos, add, del;
+    };
+
+    UndoJournal();
+    ~UndoJournal();
+
+    bool empty() const { return end==0; }
+    unsigned long bytes() const { return end; }
+
+    // Returns false if the step could not be written, in which case it is simply lost.
+    bool push(const Record &record, const char *text, unsigned long length);
+
+    // Reads the newest step, with its text copied into the arena, and removes it.
+    bool pop(Record &record, UndoArena &arena, char *&text, UndoArena::Chunk *&chunk);
+
+    void clear();
+
+};
+
+}
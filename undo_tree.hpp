@@ -0,0 +1,385 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <set>
+#include <utility>
+#include <algorithm>
+#include <cstddef>
+
+namespace Flare {
+
+// Undo history that keeps every branch. Each node is a state of the document, and holds
+// only the step that leads to it from its parent, so branches share everything up to
+// where they split.
+//
+// Undo goes to the parent and redo to the child most recently come from. earlier() and
+// later() go through the states in the order they were made instead, whichever branch
+// they are on.
+//
+// The steps are kept under a byte budget. Whatever was visited least recently goes first:
+// either a leaf of some other branch, or the oldest step of the history, which is handed
+// to the evictor, if there is one, so it can be kept somewhere else.
+template<class T, void(*Deleter)(T), size_t (*Sizer)(size_t, T)>
+class UndoTree {
+public:
+
+    typedef void (*Evictor)(T, void *);
+
+    struct Move {
+        T step;
+        bool undo;
+    };
+
+private:
+
+    static const unsigned none = ~0u;
+
+    struct Node {
+        // Goes from the parent's state to this one. Unused in the root.
+        T step;
+        size_t cost;
+        // When the state was first made, and how far it is from the root. Either can go
+        // below zero, as older steps are brought back as new roots.
+        long time, depth;
+        unsigned long visited;
+        unsigned parent, first_child, prev_sibling, next_sibling, redo;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<unsigned> free_nodes;
+    unsigned root, current;
+    size_t budget_, bytes_, count;
+    long next_time;
+    unsigned long clock;
+
+    // Live nodes in the order they were made, for earlier() and later(). Removed nodes
+    // are left in as `none' until there are as many of them as there are live nodes.
+    std::deque<std::pair<long, unsigned> > timeline;
+    size_t dead;
+
+    // Leaves by when they were last visited, so the least recently visited is first.
+    std::set<std::pair<unsigned long, unsigned> > leaves;
+
+    Evictor evictor;
+    void *evictor_arg;
+
+    bool isLeaf(unsigned n) const { return nodes[n].first_child==none; }
+
+    unsigned allocate(){
+        if(!free_nodes.empty()){
+            const unsigned n = free_nodes.back();
+            free_nodes.pop_back();
+            return n;
+        }
+        nodes.push_back(Node());
+        return nodes.size()-1;
+    }
+
+    void visit(unsigned n){
+        Node &node = nodes[n];
+        if(isLeaf(n))
+            leaves.erase(std::make_pair(node.visited, n));
+        node.visited = ++clock;
+        if(isLeaf(n))
+            leaves.insert(std::make_pair(node.visited, n));
+    }
+
+    std::deque<std::pair<long, unsigned> >::iterator findTime(long time){
+        return std::lower_bound(timeline.begin(), timeline.end(), std::make_pair(time, 0u));
+    }
+
+    void forgetTime(long time){
+        findTime(time)->second = none;
+        dead++;
+        if(dead>=16 && dead>timeline.size()/2){
+            std::deque<std::pair<long, unsigned> > live;
+            for(std::deque<std::pair<long, unsigned> >::const_iterator i = timeline.begin(); i!=timeline.end(); i++){
+                if(i->second!=none)
+                    live.push_back(*i);
+            }
+            timeline.swap(live);
+            dead = 0;
+        }
+    }
+
+    void addChild(unsigned parent, unsigned child){
+        Node &p = nodes[parent], &c = nodes[child];
+        if(isLeaf(parent))
+            leaves.erase(std::make_pair(p.visited, parent));
+        c.parent = parent;
+        c.prev_sibling = none;
+        c.next_sibling = p.first_child;
+        if(p.first_child!=none)
+            nodes[p.first_child].prev_sibling = child;
+        p.first_child = child;
+        p.redo = child;
+    }
+
+    // Removes a leaf other than the current state.
+    void prune(unsigned n){
+        Node &node = nodes[n];
+        leaves.erase(std::make_pair(node.visited, n));
+        forgetTime(node.time);
+        Deleter(node.step);
+        bytes_ -= node.cost;
+        // Nodes with no cost have nothing to delete when the tree is cleared.
+        node.cost = 0;
+        count--;
+
+        Node &parent = nodes[node.parent];
+        if(node.prev_sibling!=none)
+            nodes[node.prev_sibling].next_sibling = node.next_sibling;
+        else
+            parent.first_child = node.next_sibling;
+        if(node.next_sibling!=none)
+            nodes[node.next_sibling].prev_sibling = node.prev_sibling;
+
+        if(parent.redo==n)
+            parent.redo = parent.first_child;
+        if(parent.first_child==none)
+            leaves.insert(std::make_pair(parent.visited, node.parent));
+
+        free_nodes.push_back(n);
+    }
+
+    // Drops the root, handing the step to its only child to the evictor. The child is the
+    // new root.
+    void spillRoot(){
+        const unsigned old_root = root;
+        Node &child = nodes[nodes[old_root].first_child];
+        root = nodes[old_root].first_child;
+        forgetTime(nodes[old_root].time);
+        free_nodes.push_back(old_root);
+
+        if(evictor)
+            evictor(child.step, evictor_arg);
+        Deleter(child.step);
+        bytes_ -= child.cost;
+        child.cost = 0;
+        child.parent = none;
+        count--;
+    }
+
+    // Removes whatever was visited least recently until the tree is in budget, but never
+    // the current state or the step leading to it.
+    void trim(){
+        while(bytes_>budget_){
+            std::set<std::pair<unsigned long, unsigned> >::const_iterator leaf = leaves.begin();
+            if(leaf!=leaves.end() && leaf->second==current)
+                leaf++;
+
+            const bool can_spill = root!=current && nodes[nodes[root].first_child].next_sibling==none;
+            if(can_spill && (leaf==leaves.end() || nodes[root].visited<leaf->first))
+                spillRoot();
+            else if(leaf!=leaves.end())
+                prune(leaf->second);
+            else
+                break;
+        }
+    }
+
+    void reset(){
+        nodes.clear();
+        free_nodes.clear();
+        timeline.clear();
+        leaves.clear();
+        dead = 0;
+        bytes_ = 0;
+        count = 0;
+        clock = 0;
+        next_time = 1;
+
+        root = current = allocate();
+        Node &node = nodes[root];
+        node.cost = 0;
+        node.time = node.depth = 0;
+        node.visited = 0;
+        node.parent = node.first_child = node.prev_sibling = node.next_sibling = node.redo = none;
+        timeline.push_back(std::make_pair(0l, root));
+        leaves.insert(std::make_pair(0ul, root));
+    }
+
+    // Moves to `target', filling `moves' with the steps that take the document there.
+    void travel(unsigned target, std::vector<Move> &moves){
+        std::vector<unsigned> down;
+        unsigned from = current, to = target;
+        while(nodes[from].depth>nodes[to].depth){
+            const Move move = {nodes[from].step, true};
+            moves.push_back(move);
+            from = nodes[from].parent;
+        }
+        while(nodes[to].depth>nodes[from].depth){
+            down.push_back(to);
+            to = nodes[to].parent;
+        }
+        while(from!=to){
+            const Move move = {nodes[from].step, true};
+            moves.push_back(move);
+            from = nodes[from].parent;
+            down.push_back(to);
+            to = nodes[to].parent;
+        }
+
+        visit(from);
+        for(std::vector<unsigned>::const_reverse_iterator i = down.rbegin(); i!=down.rend(); i++){
+            const Move move = {nodes[*i].step, false};
+            moves.push_back(move);
+            nodes[nodes[*i].parent].redo = *i;
+            visit(*i);
+        }
+        current = target;
+    }
+
+public:
+
+    explicit UndoTree(size_t budget = 0x80000)
+      : budget_(budget)
+      , evictor(nullptr)
+      , evictor_arg(nullptr){
+        reset();
+    }
+
+    ~UndoTree(){
+        clear();
+    }
+
+    // Number of steps held, across every branch.
+    size_t size() const { return count; }
+    // Total size of the steps, as measured by Sizer.
+    size_t bytes() const { return bytes_; }
+
+    size_t budget() const { return budget_; }
+    void budget(size_t b){
+        budget_ = b;
+        trim();
+    }
+
+    // Sets something to be called with the oldest step of the history when it is dropped
+    // to stay in budget, before it is deleted. Pruned branches aren't passed to it.
+    void evictTo(Evictor e, void *arg){
+        evictor = e;
+        evictor_arg = arg;
+    }
+
+    bool atRoot() const { return current==root; }
+    bool canRedo() const { return nodes[current].redo!=none; }
+
+    // True if the current state is the newest on its branch, so its step can be added to
+    // rather than starting a new one.
+    bool atTip() const { return current!=root && isLeaf(current); }
+
+    // The step that leads to the current state. Call currentChanged() after changing it.
+    T &step() { return nodes[current].step; }
+
+    void currentChanged(){
+        Node &node = nodes[current];
+        bytes_ -= node.cost;
+        node.cost = Sizer(0, node.step)+sizeof(Node);
+        bytes_ += node.cost;
+        trim();
+    }
+
+    // Adds a new state after the current one, and moves to it.
+    void push(T item){
+        const unsigned n = allocate();
+        addChild(current, n);
+
+        Node &node = nodes[n];
+        node.step = item;
+        node.cost = Sizer(0, item)+sizeof(Node);
+        node.time = next_time++;
+        node.depth = nodes[current].depth+1;
+        node.first_child = node.redo = none;
+        node.visited = ++clock;
+        timeline.push_back(std::make_pair(node.time, n));
+        leaves.insert(std::make_pair(node.visited, n));
+
+        bytes_ += node.cost;
+        count++;
+        current = n;
+        trim();
+    }
+
+    // Adds a state before the root, where `item' leads from the new root to the old one,
+    // and moves to it. This is for bringing back steps that were evicted.
+    void pushRoot(T item){
+        const unsigned n = allocate(), old_root = root;
+        Node &node = nodes[n];
+        node.cost = 0;
+        node.time = nodes[old_root].time-1;
+        node.depth = nodes[old_root].depth-1;
+        node.parent = node.first_child = node.prev_sibling = node.next_sibling = node.redo = none;
+        node.visited = ++clock;
+        addChild(n, old_root);
+
+        Node &old = nodes[old_root];
+        old.step = item;
+        old.cost = Sizer(0, item)+sizeof(Node);
+        // Not necessarily at the front, there can be removed nodes before it.
+        timeline.insert(findTime(node.time), std::make_pair(node.time, n));
+
+        bytes_ += old.cost;
+        count++;
+        root = current = n;
+        trim();
+    }
+
+    // Moves to the parent, and returns the step to undo to get there.
+    T undo(){
+        const T that = nodes[current].step;
+        const unsigned parent = nodes[current].parent;
+        nodes[parent].redo = current;
+        current = parent;
+        visit(current);
+        return that;
+    }
+
+    // Moves to the child most recently come from, and gets the step to redo to get there.
+    bool redo(T &step){
+        const unsigned child = nodes[current].redo;
+        if(child==none)
+            return false;
+        current = child;
+        visit(current);
+        step = nodes[current].step;
+        return true;
+    }
+
+    // Moves to the state made just before the current one, or just after it, and fills
+    // `moves' with the steps to undo or redo to get there, in order. Only the steps between
+    // the two states and the point where their branches meet are gone through.
+    bool earlier(std::vector<Move> &moves){
+        std::deque<std::pair<long, unsigned> >::iterator i = findTime(nodes[current].time);
+        while(i!=timeline.begin()){
+            if((--i)->second!=none){
+                travel(i->second, moves);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool later(std::vector<Move> &moves){
+        std::deque<std::pair<long, unsigned> >::iterator i = findTime(nodes[current].time);
+        while(++i!=timeline.end()){
+            if(i->second!=none){
+                travel(i->second, moves);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void clear(){
+        for(typename std::vector<Node>::const_iterator i = nodes.begin(); i!=nodes.end(); i++){
+            const unsigned n = i-nodes.begin();
+            if(n!=root && i->cost>0)
+                Deleter(i->step);
+        }
+        reset();
+    }
+
+};
+
+}
@@ -0,0 +1,73 @@
+#include "worker_pool.hpp"
+
+#include <FL/Fl.H>
+
+#include <chrono>
+
+namespace Flare {
+
+WorkerPool::WorkerPool(unsigned thread_count)
+  : stopping(false){
+
+    if(thread_count==0)
+        thread_count = std::thread::hardware_concurrency();
+    if(thread_count==0)
+        thread_count = 2;
+
+    threads.reserve(thread_count);
+    for(unsigned i = 0; i<thread_count; i++)
+        threads.emplace_back(&WorkerPool::run, this);
+}
+
+WorkerPool::~WorkerPool(){
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        jobs.clear();
+    }
+    wake.notify_all();
+
+    for(std::vector<std::thread>::iterator i = threads.begin(); i!=threads.end(); i++)
+        i->join();
+}
+
+void WorkerPool::post(const std::function<void()> &job){
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(job);
+    }
+    wake.notify_one();
+}
+
+void WorkerPool::run(){
+    while(true){
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while(jobs.empty() && !stopping)
+                wake.wait(lock);
+
+            if(stopping)
+                return;
+
+            job.swap(jobs.front());
+            jobs.pop_front();
+        }
+        job();
+    }
+}
+
+bool WorkerPool::awake(void (*callback)(void *), void *arg){
+    // FLTK's awake queue has a fixed size, and it can fill up when lots of jobs finish at once.
+    while(Fl::awake(callback, arg)!=0){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(stopping)
+                return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+}
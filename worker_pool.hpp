@@ -0,0 +1,52 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <deque>
+
+namespace Flare {
+
+// A fixed set of threads that run queued jobs in the order they were posted.
+// Jobs must not touch any widgets. Anything that has to go back to the UI should be
+// handed over with AwakeUI.
+class WorkerPool {
+
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()> > jobs;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping;
+
+    void run();
+
+public:
+
+    // A thread count of 0 uses one thread per core.
+    explicit WorkerPool(unsigned thread_count = 0);
+    // Waits for running jobs to finish. Jobs that have not started yet are dropped.
+    ~WorkerPool();
+
+    void post(const std::function<void()> &job);
+
+    unsigned threadCount() const { return threads.size(); }
+
+    // Fl::awake, but retries while FLTK's message queue is full instead of losing the
+    // message. Gives up and returns false once the pool is being destroyed, since nothing
+    // empties the queue after Fl::run returns. For jobs of this pool, see AwakeUI.
+    bool awake(void (*callback)(void *), void *arg);
+
+};
+
+// Hands `arg' to `callback' on the UI thread, from a job of `pool'. If the pool is being
+// destroyed, the callback never runs and `arg' is deleted instead.
+template<class T>
+void AwakeUI(WorkerPool &pool, void (*callback)(void *), T *arg){
+    if(!pool.awake(callback, arg))
+        delete arg;
+}
+
+}